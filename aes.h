@@ -0,0 +1,90 @@
+#ifndef __AES_H__
+#define __AES_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+// internal interface between aes128.cpp and the AES backends
+// round keys are little endian words, i.e. the byte order of FIPS-197
+// dec_roundkeys are for the equivalent inverse cipher, in decryption order
+//
+// the kernels are templates on the number of rounds: 10, 12 and 14 for
+// AES-128, AES-192 and AES-256(Nk = rounds - 6 key words)
+// each one is instantiated in its backend, so the round loops are unrolled
+// without any branch on the key size
+const int aes_max_rounds = 14;
+
+// AES-NI(aesni.cpp)
+// key expansion of AES-128 with AESKEYGENASSIST, other key sizes use the
+// portable key expansion, the layout is the same
+void aesni_expand_key(const uint8_t key[16], uint32_t roundkeys[(10 + 1) * 4]);
+template <int rounds>
+void aesni_expand_dec_key(const uint32_t roundkeys[(rounds + 1) * 4],
+                          uint32_t dec_roundkeys[(rounds + 1) * 4]);
+template <int rounds>
+void aesni_cbc_encrypt(const uint32_t roundkeys[(rounds + 1) * 4],
+                       const uint8_t iv[16], const uint8_t *input,
+                       uint8_t *output, size_t blocks);
+template <int rounds>
+void aesni_cbc_decrypt(const uint32_t dec_roundkeys[(rounds + 1) * 4],
+                       const uint8_t iv[16], const uint8_t *input,
+                       uint8_t *output, size_t blocks);
+template <int rounds>
+void aesni_ecb_encrypt(const uint32_t roundkeys[(rounds + 1) * 4],
+                       const uint8_t *input, uint8_t *output, size_t blocks);
+template <int rounds>
+void aesni_ecb_decrypt(const uint32_t dec_roundkeys[(rounds + 1) * 4],
+                       const uint8_t *input, uint8_t *output, size_t blocks);
+// CBC encryption of up to 8 streams with different keys, see cbc_multi_fn
+template <int rounds>
+void aesni_cbc_encrypt_multi(const uint32_t *const roundkeys[8],
+                             uint8_t ivs[8 * 16], const uint8_t *const input[8],
+                             uint8_t *const output[8], size_t streams,
+                             size_t blocks);
+
+// bitsliced AES(bsaes.cpp), constant time
+// round keys in bitsliced form, see bs_ortho()
+template <int rounds>
+void bsaes_expand_key(const uint32_t roundkeys[(rounds + 1) * 4],
+                      uint64_t sk[(rounds + 1) * 8]);
+// ECB on independent blocks, 8 or 16 at a time
+template <int rounds>
+void bsaes_crypt_blocks(bool encrypt, const uint64_t sk[(rounds + 1) * 8],
+                        const uint8_t *input, uint8_t *output, size_t blocks);
+// CBC encryption of up to 8 streams, stream j with the bitsliced key sk[j]
+template <int rounds>
+void bsaes_cbc_encrypt_multi(const uint64_t *const sk[8], uint8_t ivs[8 * 16],
+                             const uint8_t *const input[8],
+                             uint8_t *const output[8], size_t streams,
+                             size_t blocks);
+
+// vector permute AES(vpaes.cpp), constant time, needs SSSE3
+// the round keys carry the basis changes of the state, computed from both the
+// round keys and the round keys of the equivalent inverse cipher
+template <int rounds>
+void vpaes_expand_key(const uint32_t roundkeys[(rounds + 1) * 4],
+                      const uint32_t dec_roundkeys[(rounds + 1) * 4],
+                      uint32_t vp_roundkeys[(rounds + 1) * 4],
+                      uint32_t vp_dec_roundkeys[(rounds + 1) * 4]);
+template <int rounds>
+void vpaes_cbc_encrypt(const uint32_t vp_roundkeys[(rounds + 1) * 4],
+                       const uint8_t iv[16], const uint8_t *input,
+                       uint8_t *output, size_t blocks);
+template <int rounds>
+void vpaes_cbc_decrypt(const uint32_t vp_dec_roundkeys[(rounds + 1) * 4],
+                       const uint8_t iv[16], const uint8_t *input,
+                       uint8_t *output, size_t blocks);
+template <int rounds>
+void vpaes_ecb_encrypt(const uint32_t vp_roundkeys[(rounds + 1) * 4],
+                       const uint8_t *input, uint8_t *output, size_t blocks);
+template <int rounds>
+void vpaes_ecb_decrypt(const uint32_t vp_dec_roundkeys[(rounds + 1) * 4],
+                       const uint8_t *input, uint8_t *output, size_t blocks);
+// CBC encryption of up to 8 streams with different keys, see cbc_multi_fn
+template <int rounds>
+void vpaes_cbc_encrypt_multi(const uint32_t *const vp_roundkeys[8],
+                             uint8_t ivs[8 * 16], const uint8_t *const input[8],
+                             uint8_t *const output[8], size_t streams,
+                             size_t blocks);
+
+#endif
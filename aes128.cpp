@@ -1,4 +1,7 @@
 #include "crypto.h"
+#include "aes.h"
+#include "modes.h"
+#include "util.h"
 #include <cassert>
 #include <cstdio>
 #include <cstring>
@@ -11,7 +14,7 @@ using namespace std;
 // https://kavaliro.com/wp-content/uploads/2014/03/AES.pdf
 
 // S-box(Figure 7)
-const uint32_t s[] = {
+constexpr uint32_t s[] = {
     0x63, 0x7c, 0x77, 0x7b, 0xf2, 0x6b, 0x6f, 0xc5, 0x30, 0x01, 0x67, 0x2b,
     0xfe, 0xd7, 0xab, 0x76, 0xca, 0x82, 0xc9, 0x7d, 0xfa, 0x59, 0x47, 0xf0,
     0xad, 0xd4, 0xa2, 0xaf, 0x9c, 0xa4, 0x72, 0xc0, 0xb7, 0xfd, 0x93, 0x26,
@@ -36,7 +39,7 @@ const uint32_t s[] = {
     0xb0, 0x54, 0xbb, 0x16};
 
 // Inverse S-box(Figure 14)
-const uint32_t inv_s[] = {
+constexpr uint32_t inv_s[] = {
     0x52, 0x09, 0x6a, 0xd5, 0x30, 0x36, 0xa5, 0x38, 0xbf, 0x40, 0xa3, 0x9e,
     0x81, 0xf3, 0xd7, 0xfb, 0x7c, 0xe3, 0x39, 0x82, 0x9b, 0x2f, 0xff, 0x87,
     0x34, 0x8e, 0x43, 0x44, 0xc4, 0xde, 0xe9, 0xcb, 0x54, 0x7b, 0x94, 0x32,
@@ -61,9 +64,9 @@ const uint32_t inv_s[] = {
     0x55, 0x21, 0x0c, 0x7d};
 
 // Rcon
-const uint32_t rcon[] = {0x01000000, 0x02000000, 0x04000000, 0x08000000,
-                         0x10000000, 0x20000000, 0x40000000, 0x80000000,
-                         0x1B000000, 0x36000000};
+// words are little endian, so Rcon lives in the lowest byte
+const uint32_t rcon[] = {0x01, 0x02, 0x04, 0x08, 0x10,
+                         0x20, 0x40, 0x80, 0x1B, 0x36};
 
 inline uint32_t subword(uint32_t input) {
   // apply sbox to each byte
@@ -75,29 +78,11 @@ inline uint32_t subword(uint32_t input) {
   return output;
 }
 
-inline void add_round_key(uint8_t state[16], const uint32_t *roundkey) {
-  for (int i = 0; i < 16; i++) {
-    // column major order
-    state[i] ^= (roundkey[i / 4] >> (8 * (3 - i % 4))) & 0xFF;
-  }
-}
-
-inline void print_state(const uint8_t state[16]) {
-  printf("state:\n");
-  for (int i = 0; i < 4; i++) {
-    for (int j = 0; j < 4; j++) {
-      printf("%02x ", state[i + j * 4]);
-    }
-    printf("\n");
-  }
-}
-
 // modulo x^8 + x^4 + x^3 + x + 1
 // 0b100011011
 // (0b1xxxxxxx << 1) ^ 0b100011011
-inline uint8_t mul_2(uint8_t input) {
-  uint8_t output;
-  output = input << 1;
+constexpr uint8_t mul_2(uint8_t input) {
+  uint8_t output = input << 1;
   if (input & 0x80) {
     // handle modulo
     output ^= 0b00011011;
@@ -105,283 +90,772 @@ inline uint8_t mul_2(uint8_t input) {
   return output;
 }
 
-inline uint8_t mul_3(uint8_t input) {
-  uint8_t input2 = mul_2(input);
-  uint8_t output = input2 ^ input;
-  return output;
-}
+constexpr uint8_t mul_3(uint8_t input) { return mul_2(input) ^ input; }
 
 // 9 = 0b1001
-inline uint8_t mul_9(uint8_t input) {
-  uint8_t input2 = mul_2(input);
-  uint8_t input4 = mul_2(input2);
-  uint8_t input8 = mul_2(input4);
-  uint8_t output = input8 ^ input;
-  return output;
+constexpr uint8_t mul_9(uint8_t input) {
+  return mul_2(mul_2(mul_2(input))) ^ input;
 }
 
 // b = 0b1011
-inline uint8_t mul_b(uint8_t input) {
-  uint8_t input2 = mul_2(input);
-  uint8_t input4 = mul_2(input2);
-  uint8_t input8 = mul_2(input4);
-  uint8_t output = input8 ^ input2 ^ input;
-  return output;
+constexpr uint8_t mul_b(uint8_t input) {
+  return mul_2(mul_2(mul_2(input))) ^ mul_2(input) ^ input;
 }
 
 // d = 0b1101
-inline uint8_t mul_d(uint8_t input) {
-  uint8_t input2 = mul_2(input);
-  uint8_t input4 = mul_2(input2);
-  uint8_t input8 = mul_2(input4);
-  uint8_t output = input8 ^ input4 ^ input;
-  return output;
+constexpr uint8_t mul_d(uint8_t input) {
+  return mul_2(mul_2(mul_2(input))) ^ mul_2(mul_2(input)) ^ input;
 }
 
 // e = 0b1110
-inline uint8_t mul_e(uint8_t input) {
-  uint8_t input2 = mul_2(input);
-  uint8_t input4 = mul_2(input2);
-  uint8_t input8 = mul_2(input4);
-  uint8_t output = input8 ^ input4 ^ input2;
-  return output;
+constexpr uint8_t mul_e(uint8_t input) {
+  return mul_2(mul_2(mul_2(input))) ^ mul_2(mul_2(input)) ^ mul_2(input);
+}
+
+constexpr uint32_t rotl32(uint32_t input, int bits) {
+  return bits == 0 ? input : (input << bits) | (input >> (32 - bits));
+}
+
+// T-tables
+// the state is kept in four column words:
+// column c = state[4c] | state[4c+1] << 8 | state[4c+2] << 16 | state[4c+3]
+// << 24, i.e. a little endian load of the column, row 0 in the lowest byte
+//
+// te[0][x] = (2 S[x], S[x], S[x], 3 S[x]) is the column that MixColumns
+// makes out of S[x] in row 0, te[i] = rotl(te[0], 8 * i) is the same for row i
+// so SubBytes, ShiftRows and MixColumns of one round become 16 lookups
+//
+// td[0][x] = (e S^-1[x], 9 S^-1[x], d S^-1[x], b S^-1[x]) does the same for
+// InvSubBytes, InvShiftRows and InvMixColumns
+struct TTables {
+  uint32_t te[4][256];
+  uint32_t td[4][256];
+};
+
+constexpr TTables make_ttables() {
+  TTables tables = {};
+  for (int x = 0; x < 256; x++) {
+    uint8_t sx = s[x];
+    uint32_t te0 = (uint32_t)mul_2(sx) | ((uint32_t)sx << 8) |
+                   ((uint32_t)sx << 16) | ((uint32_t)mul_3(sx) << 24);
+    uint8_t inv_sx = inv_s[x];
+    uint32_t td0 = (uint32_t)mul_e(inv_sx) | ((uint32_t)mul_9(inv_sx) << 8) |
+                   ((uint32_t)mul_d(inv_sx) << 16) |
+                   ((uint32_t)mul_b(inv_sx) << 24);
+    for (int i = 0; i < 4; i++) {
+      tables.te[i][x] = rotl32(te0, 8 * i);
+      tables.td[i][x] = rotl32(td0, 8 * i);
+    }
+  }
+  return tables;
+}
+
+// computed at compile time, 8KiB in total
+constexpr TTables ttables = make_ttables();
+
+// InvMixColumns of one column word
+// td[] contains InvSubBytes, cancel it by SubBytes first
+inline uint32_t inv_mix_column(uint32_t input) {
+  return ttables.td[0][s[input & 0xFF]] ^
+         ttables.td[1][s[(input >> 8) & 0xFF]] ^
+         ttables.td[2][s[(input >> 16) & 0xFF]] ^
+         ttables.td[3][s[input >> 24]];
+}
+
+// key expansion(FIPS-197 5.2)
+// Nk = rounds - 6 key words: 4, 6 and 8 for AES-128, AES-192 and AES-256
+// rounds+1 roundkeys
+// roundkey = 4 uint32_t
+template <int rounds>
+void aes_expand_key(const uint8_t key[(rounds - 6) * 4],
+                    uint32_t roundkeys[(rounds + 1) * 4]) {
+  const int nk = rounds - 6;
+
+  // init round
+  for (int i = 0; i < nk; i++) {
+    roundkeys[i] = load_le32(&key[4 * i]);
+  }
+
+  for (int i = nk; i < 4 * (rounds + 1); i++) {
+    uint32_t temp = roundkeys[i - 1];
+    if (i % nk == 0) {
+      // temp = SubWord(RotWord(temp)) xor Rcon(i/Nk)
+      // RotWord moves byte 0 to byte 3, which is a right rotate here
+      uint32_t rotword = (temp >> 8) | (temp << 24);
+      temp = subword(rotword) ^ rcon[i / nk - 1];
+    } else if (nk > 6 && i % nk == 4) {
+      // AES-256 only
+      temp = subword(temp);
+    }
+    roundkeys[i] = roundkeys[i - nk] ^ temp;
+  }
 }
 
-inline void shift_rows(uint8_t state[16]) {
-  // row 2, shift by 1
-  uint8_t temp = state[1];
-  state[1] = state[5];
-  state[5] = state[9];
-  state[9] = state[13];
-  state[13] = temp;
-  // row 3, shift by 2
-  temp = state[2];
-  state[2] = state[10];
-  state[10] = temp;
-  temp = state[6];
-  state[6] = state[14];
-  state[14] = temp;
-  // row 4, shift by 3
-  temp = state[15];
-  state[15] = state[11];
-  state[11] = state[7];
-  state[7] = state[3];
-  state[3] = temp;
-}
-
-inline void inv_shift_rows(uint8_t state[16]) {
-  // row 2, shift by 1
-  uint8_t temp = state[13];
-  state[13] = state[9];
-  state[9] = state[5];
-  state[5] = state[1];
-  state[1] = temp;
-  // row 3, shift by 2
-  temp = state[2];
-  state[2] = state[10];
-  state[10] = temp;
-  temp = state[6];
-  state[6] = state[14];
-  state[14] = temp;
-  // row 4, shift by 3
-  temp = state[3];
-  state[3] = state[7];
-  state[7] = state[11];
-  state[11] = state[15];
-  state[15] = temp;
-}
-
-inline void sub_bytes(uint8_t state[16]) {
-  for (int i = 0; i < 16; i++) {
-    state[i] = s[state[i]];
-  }
-}
-
-inline void inv_sub_bytes(uint8_t state[16]) {
-  for (int i = 0; i < 16; i++) {
-    state[i] = inv_s[state[i]];
-  }
-}
-
-void aes128_cbc_encrypt(const vector<uint8_t> &input, const vector<uint8_t> &iv,
-                        vector<uint8_t> &output,
-                        uint32_t roundkeys[(10 + 1) * 4]) {
+// key expansion for the equivalent inverse cipher(FIPS-197 5.3.5)
+// dw[0] = w[Nr], dw[round] = InvMixColumns(w[Nr - round]), dw[Nr] = w[0]
+// so decryption has the same structure as encryption
+template <int rounds>
+void aes_expand_dec_key(const uint32_t roundkeys[(rounds + 1) * 4],
+                        uint32_t dec_roundkeys[(rounds + 1) * 4]) {
+  for (int round = 0; round <= rounds; round++) {
+    for (int i = 0; i < 4; i++) {
+      uint32_t w = roundkeys[(rounds - round) * 4 + i];
+      if (round != 0 && round != rounds) {
+        w = inv_mix_column(w);
+      }
+      dec_roundkeys[round * 4 + i] = w;
+    }
+  }
+}
+
+template <int rounds>
+inline void aes_encrypt_block(const uint32_t roundkeys[(rounds + 1) * 4],
+                              const uint8_t input[16], uint8_t output[16]) {
+  const uint32_t(*te)[256] = ttables.te;
+
+  // state = in
+  // AddRoundKey(state, w[0, Nb-1])
+  uint32_t c0 = load_le32(&input[0]) ^ roundkeys[0];
+  uint32_t c1 = load_le32(&input[4]) ^ roundkeys[1];
+  uint32_t c2 = load_le32(&input[8]) ^ roundkeys[2];
+  uint32_t c3 = load_le32(&input[12]) ^ roundkeys[3];
+
+  // rounds - 1 full rounds
+  // row i of column c comes from column c + i after ShiftRows
+#pragma GCC unroll 14
+  for (int round = 1; round <= rounds - 1; round++) {
+    const uint32_t *rk = &roundkeys[round * 4];
+    uint32_t t0 = te[0][c0 & 0xFF] ^ te[1][(c1 >> 8) & 0xFF] ^
+                  te[2][(c2 >> 16) & 0xFF] ^ te[3][c3 >> 24] ^ rk[0];
+    uint32_t t1 = te[0][c1 & 0xFF] ^ te[1][(c2 >> 8) & 0xFF] ^
+                  te[2][(c3 >> 16) & 0xFF] ^ te[3][c0 >> 24] ^ rk[1];
+    uint32_t t2 = te[0][c2 & 0xFF] ^ te[1][(c3 >> 8) & 0xFF] ^
+                  te[2][(c0 >> 16) & 0xFF] ^ te[3][c1 >> 24] ^ rk[2];
+    uint32_t t3 = te[0][c3 & 0xFF] ^ te[1][(c0 >> 8) & 0xFF] ^
+                  te[2][(c1 >> 16) & 0xFF] ^ te[3][c2 >> 24] ^ rk[3];
+    c0 = t0;
+    c1 = t1;
+    c2 = t2;
+    c3 = t3;
+  }
+
+  // SubBytes(state), ShiftRows(state) without MixColumns
+  // AddRoundKey(state, w[Nr*Nb, (Nr+1)*Nb-1])
+  const uint32_t *rk = &roundkeys[rounds * 4];
+  store_le32(&output[0], (s[c0 & 0xFF] | (s[(c1 >> 8) & 0xFF] << 8) |
+                          (s[(c2 >> 16) & 0xFF] << 16) | (s[c3 >> 24] << 24)) ^
+                             rk[0]);
+  store_le32(&output[4], (s[c1 & 0xFF] | (s[(c2 >> 8) & 0xFF] << 8) |
+                          (s[(c3 >> 16) & 0xFF] << 16) | (s[c0 >> 24] << 24)) ^
+                             rk[1]);
+  store_le32(&output[8], (s[c2 & 0xFF] | (s[(c3 >> 8) & 0xFF] << 8) |
+                          (s[(c0 >> 16) & 0xFF] << 16) | (s[c1 >> 24] << 24)) ^
+                             rk[2]);
+  store_le32(&output[12], (s[c3 & 0xFF] | (s[(c0 >> 8) & 0xFF] << 8) |
+                           (s[(c1 >> 16) & 0xFF] << 16) | (s[c2 >> 24] << 24)) ^
+                              rk[3]);
+}
+
+template <int rounds>
+inline void aes_decrypt_block(const uint32_t dec_roundkeys[(rounds + 1) * 4],
+                              const uint8_t input[16], uint8_t output[16]) {
+  const uint32_t(*td)[256] = ttables.td;
+
+  // state = in
+  // AddRoundKey(state, dw[0, Nb-1])
+  uint32_t c0 = load_le32(&input[0]) ^ dec_roundkeys[0];
+  uint32_t c1 = load_le32(&input[4]) ^ dec_roundkeys[1];
+  uint32_t c2 = load_le32(&input[8]) ^ dec_roundkeys[2];
+  uint32_t c3 = load_le32(&input[12]) ^ dec_roundkeys[3];
+
+  // rounds - 1 full rounds
+  // row i of column c comes from column c - i after InvShiftRows
+#pragma GCC unroll 14
+  for (int round = 1; round <= rounds - 1; round++) {
+    const uint32_t *rk = &dec_roundkeys[round * 4];
+    uint32_t t0 = td[0][c0 & 0xFF] ^ td[1][(c3 >> 8) & 0xFF] ^
+                  td[2][(c2 >> 16) & 0xFF] ^ td[3][c1 >> 24] ^ rk[0];
+    uint32_t t1 = td[0][c1 & 0xFF] ^ td[1][(c0 >> 8) & 0xFF] ^
+                  td[2][(c3 >> 16) & 0xFF] ^ td[3][c2 >> 24] ^ rk[1];
+    uint32_t t2 = td[0][c2 & 0xFF] ^ td[1][(c1 >> 8) & 0xFF] ^
+                  td[2][(c0 >> 16) & 0xFF] ^ td[3][c3 >> 24] ^ rk[2];
+    uint32_t t3 = td[0][c3 & 0xFF] ^ td[1][(c2 >> 8) & 0xFF] ^
+                  td[2][(c1 >> 16) & 0xFF] ^ td[3][c0 >> 24] ^ rk[3];
+    c0 = t0;
+    c1 = t1;
+    c2 = t2;
+    c3 = t3;
+  }
+
+  // InvSubBytes(state), InvShiftRows(state) without InvMixColumns
+  // AddRoundKey(state, dw[Nr*Nb, (Nr+1)*Nb-1])
+  const uint32_t *rk = &dec_roundkeys[rounds * 4];
+  store_le32(&output[0],
+             (inv_s[c0 & 0xFF] | (inv_s[(c3 >> 8) & 0xFF] << 8) |
+              (inv_s[(c2 >> 16) & 0xFF] << 16) | (inv_s[c1 >> 24] << 24)) ^
+                 rk[0]);
+  store_le32(&output[4],
+             (inv_s[c1 & 0xFF] | (inv_s[(c0 >> 8) & 0xFF] << 8) |
+              (inv_s[(c3 >> 16) & 0xFF] << 16) | (inv_s[c2 >> 24] << 24)) ^
+                 rk[1]);
+  store_le32(&output[8],
+             (inv_s[c2 & 0xFF] | (inv_s[(c1 >> 8) & 0xFF] << 8) |
+              (inv_s[(c0 >> 16) & 0xFF] << 16) | (inv_s[c3 >> 24] << 24)) ^
+                 rk[2]);
+  store_le32(&output[12],
+             (inv_s[c3 & 0xFF] | (inv_s[(c2 >> 8) & 0xFF] << 8) |
+              (inv_s[(c1 >> 16) & 0xFF] << 16) | (inv_s[c0 >> 24] << 24)) ^
+                 rk[3]);
+}
+
+template <int rounds>
+void aes_cbc_encrypt_table(const vector<uint8_t> &input,
+                           const vector<uint8_t> &iv, vector<uint8_t> &output,
+                           const uint32_t roundkeys[(rounds + 1) * 4]) {
   uint8_t cur_iv[16];
   memcpy(cur_iv, &iv[0], 16);
 
   // for each block
   for (size_t offset = 0; offset < input.size(); offset += 16) {
-    // column major
-    // 0 4 8 12
-    // 1 5 9 13
-    // 2 6 10 14
-    // 3 7 11 15
     uint8_t state[16];
-
-    // state = in
     for (int i = 0; i < 16; i++) {
       state[i] = input[offset + i] ^ cur_iv[i];
     }
+    aes_encrypt_block<rounds>(roundkeys, state, cur_iv);
+    // cipher text is used as new iv
+    memcpy(&output[offset], cur_iv, 16);
+  }
+}
 
-    // AddRoundKey(state, w[0, Nb-1])
-    add_round_key(state, &roundkeys[0]);
-
-    // 9 rounds
-    for (int round = 1; round <= 10 - 1; round++) {
-      // SubBytes(state)
-      sub_bytes(state);
-
-      // ShiftRows(state)
-      shift_rows(state);
-
-      // MixColumns()
-      // for 4 columns
-      for (int i = 0; i < 4; i++) {
-        // 2 3 1 1
-        uint8_t new0 = mul_2(state[i * 4]) ^ mul_3(state[i * 4 + 1]) ^
-                       state[i * 4 + 2] ^ state[i * 4 + 3];
-        // 1 2 3 1
-        uint8_t new1 = state[i * 4] ^ mul_2(state[i * 4 + 1]) ^
-                       mul_3(state[i * 4 + 2]) ^ state[i * 4 + 3];
-        // 1 1 2 3
-        uint8_t new2 = state[i * 4] ^ state[i * 4 + 1] ^
-                       mul_2(state[i * 4 + 2]) ^ mul_3(state[i * 4 + 3]);
-        // 3 1 1 2
-        uint8_t new3 = mul_3(state[i * 4]) ^ state[i * 4 + 1] ^
-                       state[i * 4 + 2] ^ mul_2(state[i * 4 + 3]);
-        state[i * 4] = new0;
-        state[i * 4 + 1] = new1;
-        state[i * 4 + 2] = new2;
-        state[i * 4 + 3] = new3;
-      }
+template <int rounds>
+void aes_cbc_decrypt_table(const vector<uint8_t> &input,
+                           const vector<uint8_t> &iv, vector<uint8_t> &output,
+                           const uint32_t dec_roundkeys[(rounds + 1) * 4]) {
+  uint8_t cur_iv[16];
+  memcpy(cur_iv, &iv[0], 16);
 
-      // AddRoundKey(state, w[round*Nb, (round+1)*Nb-1])
-      add_round_key(state, &roundkeys[round * 4]);
-    }
+  // for each block
+  for (size_t offset = 0; offset < input.size(); offset += 16) {
+    uint8_t state[16];
+    aes_decrypt_block<rounds>(dec_roundkeys, &input[offset], state);
 
-    // SubBytes(state)
-    sub_bytes(state);
+    // out = state xor last cipher text
+    // the cipher text is read first, so input and output may be the same
+    for (int i = 0; i < 16; i++) {
+      uint8_t cipher = input[offset + i];
+      output[offset + i] = state[i] ^ cur_iv[i];
+      cur_iv[i] = cipher;
+    }
+  }
+}
 
-    // ShiftRows(state)
-    shift_rows(state);
+AESBackend aes_backend = AESBackend::Auto;
 
-    // AddRoundKey(state, w[Nr*Nb, (Nr+1)*Nb-1])
-    add_round_key(state, &roundkeys[10 * 4]);
+bool aes_set_backend(AESBackend backend) {
+  // Table and Bitslice are portable
+  if (backend == AESBackend::AESNI && !cpu_has_aesni()) {
+    return false;
+  }
+  if (backend == AESBackend::VPAES && !cpu_has_ssse3()) {
+    return false;
+  }
+  aes_backend = backend;
+  return true;
+}
 
-    // out = state
-    memcpy(&output[offset], state, 16);
-    memcpy(cur_iv, state, 16);
+// resolve AESBackend::Auto
+// parallel: blocks are independent(CBC decryption), bitslicing can be used
+AESBackend aes_get_backend(bool parallel) {
+  if (aes_backend == AESBackend::Auto) {
+    if (cpu_has_aesni()) {
+      return AESBackend::AESNI;
+    }
+    // constant time, vector permute beats SSE2 bitslicing even on
+    // independent blocks
+    if (cpu_has_ssse3()) {
+      return AESBackend::VPAES;
+    }
+    return parallel ? AESBackend::Bitslice : AESBackend::Table;
   }
+  return aes_backend;
 }
 
-void aes128_cbc_decrypt(const vector<uint8_t> &input, const vector<uint8_t> &iv,
-                        vector<uint8_t> &output,
-                        uint32_t roundkeys[(10 + 1) * 4]) {
+template <int rounds>
+void aes_init_rounds(aes_context &ctx, const uint8_t *key) {
+  ctx.rounds = rounds;
+  ctx.serial_backend = aes_get_backend(false);
+  ctx.parallel_backend = aes_get_backend(true);
+
+  if (ctx.parallel_backend == AESBackend::AESNI) {
+    // AESKEYGENASSIST only pays off for AES-128, the portable key expansion
+    // gives the same layout
+    if (rounds == 10) {
+      aesni_expand_key(key, ctx.roundkeys);
+    } else {
+      aes_expand_key<rounds>(key, ctx.roundkeys);
+    }
+    aesni_expand_dec_key<rounds>(ctx.roundkeys, ctx.dec_roundkeys);
+    return;
+  }
 
-  uint8_t cur_iv[16];
-  memcpy(cur_iv, &iv[0], 16);
+  aes_expand_key<rounds>(key, ctx.roundkeys);
+  if (ctx.parallel_backend == AESBackend::Bitslice) {
+    // the bitsliced cipher decrypts with the encryption round keys
+    bsaes_expand_key<rounds>(ctx.roundkeys, ctx.bs_roundkeys);
+  } else {
+    aes_expand_dec_key<rounds>(ctx.roundkeys, ctx.dec_roundkeys);
+  }
+  if (ctx.parallel_backend == AESBackend::VPAES) {
+    // the basis changes are applied to both key schedules
+    vpaes_expand_key<rounds>(ctx.roundkeys, ctx.dec_roundkeys,
+                             ctx.vp_roundkeys, ctx.vp_dec_roundkeys);
+  }
+}
 
-  // for each block
-  for (size_t offset = 0; offset < input.size(); offset += 16) {
-    // column major
-    // 0 4 8 12
-    // 1 5 9 13
-    // 2 6 10 14
-    // 3 7 11 15
-    uint8_t state[16];
+void aes_init(aes_context &ctx, const vector<uint8_t> &key) {
+  // key size = 16, 24 or 32 bytes
+  if (key.size() == 16) {
+    aes_init_rounds<10>(ctx, &key[0]);
+  } else if (key.size() == 24) {
+    aes_init_rounds<12>(ctx, &key[0]);
+  } else {
+    assert(key.size() == 32);
+    aes_init_rounds<14>(ctx, &key[0]);
+  }
+}
 
-    // state = in
-    memcpy(state, &input[offset], 16);
-
-    // AddRoundKey(state, w[Nr * Nb, (Nr + 1) * Nb - 1])
-    add_round_key(state, &roundkeys[10 * 4]);
-
-    // 9 rounds
-    for (int round = 10 - 1; round >= 1; round--) {
-      // InvShiftRows(state)
-      inv_shift_rows(state);
-
-      // InvSubBytes(state)
-      inv_sub_bytes(state);
-
-      // AddRoundKey(state, w[round*Nb, (round+1)*Nb-1])
-      add_round_key(state, &roundkeys[round * 4]);
-
-      // InvMixColumns()
-      // for 4 columns
-      for (int i = 0; i < 4; i++) {
-        // e b d 9
-        uint8_t new0 = mul_e(state[i * 4]) ^ mul_b(state[i * 4 + 1]) ^
-                       mul_d(state[i * 4 + 2]) ^ mul_9(state[i * 4 + 3]);
-        // 9 e b d
-        uint8_t new1 = mul_9(state[i * 4]) ^ mul_e(state[i * 4 + 1]) ^
-                       mul_b(state[i * 4 + 2]) ^ mul_d(state[i * 4 + 3]);
-        // d 9 e b
-        uint8_t new2 = mul_d(state[i * 4]) ^ mul_9(state[i * 4 + 1]) ^
-                       mul_e(state[i * 4 + 2]) ^ mul_b(state[i * 4 + 3]);
-        // b d 9 e
-        uint8_t new3 = mul_b(state[i * 4]) ^ mul_d(state[i * 4 + 1]) ^
-                       mul_9(state[i * 4 + 2]) ^ mul_e(state[i * 4 + 3]);
-        state[i * 4] = new0;
-        state[i * 4 + 1] = new1;
-        state[i * 4 + 2] = new2;
-        state[i * 4 + 3] = new3;
+template <int rounds>
+void aes_cbc_encrypt_rounds(const aes_context &ctx,
+                            const vector<uint8_t> &input,
+                            const vector<uint8_t> &iv,
+                            vector<uint8_t> &output) {
+  if (ctx.serial_backend == AESBackend::AESNI) {
+    aesni_cbc_encrypt<rounds>(ctx.roundkeys, &iv[0], input.data(),
+                              output.data(), input.size() / 16);
+  } else if (ctx.serial_backend == AESBackend::VPAES) {
+    vpaes_cbc_encrypt<rounds>(ctx.vp_roundkeys, &iv[0], input.data(),
+                              output.data(), input.size() / 16);
+  } else if (ctx.serial_backend == AESBackend::Bitslice) {
+    // serial, one block per batch
+    uint8_t cur_iv[16];
+    memcpy(cur_iv, &iv[0], 16);
+    for (size_t offset = 0; offset < input.size(); offset += 16) {
+      uint8_t state[16];
+      for (int i = 0; i < 16; i++) {
+        state[i] = input[offset + i] ^ cur_iv[i];
       }
+      bsaes_crypt_blocks<rounds>(true, ctx.bs_roundkeys, state, cur_iv, 1);
+      memcpy(&output[offset], cur_iv, 16);
     }
+  } else {
+    aes_cbc_encrypt_table<rounds>(input, iv, output, ctx.roundkeys);
+  }
+}
 
-    // InvShiftRows(state)
-    inv_shift_rows(state);
+// ECB decryption of independent blocks with bitsliced AES, key is an
+// aes_context
+template <int rounds>
+void aes_bs_decrypt_blocks(const void *key, const uint8_t *input,
+                           uint8_t *output, size_t blocks) {
+  const aes_context *ctx = (const aes_context *)key;
+  bsaes_crypt_blocks<rounds>(false, ctx->bs_roundkeys, input, output, blocks);
+}
 
-    // InvSubBytes(state)
-    inv_sub_bytes(state);
+template <int rounds>
+void aes_cbc_decrypt_rounds(const aes_context &ctx,
+                            const vector<uint8_t> &input,
+                            const vector<uint8_t> &iv,
+                            vector<uint8_t> &output) {
+  if (ctx.parallel_backend == AESBackend::AESNI) {
+    aesni_cbc_decrypt<rounds>(ctx.dec_roundkeys, &iv[0], input.data(),
+                              output.data(), input.size() / 16);
+  } else if (ctx.parallel_backend == AESBackend::VPAES) {
+    vpaes_cbc_decrypt<rounds>(ctx.vp_dec_roundkeys, &iv[0], input.data(),
+                              output.data(), input.size() / 16);
+  } else if (ctx.parallel_backend == AESBackend::Bitslice) {
+    cbc_decrypt(aes_bs_decrypt_blocks<rounds>, &ctx, 16, &iv[0], input.data(),
+                output.data(), input.size() / 16);
+  } else {
+    aes_cbc_decrypt_table<rounds>(input, iv, output, ctx.dec_roundkeys);
+  }
+}
 
-    // AddRoundKey(state, w[0, Nb-1])
-    add_round_key(state, &roundkeys[0]);
+void aes_cbc_encrypt(const aes_context &ctx, const vector<uint8_t> &input,
+                     const vector<uint8_t> &iv, vector<uint8_t> &output) {
+  // block size = 16 bytes
+  assert(iv.size() == 16);
+  assert((input.size() % 16) == 0);
+  output.resize(input.size());
 
-    // out = state
-    for (int i = 0; i < 16; i++) {
-      output[offset + i] = state[i] ^ cur_iv[i];
-      cur_iv[i] = input[offset + i];
-    }
+  if (ctx.rounds == 10) {
+    aes_cbc_encrypt_rounds<10>(ctx, input, iv, output);
+  } else if (ctx.rounds == 12) {
+    aes_cbc_encrypt_rounds<12>(ctx, input, iv, output);
+  } else {
+    aes_cbc_encrypt_rounds<14>(ctx, input, iv, output);
   }
 }
 
-void aes128_cbc(bool encrypt, const vector<uint8_t> &input,
-                const vector<uint8_t> &key, const vector<uint8_t> &iv,
-                vector<uint8_t> &output) {
+void aes_cbc_decrypt(const aes_context &ctx, const vector<uint8_t> &input,
+                     const vector<uint8_t> &iv, vector<uint8_t> &output) {
   // block size = 16 bytes
   assert(iv.size() == 16);
   assert((input.size() % 16) == 0);
   output.resize(input.size());
+
+  if (ctx.rounds == 10) {
+    aes_cbc_decrypt_rounds<10>(ctx, input, iv, output);
+  } else if (ctx.rounds == 12) {
+    aes_cbc_decrypt_rounds<12>(ctx, input, iv, output);
+  } else {
+    aes_cbc_decrypt_rounds<14>(ctx, input, iv, output);
+  }
+}
+
+void aes_cbc(bool encrypt, const vector<uint8_t> &input,
+             const vector<uint8_t> &key, const vector<uint8_t> &iv,
+             vector<uint8_t> &output) {
+  aes_context ctx;
+  aes_init(ctx, key);
+  if (encrypt) {
+    aes_cbc_encrypt(ctx, input, iv, output);
+  } else {
+    aes_cbc_decrypt(ctx, input, iv, output);
+  }
+}
+
+void aes128_cbc(bool encrypt, const vector<uint8_t> &input,
+                const vector<uint8_t> &key, const vector<uint8_t> &iv,
+                vector<uint8_t> &output) {
   // key size = 16 bytes
   assert(key.size() == 16);
+  aes_cbc(encrypt, input, key, iv, output);
+}
 
-  // key expansion
-  // aes128: 10 rounds
-  // 10+1 roundkeys
-  // roundkey = 4 uint32_t
-  uint32_t roundkeys[(10 + 1) * 4];
-
-  // init round
-  for (int i = 0; i < 4; i++) {
-    roundkeys[i] = (key[4 * i] << 24) | (key[4 * i + 1] << 16) |
-                   (key[4 * i + 2] << 8) | (key[4 * i + 3]);
+// ECB encryption of independent blocks, key is an aes_context
+template <int rounds>
+void aes_ecb_encrypt_blocks(const void *key, const uint8_t *input,
+                            uint8_t *output, size_t blocks) {
+  const aes_context *ctx = (const aes_context *)key;
+  if (ctx->parallel_backend == AESBackend::AESNI) {
+    aesni_ecb_encrypt<rounds>(ctx->roundkeys, input, output, blocks);
+  } else if (ctx->parallel_backend == AESBackend::VPAES) {
+    vpaes_ecb_encrypt<rounds>(ctx->vp_roundkeys, input, output, blocks);
+  } else if (ctx->parallel_backend == AESBackend::Bitslice) {
+    bsaes_crypt_blocks<rounds>(true, ctx->bs_roundkeys, input, output, blocks);
+  } else {
+    for (size_t i = 0; i < blocks; i++) {
+      aes_encrypt_block<rounds>(ctx->roundkeys, &input[i * 16],
+                                &output[i * 16]);
+    }
   }
+}
 
-  // Nk = 4, Nr = 10
-  for (int i = 4; i < 4 * (10 + 1); i++) {
-    uint32_t temp = roundkeys[i - 1];
-    if (i % 4 == 0) {
-      // temp = SubWord(RotWord(temp)) xor Rcon(i/Nk)
-      uint32_t rotword = (temp << 8) | (temp >> 24);
-      temp = subword(rotword) ^ rcon[i / 4 - 1];
+// ECB decryption of independent blocks, key is an aes_context
+template <int rounds>
+void aes_ecb_decrypt_blocks(const void *key, const uint8_t *input,
+                            uint8_t *output, size_t blocks) {
+  const aes_context *ctx = (const aes_context *)key;
+  if (ctx->parallel_backend == AESBackend::AESNI) {
+    aesni_ecb_decrypt<rounds>(ctx->dec_roundkeys, input, output, blocks);
+  } else if (ctx->parallel_backend == AESBackend::VPAES) {
+    vpaes_ecb_decrypt<rounds>(ctx->vp_dec_roundkeys, input, output, blocks);
+  } else if (ctx->parallel_backend == AESBackend::Bitslice) {
+    bsaes_crypt_blocks<rounds>(false, ctx->bs_roundkeys, input, output,
+                               blocks);
+  } else {
+    for (size_t i = 0; i < blocks; i++) {
+      aes_decrypt_block<rounds>(ctx->dec_roundkeys, &input[i * 16],
+                                &output[i * 16]);
     }
-    roundkeys[i] = roundkeys[i - 4] ^ temp;
   }
+}
 
-  if (encrypt) {
-    aes128_cbc_encrypt(input, iv, output, roundkeys);
+// the block function for the key size of ctx
+block_fn aes_ecb_blocks(const aes_context &ctx, bool encrypt) {
+  if (ctx.rounds == 10) {
+    return encrypt ? aes_ecb_encrypt_blocks<10> : aes_ecb_decrypt_blocks<10>;
+  } else if (ctx.rounds == 12) {
+    return encrypt ? aes_ecb_encrypt_blocks<12> : aes_ecb_decrypt_blocks<12>;
+  }
+  return encrypt ? aes_ecb_encrypt_blocks<14> : aes_ecb_decrypt_blocks<14>;
+}
+
+// CBC encryption of several streams, keys are aes_contexts of the same key
+// size and backend
+template <int rounds>
+void aes_cbc_encrypt_multi(const void *const keys[], uint8_t *ivs,
+                           const uint8_t *const input[],
+                           uint8_t *const output[], size_t streams,
+                           size_t blocks) {
+  const aes_context *ctx = (const aes_context *)keys[0];
+  if (ctx->parallel_backend == AESBackend::AESNI) {
+    const uint32_t *roundkeys[8];
+    for (size_t i = 0; i < streams; i++) {
+      roundkeys[i] = ((const aes_context *)keys[i])->roundkeys;
+    }
+    aesni_cbc_encrypt_multi<rounds>(roundkeys, ivs, input, output, streams,
+                                    blocks);
+  } else if (ctx->parallel_backend == AESBackend::VPAES) {
+    const uint32_t *vp_roundkeys[8];
+    for (size_t i = 0; i < streams; i++) {
+      vp_roundkeys[i] = ((const aes_context *)keys[i])->vp_roundkeys;
+    }
+    vpaes_cbc_encrypt_multi<rounds>(vp_roundkeys, ivs, input, output, streams,
+                                    blocks);
+  } else if (ctx->parallel_backend == AESBackend::Bitslice) {
+    const uint64_t *bs_roundkeys[8];
+    for (size_t i = 0; i < streams; i++) {
+      bs_roundkeys[i] = ((const aes_context *)keys[i])->bs_roundkeys;
+    }
+    bsaes_cbc_encrypt_multi<rounds>(bs_roundkeys, ivs, input, output, streams,
+                                    blocks);
   } else {
-    aes128_cbc_decrypt(input, iv, output, roundkeys);
+    // the table lookups of different streams overlap
+    for (size_t i = 0; i < blocks; i++) {
+      for (size_t j = 0; j < streams; j++) {
+        uint8_t state[16];
+        for (int k = 0; k < 16; k++) {
+          state[k] = input[j][i * 16 + k] ^ ivs[j * 16 + k];
+        }
+        aes_encrypt_block<rounds>(((const aes_context *)keys[j])->roundkeys,
+                                  state, &ivs[j * 16]);
+        if (output != nullptr) {
+          memcpy(&output[j][i * 16], &ivs[j * 16], 16);
+        }
+      }
+    }
   }
 }
+
+// key size and backend of ctx, messages of one multi-stream call share them
+int aes_kind(const aes_context &ctx) {
+  return ctx.rounds * 4 + (int)ctx.parallel_backend;
+}
+
+// the multi-stream function for the key size of ctx
+cbc_multi_fn aes_cbc_multi(const aes_context &ctx) {
+  if (ctx.rounds == 10) {
+    return aes_cbc_encrypt_multi<10>;
+  } else if (ctx.rounds == 12) {
+    return aes_cbc_encrypt_multi<12>;
+  }
+  return aes_cbc_encrypt_multi<14>;
+}
+
+// group streams by kinds in place, then call run(streams, count) per group
+// the order of the messages does not matter
+template <class Stream, class Run>
+void aes_for_each_kind(vector<Stream> &streams, vector<int> &kinds, Run run) {
+  for (size_t begin = 0, end; begin < streams.size(); begin = end) {
+    end = begin;
+    for (size_t i = begin; i < streams.size(); i++) {
+      if (kinds[i] == kinds[begin]) {
+        swap(streams[i], streams[end]);
+        swap(kinds[i], kinds[end]);
+        end++;
+      }
+    }
+    run(&streams[begin], end - begin);
+  }
+}
+
+void aes_cbc_encrypt_batch(const vector<cbc_job<aes_context>> &jobs) {
+  vector<cbc_stream> streams(jobs.size());
+  vector<int> kinds(jobs.size());
+  for (size_t i = 0; i < jobs.size(); i++) {
+    const cbc_job<aes_context> &job = jobs[i];
+    // block size = 16 bytes
+    assert(job.iv->size() == 16);
+    assert((job.input->size() % 16) == 0);
+    job.output->resize(job.input->size());
+    // no CBC-MAC output, no extra last block
+    streams[i] = {job.ctx, job.iv->data(), job.input->data(),
+                  job.output->data(), job.input->size() / 16, nullptr,
+                  nullptr};
+    kinds[i] = aes_kind(*job.ctx);
+  }
+
+  aes_for_each_kind(streams, kinds, [](cbc_stream *group, size_t count) {
+    const aes_context *ctx = (const aes_context *)group[0].key;
+    cbc128_encrypt_multi(aes_cbc_multi(*ctx), 8, group, count);
+  });
+}
+
+// CBC-MAC of one stream, key is an aes_context
+template <int rounds>
+void aes_cbc_mac_blocks(const void *key, uint8_t mac[16],
+                        const uint8_t *input, size_t blocks) {
+  const aes_context *ctx = (const aes_context *)key;
+  if (ctx->serial_backend == AESBackend::AESNI ||
+      ctx->serial_backend == AESBackend::VPAES) {
+    // the CBC kernels write cipher text, keep only a few blocks of it
+    uint8_t buffer[16 * 16];
+    for (size_t i = 0; i < blocks; i += 16) {
+      size_t count = blocks - i < 16 ? blocks - i : 16;
+      if (ctx->serial_backend == AESBackend::AESNI) {
+        aesni_cbc_encrypt<rounds>(ctx->roundkeys, mac, &input[i * 16], buffer,
+                                  count);
+      } else {
+        vpaes_cbc_encrypt<rounds>(ctx->vp_roundkeys, mac, &input[i * 16],
+                                  buffer, count);
+      }
+      memcpy(mac, &buffer[(count - 1) * 16], 16);
+    }
+    return;
+  }
+
+  for (size_t i = 0; i < blocks; i++) {
+    uint8_t state[16];
+    for (int k = 0; k < 16; k++) {
+      state[k] = input[i * 16 + k] ^ mac[k];
+    }
+    if (ctx->serial_backend == AESBackend::Bitslice) {
+      bsaes_crypt_blocks<rounds>(true, ctx->bs_roundkeys, state, mac, 1);
+    } else {
+      aes_encrypt_block<rounds>(ctx->roundkeys, state, mac);
+    }
+  }
+}
+
+cbc_mac_fn aes_cbc_mac(const aes_context &ctx) {
+  if (ctx.rounds == 10) {
+    return aes_cbc_mac_blocks<10>;
+  } else if (ctx.rounds == 12) {
+    return aes_cbc_mac_blocks<12>;
+  }
+  return aes_cbc_mac_blocks<14>;
+}
+
+void aes_cmac_init(aes_cmac_context &ctx, const vector<uint8_t> &key) {
+  aes_init(ctx.key, key);
+  cmac128_subkeys(aes_ecb_blocks(ctx.key, true), &ctx.key, ctx.k1, ctx.k2);
+}
+
+void aes_cmac_update(const aes_cmac_context &ctx, cmac_state &state,
+                     const vector<uint8_t> &input) {
+  cmac128_update(aes_cbc_mac(ctx.key), &ctx.key, state, input.data(),
+                 input.size());
+}
+
+void aes_cmac_final(const aes_cmac_context &ctx, const cmac_state &state,
+                    vector<uint8_t> &tag) {
+  tag.resize(16);
+  cmac128_final(aes_cbc_mac(ctx.key), &ctx.key, ctx.k1, ctx.k2, state,
+                tag.data());
+}
+
+void aes_cmac(const aes_cmac_context &ctx, const vector<uint8_t> &input,
+              vector<uint8_t> &tag) {
+  cmac_state state;
+  cmac_start(state);
+  aes_cmac_update(ctx, state, input);
+  aes_cmac_final(ctx, state, tag);
+}
+
+void aes_cmac_batch(const vector<cmac_job<aes_cmac_context>> &jobs) {
+  vector<cmac_stream> streams(jobs.size());
+  vector<int> kinds(jobs.size());
+  for (size_t i = 0; i < jobs.size(); i++) {
+    const cmac_job<aes_cmac_context> &job = jobs[i];
+    job.tag->resize(16);
+    streams[i] = {&job.ctx->key,     job.ctx->k1,       job.ctx->k2,
+                  job.input->data(), job.input->size(), job.tag->data()};
+    kinds[i] = aes_kind(job.ctx->key);
+  }
+
+  aes_for_each_kind(streams, kinds, [](cmac_stream *group, size_t count) {
+    const aes_context *ctx = (const aes_context *)group[0].key;
+    cmac128_multi(aes_cbc_multi(*ctx), 8, group, count);
+  });
+}
+
+void aes_ctr(const vector<uint8_t> &input, const vector<uint8_t> &key,
+             const vector<uint8_t> &iv, vector<uint8_t> &output) {
+  // initial counter block = 16 bytes
+  assert(iv.size() == 16);
+  output.resize(input.size());
+
+  aes_context ctx;
+  aes_init(ctx, key);
+  ctr128_crypt(aes_ecb_blocks(ctx, true), &ctx, &iv[0], input.data(),
+               output.data(), input.size());
+}
+
+void aes128_ctr(const vector<uint8_t> &input, const vector<uint8_t> &key,
+                const vector<uint8_t> &iv, vector<uint8_t> &output) {
+  // key size = 16 bytes
+  assert(key.size() == 16);
+  aes_ctr(input, key, iv, output);
+}
+
+void aes_gcm_encrypt(const vector<uint8_t> &input, const vector<uint8_t> &key,
+                     const vector<uint8_t> &iv, const vector<uint8_t> &aad,
+                     vector<uint8_t> &output, vector<uint8_t> &tag) {
+  assert(iv.size() > 0);
+  output.resize(input.size());
+  tag.resize(16);
+
+  aes_context ctx;
+  aes_init(ctx, key);
+  // PCLMULQDQ when available, else the 4-bit GHASH tables
+  bool clmul = cpu_has_pclmul();
+  gcm128_crypt(true, aes_ecb_blocks(ctx, true), &ctx, clmul, iv.data(),
+               iv.size(), aad.data(), aad.size(), input.data(), output.data(),
+               input.size(), tag.data());
+}
+
+bool aes_gcm_decrypt(const vector<uint8_t> &input, const vector<uint8_t> &key,
+                     const vector<uint8_t> &iv, const vector<uint8_t> &aad,
+                     const vector<uint8_t> &tag, vector<uint8_t> &output) {
+  aes_context ctx;
+  aes_init(ctx, key);
+  bool clmul = cpu_has_pclmul();
+  return gcm128_decrypt(aes_ecb_blocks(ctx, true), &ctx, clmul, input, iv,
+                        aad, tag, output);
+}
+
+void aes128_gcm_encrypt(const vector<uint8_t> &input,
+                        const vector<uint8_t> &key, const vector<uint8_t> &iv,
+                        const vector<uint8_t> &aad, vector<uint8_t> &output,
+                        vector<uint8_t> &tag) {
+  // key size = 16 bytes
+  assert(key.size() == 16);
+  aes_gcm_encrypt(input, key, iv, aad, output, tag);
+}
+
+bool aes128_gcm_decrypt(const vector<uint8_t> &input,
+                        const vector<uint8_t> &key, const vector<uint8_t> &iv,
+                        const vector<uint8_t> &aad, const vector<uint8_t> &tag,
+                        vector<uint8_t> &output) {
+  // key size = 16 bytes
+  assert(key.size() == 16);
+  return aes_gcm_decrypt(input, key, iv, aad, tag, output);
+}
+
+void aes_xts_init(aes_xts_context &ctx, const vector<uint8_t> &key) {
+  // key size = 32 or 64 bytes, data key || tweak key
+  assert(key.size() == 32 || key.size() == 64);
+  size_t half = key.size() / 2;
+  aes_init(ctx.data_key, vector<uint8_t>(key.begin(), key.begin() + half));
+  aes_init(ctx.tweak_key, vector<uint8_t>(key.begin() + half, key.end()));
+}
+
+void aes_xts_encrypt(const aes_xts_context &ctx, uint64_t sector,
+                     size_t sector_size, const vector<uint8_t> &input,
+                     vector<uint8_t> &output) {
+  output.resize(input.size());
+  xts128_crypt(aes_ecb_blocks(ctx.data_key, true), &ctx.data_key,
+               aes_ecb_blocks(ctx.tweak_key, true), &ctx.tweak_key, sector,
+               sector_size, input.data(), output.data(), input.size());
+}
+
+void aes_xts_decrypt(const aes_xts_context &ctx, uint64_t sector,
+                     size_t sector_size, const vector<uint8_t> &input,
+                     vector<uint8_t> &output) {
+  output.resize(input.size());
+  // the tweak is always encrypted
+  xts128_crypt(aes_ecb_blocks(ctx.data_key, false), &ctx.data_key,
+               aes_ecb_blocks(ctx.tweak_key, true), &ctx.tweak_key, sector,
+               sector_size, input.data(), output.data(), input.size());
+}
@@ -0,0 +1,359 @@
+#include "aes.h"
+#include <cstdlib>
+
+// reference:
+// https://www.intel.com/content/dam/doc/white-paper/advanced-encryption-standard-new-instructions-set-paper.pdf
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <wmmintrin.h>
+
+// compile AES-NI code without -maes, callers check cpu_has_aesni() first
+#define AESNI_TARGET __attribute__((target("aes,sse2")))
+
+// w[i+4..i+7] from w[i..i+3] and AESKEYGENASSIST(w[i+3])
+template <int rcon>
+AESNI_TARGET inline __m128i expand_step(__m128i key) {
+  // SubWord(RotWord(w[i+3])) xor Rcon in the highest word
+  __m128i temp = _mm_aeskeygenassist_si128(key, rcon);
+  temp = _mm_shuffle_epi32(temp, _MM_SHUFFLE(3, 3, 3, 3));
+  // prefix xor: w[i+4] = w[i] ^ temp, w[i+5] = w[i+1] ^ w[i+4], ...
+  key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+  key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+  key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+  return _mm_xor_si128(key, temp);
+}
+
+AESNI_TARGET void aesni_expand_key(const uint8_t key[16],
+                                   uint32_t roundkeys[(10 + 1) * 4]) {
+  __m128i *rk = (__m128i *)roundkeys;
+  __m128i temp = _mm_loadu_si128((const __m128i *)key);
+  _mm_storeu_si128(&rk[0], temp);
+  temp = expand_step<0x01>(temp);
+  _mm_storeu_si128(&rk[1], temp);
+  temp = expand_step<0x02>(temp);
+  _mm_storeu_si128(&rk[2], temp);
+  temp = expand_step<0x04>(temp);
+  _mm_storeu_si128(&rk[3], temp);
+  temp = expand_step<0x08>(temp);
+  _mm_storeu_si128(&rk[4], temp);
+  temp = expand_step<0x10>(temp);
+  _mm_storeu_si128(&rk[5], temp);
+  temp = expand_step<0x20>(temp);
+  _mm_storeu_si128(&rk[6], temp);
+  temp = expand_step<0x40>(temp);
+  _mm_storeu_si128(&rk[7], temp);
+  temp = expand_step<0x80>(temp);
+  _mm_storeu_si128(&rk[8], temp);
+  temp = expand_step<0x1B>(temp);
+  _mm_storeu_si128(&rk[9], temp);
+  temp = expand_step<0x36>(temp);
+  _mm_storeu_si128(&rk[10], temp);
+}
+
+template <int rounds>
+AESNI_TARGET void
+aesni_expand_dec_key(const uint32_t roundkeys[(rounds + 1) * 4],
+                     uint32_t dec_roundkeys[(rounds + 1) * 4]) {
+  const __m128i *rk = (const __m128i *)roundkeys;
+  __m128i *drk = (__m128i *)dec_roundkeys;
+  // AESDEC expects InvMixColumns applied to the middle round keys
+  _mm_storeu_si128(&drk[0], _mm_loadu_si128(&rk[rounds]));
+#pragma GCC unroll 14
+  for (int round = 1; round <= rounds - 1; round++) {
+    _mm_storeu_si128(&drk[round],
+                     _mm_aesimc_si128(_mm_loadu_si128(&rk[rounds - round])));
+  }
+  _mm_storeu_si128(&drk[rounds], _mm_loadu_si128(&rk[0]));
+}
+
+template <int rounds>
+AESNI_TARGET void aesni_cbc_encrypt(const uint32_t roundkeys[(rounds + 1) * 4],
+                                    const uint8_t iv[16], const uint8_t *input,
+                                    uint8_t *output, size_t blocks) {
+  // keep all round keys in registers
+  __m128i rk[rounds + 1];
+  for (int round = 0; round <= rounds; round++) {
+    rk[round] = _mm_loadu_si128((const __m128i *)&roundkeys[round * 4]);
+  }
+
+  __m128i state = _mm_loadu_si128((const __m128i *)iv);
+  for (size_t i = 0; i < blocks; i++) {
+    // plain text is xored with last cipher text
+    __m128i data = _mm_loadu_si128((const __m128i *)&input[i * 16]);
+    state = _mm_xor_si128(state, data);
+    state = _mm_xor_si128(state, rk[0]);
+#pragma GCC unroll 14
+    for (int round = 1; round <= rounds - 1; round++) {
+      state = _mm_aesenc_si128(state, rk[round]);
+    }
+    state = _mm_aesenclast_si128(state, rk[rounds]);
+    _mm_storeu_si128((__m128i *)&output[i * 16], state);
+  }
+}
+
+template <int rounds>
+AESNI_TARGET void
+aesni_cbc_decrypt(const uint32_t dec_roundkeys[(rounds + 1) * 4],
+                  const uint8_t iv[16], const uint8_t *input, uint8_t *output,
+                  size_t blocks) {
+  __m128i rk[rounds + 1];
+  for (int round = 0; round <= rounds; round++) {
+    rk[round] = _mm_loadu_si128((const __m128i *)&dec_roundkeys[round * 4]);
+  }
+
+  __m128i cur_iv = _mm_loadu_si128((const __m128i *)iv);
+  size_t i = 0;
+
+  // blocks do not depend on each other in decryption
+  // AESDEC has a latency of several cycles but can issue every cycle,
+  // so keep 8 blocks in flight
+  for (; i + 8 <= blocks; i += 8) {
+    __m128i data[8];
+    __m128i state[8];
+#pragma GCC unroll 8
+    for (int j = 0; j < 8; j++) {
+      data[j] = _mm_loadu_si128((const __m128i *)&input[(i + j) * 16]);
+      state[j] = _mm_xor_si128(data[j], rk[0]);
+    }
+#pragma GCC unroll 14
+    for (int round = 1; round <= rounds - 1; round++) {
+#pragma GCC unroll 8
+      for (int j = 0; j < 8; j++) {
+        state[j] = _mm_aesdec_si128(state[j], rk[round]);
+      }
+    }
+#pragma GCC unroll 8
+    for (int j = 0; j < 8; j++) {
+      state[j] = _mm_aesdeclast_si128(state[j], rk[rounds]);
+    }
+    // plain text is xored with last cipher text
+    _mm_storeu_si128((__m128i *)&output[i * 16],
+                     _mm_xor_si128(state[0], cur_iv));
+#pragma GCC unroll 8
+    for (int j = 1; j < 8; j++) {
+      _mm_storeu_si128((__m128i *)&output[(i + j) * 16],
+                       _mm_xor_si128(state[j], data[j - 1]));
+    }
+    cur_iv = data[7];
+  }
+
+  // tail, one block at a time
+  for (; i < blocks; i++) {
+    __m128i data = _mm_loadu_si128((const __m128i *)&input[i * 16]);
+    __m128i state = _mm_xor_si128(data, rk[0]);
+#pragma GCC unroll 14
+    for (int round = 1; round <= rounds - 1; round++) {
+      state = _mm_aesdec_si128(state, rk[round]);
+    }
+    state = _mm_aesdeclast_si128(state, rk[rounds]);
+    _mm_storeu_si128((__m128i *)&output[i * 16], _mm_xor_si128(state, cur_iv));
+    cur_iv = data;
+  }
+}
+
+// ECB encryption of independent blocks, 8 in flight
+template <int rounds>
+AESNI_TARGET void aesni_ecb_encrypt(const uint32_t roundkeys[(rounds + 1) * 4],
+                                    const uint8_t *input, uint8_t *output,
+                                    size_t blocks) {
+  __m128i rk[rounds + 1];
+  for (int round = 0; round <= rounds; round++) {
+    rk[round] = _mm_loadu_si128((const __m128i *)&roundkeys[round * 4]);
+  }
+
+  size_t i = 0;
+  for (; i + 8 <= blocks; i += 8) {
+    __m128i state[8];
+#pragma GCC unroll 8
+    for (int j = 0; j < 8; j++) {
+      state[j] = _mm_xor_si128(
+          _mm_loadu_si128((const __m128i *)&input[(i + j) * 16]), rk[0]);
+    }
+#pragma GCC unroll 14
+    for (int round = 1; round <= rounds - 1; round++) {
+#pragma GCC unroll 8
+      for (int j = 0; j < 8; j++) {
+        state[j] = _mm_aesenc_si128(state[j], rk[round]);
+      }
+    }
+#pragma GCC unroll 8
+    for (int j = 0; j < 8; j++) {
+      _mm_storeu_si128((__m128i *)&output[(i + j) * 16],
+                       _mm_aesenclast_si128(state[j], rk[rounds]));
+    }
+  }
+
+  // tail, one block at a time
+  for (; i < blocks; i++) {
+    __m128i state = _mm_xor_si128(
+        _mm_loadu_si128((const __m128i *)&input[i * 16]), rk[0]);
+#pragma GCC unroll 14
+    for (int round = 1; round <= rounds - 1; round++) {
+      state = _mm_aesenc_si128(state, rk[round]);
+    }
+    _mm_storeu_si128((__m128i *)&output[i * 16],
+                     _mm_aesenclast_si128(state, rk[rounds]));
+  }
+}
+
+// ECB decryption of independent blocks, 8 in flight
+template <int rounds>
+AESNI_TARGET void
+aesni_ecb_decrypt(const uint32_t dec_roundkeys[(rounds + 1) * 4],
+                  const uint8_t *input, uint8_t *output, size_t blocks) {
+  __m128i rk[rounds + 1];
+  for (int round = 0; round <= rounds; round++) {
+    rk[round] = _mm_loadu_si128((const __m128i *)&dec_roundkeys[round * 4]);
+  }
+
+  size_t i = 0;
+  for (; i + 8 <= blocks; i += 8) {
+    __m128i state[8];
+#pragma GCC unroll 8
+    for (int j = 0; j < 8; j++) {
+      state[j] = _mm_xor_si128(
+          _mm_loadu_si128((const __m128i *)&input[(i + j) * 16]), rk[0]);
+    }
+#pragma GCC unroll 14
+    for (int round = 1; round <= rounds - 1; round++) {
+#pragma GCC unroll 8
+      for (int j = 0; j < 8; j++) {
+        state[j] = _mm_aesdec_si128(state[j], rk[round]);
+      }
+    }
+#pragma GCC unroll 8
+    for (int j = 0; j < 8; j++) {
+      _mm_storeu_si128((__m128i *)&output[(i + j) * 16],
+                       _mm_aesdeclast_si128(state[j], rk[rounds]));
+    }
+  }
+
+  // tail, one block at a time
+  for (; i < blocks; i++) {
+    __m128i state = _mm_xor_si128(
+        _mm_loadu_si128((const __m128i *)&input[i * 16]), rk[0]);
+#pragma GCC unroll 14
+    for (int round = 1; round <= rounds - 1; round++) {
+      state = _mm_aesdec_si128(state, rk[round]);
+    }
+    _mm_storeu_si128((__m128i *)&output[i * 16],
+                     _mm_aesdeclast_si128(state, rk[rounds]));
+  }
+}
+
+// CBC encryption of up to 8 independent streams, stream j with roundkeys[j]
+// the chains are interleaved, 8 blocks in flight like aesni_cbc_decrypt
+// the round keys are read from memory, 8 key schedules do not fit in registers
+template <int rounds>
+AESNI_TARGET void aesni_cbc_encrypt_multi(const uint32_t *const roundkeys[8],
+                                          uint8_t ivs[8 * 16],
+                                          const uint8_t *const input[8],
+                                          uint8_t *const output[8],
+                                          size_t streams, size_t blocks) {
+  // missing streams repeat the first one, their output is dropped
+  const uint32_t *rk[8];
+  const uint8_t *src[8];
+  __m128i state[8];
+  for (int j = 0; j < 8; j++) {
+    size_t stream = (size_t)j < streams ? j : 0;
+    rk[j] = roundkeys[stream];
+    src[j] = input[stream];
+    state[j] = _mm_loadu_si128((const __m128i *)&ivs[stream * 16]);
+  }
+
+  for (size_t i = 0; i < blocks; i++) {
+    // plain text is xored with last cipher text
+#pragma GCC unroll 8
+    for (int j = 0; j < 8; j++) {
+      __m128i data = _mm_loadu_si128((const __m128i *)&src[j][i * 16]);
+      state[j] = _mm_xor_si128(_mm_xor_si128(state[j], data),
+                               _mm_loadu_si128((const __m128i *)rk[j]));
+    }
+#pragma GCC unroll 14
+    for (int round = 1; round <= rounds - 1; round++) {
+#pragma GCC unroll 8
+      for (int j = 0; j < 8; j++) {
+        state[j] = _mm_aesenc_si128(
+            state[j], _mm_loadu_si128((const __m128i *)&rk[j][round * 4]));
+      }
+    }
+#pragma GCC unroll 8
+    for (int j = 0; j < 8; j++) {
+      state[j] = _mm_aesenclast_si128(
+          state[j], _mm_loadu_si128((const __m128i *)&rk[j][rounds * 4]));
+      if (output != nullptr && (size_t)j < streams) {
+        _mm_storeu_si128((__m128i *)&output[j][i * 16], state[j]);
+      }
+    }
+  }
+
+  for (size_t j = 0; j < streams; j++) {
+    _mm_storeu_si128((__m128i *)&ivs[j * 16], state[j]);
+  }
+}
+
+#else
+
+// not available on this architecture, never selected
+#define AESNI_TARGET
+
+void aesni_expand_key(const uint8_t[16], uint32_t[(10 + 1) * 4]) { abort(); }
+
+template <int rounds>
+void aesni_expand_dec_key(const uint32_t[(rounds + 1) * 4],
+                          uint32_t[(rounds + 1) * 4]) {
+  abort();
+}
+
+template <int rounds>
+void aesni_cbc_encrypt(const uint32_t[(rounds + 1) * 4], const uint8_t[16],
+                       const uint8_t *, uint8_t *, size_t) {
+  abort();
+}
+
+template <int rounds>
+void aesni_cbc_decrypt(const uint32_t[(rounds + 1) * 4], const uint8_t[16],
+                       const uint8_t *, uint8_t *, size_t) {
+  abort();
+}
+
+template <int rounds>
+void aesni_ecb_encrypt(const uint32_t[(rounds + 1) * 4], const uint8_t *,
+                       uint8_t *, size_t) {
+  abort();
+}
+
+template <int rounds>
+void aesni_ecb_decrypt(const uint32_t[(rounds + 1) * 4], const uint8_t *,
+                       uint8_t *, size_t) {
+  abort();
+}
+
+template <int rounds>
+void aesni_cbc_encrypt_multi(const uint32_t *const[8], uint8_t[8 * 16],
+                             const uint8_t *const[8], uint8_t *const[8], size_t,
+                             size_t) {
+  abort();
+}
+
+#endif
+
+// AES-128, AES-192 and AES-256
+#define AESNI_INSTANTIATE(rounds)                                              \
+  template AESNI_TARGET void aesni_expand_dec_key<rounds>(const uint32_t *,    \
+                                                          uint32_t *);         \
+  template AESNI_TARGET void aesni_cbc_encrypt<rounds>(                        \
+      const uint32_t *, const uint8_t *, const uint8_t *, uint8_t *, size_t);  \
+  template AESNI_TARGET void aesni_cbc_decrypt<rounds>(                        \
+      const uint32_t *, const uint8_t *, const uint8_t *, uint8_t *, size_t);  \
+  template AESNI_TARGET void aesni_ecb_encrypt<rounds>(                        \
+      const uint32_t *, const uint8_t *, uint8_t *, size_t);                   \
+  template AESNI_TARGET void aesni_ecb_decrypt<rounds>(                        \
+      const uint32_t *, const uint8_t *, uint8_t *, size_t);                   \
+  template AESNI_TARGET void aesni_cbc_encrypt_multi<rounds>(                  \
+      const uint32_t *const *, uint8_t *, const uint8_t *const *,              \
+      uint8_t *const *, size_t, size_t);
+
+AESNI_INSTANTIATE(10)
+AESNI_INSTANTIATE(12)
+AESNI_INSTANTIATE(14)
@@ -5,9 +5,19 @@ using namespace std;
 
 enum Algorithm {
   DES,
+  DES_PAIRED,
+  DES3,
+  DES_CTR,
   AES128,
+  AES128_CTR,
+  AES128_GCM,
+  AES128_XTS,
+  AES256,
   SM4,
+  SM4_CTR,
+  SM4_GCM,
   RC4,
+  RC4_BATCH,
   SHA224,
   SHA256,
   SHA384,
@@ -25,43 +35,139 @@ int main() {
   std::vector<uint8_t> input(input_bytes);
   random_fill(input);
   for (auto algo :
-       {Algorithm::DES, Algorithm::AES128, Algorithm::SM4, Algorithm::RC4}) {
+       {Algorithm::DES, Algorithm::DES_PAIRED, Algorithm::DES3,
+        Algorithm::DES_CTR, Algorithm::AES128, Algorithm::AES128_CTR,
+        Algorithm::AES128_GCM, Algorithm::AES128_XTS, Algorithm::AES256,
+        Algorithm::SM4, Algorithm::SM4_CTR, Algorithm::SM4_GCM,
+        Algorithm::RC4, Algorithm::RC4_BATCH}) {
     for (bool enc : {true, false}) {
       size_t key_size = 0;
       size_t iv_size = 0;
-      const char *algo_name;
+      const char *algo_name = "";
       if (algo == Algorithm::DES) {
         key_size = 8;
         iv_size = 8;
         algo_name = "DES";
+      } else if (algo == Algorithm::DES_PAIRED) {
+        // the tables of 12-bit index for every block, even in decryption
+        key_size = 8;
+        iv_size = 8;
+        algo_name = "DES-PAIRED";
+      } else if (algo == Algorithm::DES3) {
+        key_size = 24;
+        iv_size = 8;
+        algo_name = "DES3";
+      } else if (algo == Algorithm::DES_CTR) {
+        key_size = 8;
+        iv_size = 8;
+        algo_name = "DES-CTR";
       } else if (algo == Algorithm::AES128) {
         key_size = 16;
         iv_size = 16;
         algo_name = "AES128";
+      } else if (algo == Algorithm::AES128_CTR) {
+        key_size = 16;
+        iv_size = 16;
+        algo_name = "AES128-CTR";
+      } else if (algo == Algorithm::AES128_GCM) {
+        key_size = 16;
+        iv_size = 12;
+        algo_name = "AES128-GCM";
+      } else if (algo == Algorithm::AES128_XTS) {
+        key_size = 32;
+        iv_size = 0; // sector number instead
+        algo_name = "AES128-XTS";
+      } else if (algo == Algorithm::AES256) {
+        key_size = 32;
+        iv_size = 16;
+        algo_name = "AES256";
       } else if (algo == Algorithm::SM4) {
         key_size = 16;
         iv_size = 16;
         algo_name = "SM4";
+      } else if (algo == Algorithm::SM4_CTR) {
+        key_size = 16;
+        iv_size = 16;
+        algo_name = "SM4-CTR";
+      } else if (algo == Algorithm::SM4_GCM) {
+        key_size = 16;
+        iv_size = 12;
+        algo_name = "SM4-GCM";
       } else if (algo == Algorithm::RC4) {
         key_size = 128;
         iv_size = 128; // useless
         algo_name = "RC4";
+      } else if (algo == Algorithm::RC4_BATCH) {
+        // 8 messages of 256 bytes, each with a 16-byte key
+        key_size = 128;
+        iv_size = 128; // useless
+        algo_name = "RC4-BATCH";
       }
       std::vector<uint8_t> key(key_size);
       std::vector<uint8_t> iv(iv_size);
       random_fill(key);
       random_fill(iv);
       std::vector<uint8_t> output;
+      std::vector<uint8_t> aad;
+      std::vector<uint8_t> tag(16);
+      des_set_backend(algo == Algorithm::DES_PAIRED ? DESBackend::PairedTable
+                                                    : DESBackend::Auto);
+      std::vector<std::vector<uint8_t>> batch_keys(8), batch_inputs(8),
+          batch_outputs(8);
+      std::vector<rc4_job> jobs;
+      if (algo == Algorithm::RC4_BATCH) {
+        size_t size = input_bytes / 8;
+        for (int i = 0; i < 8; i++) {
+          batch_keys[i].assign(key.begin() + i * 16, key.begin() + i * 16 + 16);
+          batch_inputs[i].assign(input.begin() + i * size,
+                                 input.begin() + i * size + size);
+          jobs.push_back({&batch_keys[i], &batch_inputs[i], &batch_outputs[i]});
+        }
+      }
       auto start = chrono::high_resolution_clock::now();
       for (int i = 0; i < repeat; i++) {
-        if (algo == Algorithm::DES) {
+        if (algo == Algorithm::DES || algo == Algorithm::DES_PAIRED) {
           des_cbc(enc, input, key, iv, output);
+        } else if (algo == Algorithm::DES3) {
+          des3_cbc(enc, input, key, iv, output);
+        } else if (algo == Algorithm::DES_CTR) {
+          des_ctr(input, key, iv, output);
         } else if (algo == Algorithm::AES128) {
           aes128_cbc(enc, input, key, iv, output);
+        } else if (algo == Algorithm::AES128_CTR) {
+          aes128_ctr(input, key, iv, output);
+        } else if (algo == Algorithm::AES128_GCM) {
+          if (enc) {
+            aes128_gcm_encrypt(input, key, iv, aad, output, tag);
+          } else {
+            // the tag does not match, the whole input is still processed
+            aes128_gcm_decrypt(input, key, iv, aad, tag, output);
+          }
+        } else if (algo == Algorithm::AES128_XTS) {
+          // 512-byte sectors
+          aes_xts_context ctx;
+          aes_xts_init(ctx, key);
+          if (enc) {
+            aes_xts_encrypt(ctx, 0, 512, input, output);
+          } else {
+            aes_xts_decrypt(ctx, 0, 512, input, output);
+          }
+        } else if (algo == Algorithm::AES256) {
+          aes_cbc(enc, input, key, iv, output);
         } else if (algo == Algorithm::SM4) {
           sm4_cbc(enc, input, key, iv, output);
+        } else if (algo == Algorithm::SM4_CTR) {
+          sm4_ctr(input, key, iv, output);
+        } else if (algo == Algorithm::SM4_GCM) {
+          if (enc) {
+            sm4_gcm_encrypt(input, key, iv, aad, output, tag);
+          } else {
+            sm4_gcm_decrypt(input, key, iv, aad, tag, output);
+          }
         } else if (algo == Algorithm::RC4) {
           rc4(input, key, output);
+        } else if (algo == Algorithm::RC4_BATCH) {
+          rc4_batch(jobs);
         }
       }
       auto end = chrono::high_resolution_clock::now();
@@ -79,7 +185,7 @@ int main() {
        {Algorithm::SHA224, Algorithm::SHA256, Algorithm::SHA384,
         Algorithm::SHA512, Algorithm::SM3, Algorithm::SHA3_224,
         Algorithm::SHA3_256, Algorithm::SHA3_384, Algorithm::SHA3_512}) {
-    const char *algo_name;
+    const char *algo_name = "";
     if (algo == Algorithm::SHA224) {
       algo_name = "SHA224";
     } else if (algo == Algorithm::SHA256) {
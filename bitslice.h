@@ -0,0 +1,29 @@
+#ifndef __BITSLICE_H__
+#define __BITSLICE_H__
+
+#include <stdint.h>
+
+// internal helpers shared by bitsliced DES(bsdes.cpp) and SM4(bssm4.cpp)
+// a word holds one bit of 64 blocks per 64-bit lane
+// 1 lane: 64 blocks, AVX2: 4 lanes = 256 blocks
+typedef uint64_t u64x4 __attribute__((vector_size(32)));
+
+// transpose the 64x64 bit matrix in each lane: bit j of a[i] <-> bit i of a[j]
+// the swaps work on whole vectors, so all lanes are transposed together
+template <class W>
+inline __attribute__((always_inline)) void bs_transpose(W a[64]) {
+  const uint64_t masks[6] = {0x00000000FFFFFFFFULL, 0x0000FFFF0000FFFFULL,
+                             0x00FF00FF00FF00FFULL, 0x0F0F0F0F0F0F0F0FULL,
+                             0x3333333333333333ULL, 0x5555555555555555ULL};
+  for (int stage = 0; stage < 6; stage++) {
+    int shift = 32 >> stage;
+    uint64_t mask = masks[stage];
+    for (int i = 0; i < 64; i = ((i | shift) + 1) & ~shift) {
+      W t = ((a[i] >> shift) ^ a[i | shift]) & mask;
+      a[i | shift] ^= t;
+      a[i] ^= t << shift;
+    }
+  }
+}
+
+#endif
@@ -0,0 +1,577 @@
+#include "aes.h"
+#include "util.h"
+#include <cstring>
+
+// reference:
+// https://eprint.iacr.org/2009/129.pdf
+// https://www.bearssl.org/constanttime.html
+// https://eprint.iacr.org/2009/191.pdf
+
+// bitsliced AES
+// no table lookups indexed by secret data, so it runs in constant time
+//
+// the layout follows BearSSL's aes_ct64: 8 64-bit words q[0..7] hold 4 blocks,
+// q[i] contains bit i of every byte of the 4 blocks
+// wider lanes are made of several 64-bit words side by side: every 64-bit
+// word of a vector is an independent aes_ct64 state, all operations below
+// never move bits across 64-bit boundaries
+// SSE2: 2 x 64 bits = 8 blocks, AVX2: 4 x 64 bits = 16 blocks
+typedef uint64_t u64x2 __attribute__((vector_size(16)));
+typedef uint64_t u64x4 __attribute__((vector_size(32)));
+
+#define BSAES_INLINE inline __attribute__((always_inline))
+
+// S-box as boolean circuit(Boyar, Peralta), 113 gates
+template <class W> BSAES_INLINE void bs_sbox(W q[8]) {
+  W x0, x1, x2, x3, x4, x5, x6, x7;
+  W y1, y2, y3, y4, y5, y6, y7, y8, y9;
+  W y10, y11, y12, y13, y14, y15, y16, y17, y18, y19;
+  W y20, y21;
+  W z0, z1, z2, z3, z4, z5, z6, z7, z8, z9;
+  W z10, z11, z12, z13, z14, z15, z16, z17;
+  W t0, t1, t2, t3, t4, t5, t6, t7, t8, t9;
+  W t10, t11, t12, t13, t14, t15, t16, t17, t18, t19;
+  W t20, t21, t22, t23, t24, t25, t26, t27, t28, t29;
+  W t30, t31, t32, t33, t34, t35, t36, t37, t38, t39;
+  W t40, t41, t42, t43, t44, t45, t46, t47, t48, t49;
+  W t50, t51, t52, t53, t54, t55, t56, t57, t58, t59;
+  W t60, t61, t62, t63, t64, t65, t66, t67;
+  W s0, s1, s2, s3, s4, s5, s6, s7;
+
+  x0 = q[7];
+  x1 = q[6];
+  x2 = q[5];
+  x3 = q[4];
+  x4 = q[3];
+  x5 = q[2];
+  x6 = q[1];
+  x7 = q[0];
+
+  // top linear transformation
+  y14 = x3 ^ x5;
+  y13 = x0 ^ x6;
+  y9 = x0 ^ x3;
+  y8 = x0 ^ x5;
+  t0 = x1 ^ x2;
+  y1 = t0 ^ x7;
+  y4 = y1 ^ x3;
+  y12 = y13 ^ y14;
+  y2 = y1 ^ x0;
+  y5 = y1 ^ x6;
+  y3 = y5 ^ y8;
+  t1 = x4 ^ y12;
+  y15 = t1 ^ x5;
+  y20 = t1 ^ x1;
+  y6 = y15 ^ x7;
+  y10 = y15 ^ t0;
+  y11 = y20 ^ y9;
+  y7 = x7 ^ y11;
+  y17 = y10 ^ y11;
+  y19 = y10 ^ y8;
+  y16 = t0 ^ y11;
+  y21 = y13 ^ y16;
+  y18 = x0 ^ y16;
+
+  // non-linear section
+  t2 = y12 & y15;
+  t3 = y3 & y6;
+  t4 = t3 ^ t2;
+  t5 = y4 & x7;
+  t6 = t5 ^ t2;
+  t7 = y13 & y16;
+  t8 = y5 & y1;
+  t9 = t8 ^ t7;
+  t10 = y2 & y7;
+  t11 = t10 ^ t7;
+  t12 = y9 & y11;
+  t13 = y14 & y17;
+  t14 = t13 ^ t12;
+  t15 = y8 & y10;
+  t16 = t15 ^ t12;
+  t17 = t4 ^ t14;
+  t18 = t6 ^ t16;
+  t19 = t9 ^ t14;
+  t20 = t11 ^ t16;
+  t21 = t17 ^ y20;
+  t22 = t18 ^ y19;
+  t23 = t19 ^ y21;
+  t24 = t20 ^ y18;
+
+  t25 = t21 ^ t22;
+  t26 = t21 & t23;
+  t27 = t24 ^ t26;
+  t28 = t25 & t27;
+  t29 = t28 ^ t22;
+  t30 = t23 ^ t24;
+  t31 = t22 ^ t26;
+  t32 = t31 & t30;
+  t33 = t32 ^ t24;
+  t34 = t23 ^ t33;
+  t35 = t27 ^ t33;
+  t36 = t24 & t35;
+  t37 = t36 ^ t34;
+  t38 = t27 ^ t36;
+  t39 = t29 & t38;
+  t40 = t25 ^ t39;
+
+  t41 = t40 ^ t37;
+  t42 = t29 ^ t33;
+  t43 = t29 ^ t40;
+  t44 = t33 ^ t37;
+  t45 = t42 ^ t41;
+  z0 = t44 & y15;
+  z1 = t37 & y6;
+  z2 = t33 & x7;
+  z3 = t43 & y16;
+  z4 = t40 & y1;
+  z5 = t29 & y7;
+  z6 = t42 & y11;
+  z7 = t45 & y17;
+  z8 = t41 & y10;
+  z9 = t44 & y12;
+  z10 = t37 & y3;
+  z11 = t33 & y4;
+  z12 = t43 & y13;
+  z13 = t40 & y5;
+  z14 = t29 & y2;
+  z15 = t42 & y9;
+  z16 = t45 & y14;
+  z17 = t41 & y8;
+
+  // bottom linear transformation
+  t46 = z15 ^ z16;
+  t47 = z10 ^ z11;
+  t48 = z5 ^ z13;
+  t49 = z9 ^ z10;
+  t50 = z2 ^ z12;
+  t51 = z2 ^ z5;
+  t52 = z7 ^ z8;
+  t53 = z0 ^ z3;
+  t54 = z6 ^ z7;
+  t55 = z16 ^ z17;
+  t56 = z12 ^ t48;
+  t57 = t50 ^ t53;
+  t58 = z4 ^ t46;
+  t59 = z3 ^ t54;
+  t60 = t46 ^ t57;
+  t61 = z14 ^ t57;
+  t62 = t52 ^ t58;
+  t63 = t49 ^ t58;
+  t64 = z4 ^ t59;
+  t65 = t61 ^ t62;
+  t66 = z1 ^ t63;
+  s0 = t59 ^ t63;
+  s6 = t56 ^ ~t62;
+  s7 = t48 ^ ~t60;
+  t67 = t64 ^ t65;
+  s3 = t53 ^ t66;
+  s4 = t51 ^ t66;
+  s5 = t47 ^ t65;
+  s1 = t64 ^ ~s3;
+  s2 = t55 ^ ~t67;
+
+  q[7] = s0;
+  q[6] = s1;
+  q[5] = s2;
+  q[4] = s3;
+  q[3] = s4;
+  q[2] = s5;
+  q[1] = s6;
+  q[0] = s7;
+}
+
+// inverse of the affine transform in the S-box
+template <class W> BSAES_INLINE void bs_inv_affine(W q[8]) {
+  W q0 = ~q[0];
+  W q1 = ~q[1];
+  W q2 = q[2];
+  W q3 = q[3];
+  W q4 = q[4];
+  W q5 = ~q[5];
+  W q6 = ~q[6];
+  W q7 = q[7];
+  q[7] = q1 ^ q4 ^ q6;
+  q[6] = q0 ^ q3 ^ q5;
+  q[5] = q7 ^ q2 ^ q4;
+  q[4] = q6 ^ q1 ^ q3;
+  q[3] = q5 ^ q0 ^ q2;
+  q[2] = q4 ^ q7 ^ q1;
+  q[1] = q3 ^ q6 ^ q0;
+  q[0] = q2 ^ q5 ^ q7;
+}
+
+// S^-1(x) = A^-1(S(A^-1(x))), inversion is an involution
+template <class W> BSAES_INLINE void bs_inv_sbox(W q[8]) {
+  bs_inv_affine(q);
+  bs_sbox(q);
+  bs_inv_affine(q);
+}
+
+// each 64-bit word: 16 bits per row, 4 bits per byte of the row
+template <class W> BSAES_INLINE void bs_shift_rows(W q[8]) {
+  for (int i = 0; i < 8; i++) {
+    W x = q[i];
+    q[i] = (x & 0x000000000000FFFFULL) | ((x & 0x00000000FFF00000ULL) >> 4) |
+           ((x & 0x00000000000F0000ULL) << 12) |
+           ((x & 0x0000FF0000000000ULL) >> 8) |
+           ((x & 0x000000FF00000000ULL) << 8) |
+           ((x & 0xF000000000000000ULL) >> 12) |
+           ((x & 0x0FFF000000000000ULL) << 4);
+  }
+}
+
+template <class W> BSAES_INLINE void bs_inv_shift_rows(W q[8]) {
+  for (int i = 0; i < 8; i++) {
+    W x = q[i];
+    q[i] = (x & 0x000000000000FFFFULL) | ((x & 0x000000000FFF0000ULL) << 4) |
+           ((x & 0x00000000F0000000ULL) >> 12) |
+           ((x & 0x000000FF00000000ULL) << 8) |
+           ((x & 0x0000FF0000000000ULL) >> 8) |
+           ((x & 0x000F000000000000ULL) << 12) |
+           ((x & 0xFFF0000000000000ULL) >> 4);
+  }
+}
+
+// rotate by 32 bits in each 64-bit word
+// a macro, 256-bit vectors can not be passed by value without AVX
+#define rotr32(x) (((x) << 32) | ((x) >> 32))
+
+template <class W> BSAES_INLINE void bs_mix_columns(W q[8]) {
+  W q0 = q[0], q1 = q[1], q2 = q[2], q3 = q[3];
+  W q4 = q[4], q5 = q[5], q6 = q[6], q7 = q[7];
+  // rotate each column by one row
+  W r0 = (q0 >> 16) | (q0 << 48);
+  W r1 = (q1 >> 16) | (q1 << 48);
+  W r2 = (q2 >> 16) | (q2 << 48);
+  W r3 = (q3 >> 16) | (q3 << 48);
+  W r4 = (q4 >> 16) | (q4 << 48);
+  W r5 = (q5 >> 16) | (q5 << 48);
+  W r6 = (q6 >> 16) | (q6 << 48);
+  W r7 = (q7 >> 16) | (q7 << 48);
+
+  // multiplication by 2 moves bit i to bit i+1, bit 7 feeds back 0x1B
+  q[0] = q7 ^ r7 ^ r0 ^ rotr32(q0 ^ r0);
+  q[1] = q0 ^ r0 ^ q7 ^ r7 ^ r1 ^ rotr32(q1 ^ r1);
+  q[2] = q1 ^ r1 ^ r2 ^ rotr32(q2 ^ r2);
+  q[3] = q2 ^ r2 ^ q7 ^ r7 ^ r3 ^ rotr32(q3 ^ r3);
+  q[4] = q3 ^ r3 ^ q7 ^ r7 ^ r4 ^ rotr32(q4 ^ r4);
+  q[5] = q4 ^ r4 ^ r5 ^ rotr32(q5 ^ r5);
+  q[6] = q5 ^ r5 ^ r6 ^ rotr32(q6 ^ r6);
+  q[7] = q6 ^ r6 ^ r7 ^ rotr32(q7 ^ r7);
+}
+
+template <class W> BSAES_INLINE void bs_inv_mix_columns(W q[8]) {
+  W q0 = q[0], q1 = q[1], q2 = q[2], q3 = q[3];
+  W q4 = q[4], q5 = q[5], q6 = q[6], q7 = q[7];
+  W r0 = (q0 >> 16) | (q0 << 48);
+  W r1 = (q1 >> 16) | (q1 << 48);
+  W r2 = (q2 >> 16) | (q2 << 48);
+  W r3 = (q3 >> 16) | (q3 << 48);
+  W r4 = (q4 >> 16) | (q4 << 48);
+  W r5 = (q5 >> 16) | (q5 << 48);
+  W r6 = (q6 >> 16) | (q6 << 48);
+  W r7 = (q7 >> 16) | (q7 << 48);
+
+  q[0] = q5 ^ q6 ^ q7 ^ r0 ^ r5 ^ r7 ^ rotr32(q0 ^ q5 ^ q6 ^ r0 ^ r5);
+  q[1] = q0 ^ q5 ^ r0 ^ r1 ^ r5 ^ r6 ^ r7 ^ rotr32(q1 ^ q5 ^ q7 ^ r1 ^ r5 ^ r6);
+  q[2] = q0 ^ q1 ^ q6 ^ r1 ^ r2 ^ r6 ^ r7 ^ rotr32(q0 ^ q2 ^ q6 ^ r2 ^ r6 ^ r7);
+  q[3] = q0 ^ q1 ^ q2 ^ q5 ^ q6 ^ r0 ^ r2 ^ r3 ^ r5 ^
+         rotr32(q0 ^ q1 ^ q3 ^ q5 ^ q6 ^ q7 ^ r0 ^ r3 ^ r5 ^ r7);
+  q[4] = q1 ^ q2 ^ q3 ^ q5 ^ r1 ^ r3 ^ r4 ^ r5 ^ r6 ^ r7 ^
+         rotr32(q1 ^ q2 ^ q4 ^ q5 ^ q7 ^ r1 ^ r4 ^ r5 ^ r6);
+  q[5] = q2 ^ q3 ^ q4 ^ q6 ^ r2 ^ r4 ^ r5 ^ r6 ^ r7 ^
+         rotr32(q2 ^ q3 ^ q5 ^ q6 ^ r2 ^ r5 ^ r6 ^ r7);
+  q[6] = q3 ^ q4 ^ q5 ^ q7 ^ r3 ^ r5 ^ r6 ^ r7 ^
+         rotr32(q3 ^ q4 ^ q6 ^ q7 ^ r3 ^ r6 ^ r7);
+  q[7] = q4 ^ q5 ^ q6 ^ r4 ^ r6 ^ r7 ^ rotr32(q4 ^ q5 ^ q7 ^ r4 ^ r7);
+}
+
+template <class W> BSAES_INLINE void bs_add_round_key(W q[8], const W sk[8]) {
+  for (int i = 0; i < 8; i++) {
+    q[i] ^= sk[i];
+  }
+}
+
+template <int rounds, class W>
+BSAES_INLINE void bs_encrypt(const W sk[(rounds + 1) * 8], W q[8]) {
+  bs_add_round_key(q, &sk[0]);
+  for (int round = 1; round <= rounds - 1; round++) {
+    bs_sbox(q);
+    bs_shift_rows(q);
+    bs_mix_columns(q);
+    bs_add_round_key(q, &sk[round * 8]);
+  }
+  bs_sbox(q);
+  bs_shift_rows(q);
+  bs_add_round_key(q, &sk[rounds * 8]);
+}
+
+// straight inverse cipher, uses the encryption round keys
+template <int rounds, class W>
+BSAES_INLINE void bs_decrypt(const W sk[(rounds + 1) * 8], W q[8]) {
+  bs_add_round_key(q, &sk[rounds * 8]);
+  for (int round = rounds - 1; round >= 1; round--) {
+    bs_inv_shift_rows(q);
+    bs_inv_sbox(q);
+    bs_add_round_key(q, &sk[round * 8]);
+    bs_inv_mix_columns(q);
+  }
+  bs_inv_shift_rows(q);
+  bs_inv_sbox(q);
+  bs_add_round_key(q, &sk[0]);
+}
+
+// transpose 8 words so that q[i] holds bit i of each byte
+inline void bs_ortho(uint64_t q[8]) {
+#define SWAPN(cl, ch, s, x, y)                                                 \
+  do {                                                                         \
+    uint64_t a = (x), b = (y);                                                 \
+    (x) = (a & (uint64_t)(cl)) | ((b & (uint64_t)(cl)) << (s));                \
+    (y) = ((a & (uint64_t)(ch)) >> (s)) | (b & (uint64_t)(ch));                \
+  } while (0)
+#define SWAP2(x, y) SWAPN(0x5555555555555555, 0xAAAAAAAAAAAAAAAA, 1, x, y)
+#define SWAP4(x, y) SWAPN(0x3333333333333333, 0xCCCCCCCCCCCCCCCC, 2, x, y)
+#define SWAP8(x, y) SWAPN(0x0F0F0F0F0F0F0F0F, 0xF0F0F0F0F0F0F0F0, 4, x, y)
+  SWAP2(q[0], q[1]);
+  SWAP2(q[2], q[3]);
+  SWAP2(q[4], q[5]);
+  SWAP2(q[6], q[7]);
+
+  SWAP4(q[0], q[2]);
+  SWAP4(q[1], q[3]);
+  SWAP4(q[4], q[6]);
+  SWAP4(q[5], q[7]);
+
+  SWAP8(q[0], q[4]);
+  SWAP8(q[1], q[5]);
+  SWAP8(q[2], q[6]);
+  SWAP8(q[3], q[7]);
+#undef SWAP8
+#undef SWAP4
+#undef SWAP2
+#undef SWAPN
+}
+
+// spread the 4 column words of one block into two 64-bit words
+// q0 gets columns 0 and 2, q1 gets columns 1 and 3, byte by byte
+inline void bs_interleave_in(uint64_t *q0, uint64_t *q1, const uint32_t w[4]) {
+  uint64_t x0 = w[0], x1 = w[1], x2 = w[2], x3 = w[3];
+  x0 |= (x0 << 16);
+  x1 |= (x1 << 16);
+  x2 |= (x2 << 16);
+  x3 |= (x3 << 16);
+  x0 &= 0x0000FFFF0000FFFFULL;
+  x1 &= 0x0000FFFF0000FFFFULL;
+  x2 &= 0x0000FFFF0000FFFFULL;
+  x3 &= 0x0000FFFF0000FFFFULL;
+  x0 |= (x0 << 8);
+  x1 |= (x1 << 8);
+  x2 |= (x2 << 8);
+  x3 |= (x3 << 8);
+  x0 &= 0x00FF00FF00FF00FFULL;
+  x1 &= 0x00FF00FF00FF00FFULL;
+  x2 &= 0x00FF00FF00FF00FFULL;
+  x3 &= 0x00FF00FF00FF00FFULL;
+  *q0 = x0 | (x2 << 8);
+  *q1 = x1 | (x3 << 8);
+}
+
+inline void bs_interleave_out(uint32_t w[4], uint64_t q0, uint64_t q1) {
+  uint64_t x0 = q0 & 0x00FF00FF00FF00FFULL;
+  uint64_t x1 = q1 & 0x00FF00FF00FF00FFULL;
+  uint64_t x2 = (q0 >> 8) & 0x00FF00FF00FF00FFULL;
+  uint64_t x3 = (q1 >> 8) & 0x00FF00FF00FF00FFULL;
+  x0 |= (x0 >> 8);
+  x1 |= (x1 >> 8);
+  x2 |= (x2 >> 8);
+  x3 |= (x3 >> 8);
+  x0 &= 0x0000FFFF0000FFFFULL;
+  x1 &= 0x0000FFFF0000FFFFULL;
+  x2 &= 0x0000FFFF0000FFFFULL;
+  x3 &= 0x0000FFFF0000FFFFULL;
+  w[0] = (uint32_t)x0 | (uint32_t)(x0 >> 16);
+  w[1] = (uint32_t)x1 | (uint32_t)(x1 >> 16);
+  w[2] = (uint32_t)x2 | (uint32_t)(x2 >> 16);
+  w[3] = (uint32_t)x3 | (uint32_t)(x3 >> 16);
+}
+
+// 4 blocks <-> one 64-bit bitsliced state
+inline void bs_load(uint64_t q[8], const uint8_t *input) {
+  for (int i = 0; i < 4; i++) {
+    uint32_t w[4];
+    for (int j = 0; j < 4; j++) {
+      w[j] = load_le32(&input[i * 16 + j * 4]);
+    }
+    bs_interleave_in(&q[i], &q[i + 4], w);
+  }
+  bs_ortho(q);
+}
+
+inline void bs_store(uint64_t q[8], uint8_t *output) {
+  bs_ortho(q);
+  for (int i = 0; i < 4; i++) {
+    uint32_t w[4];
+    bs_interleave_out(w, q[i], q[i + 4]);
+    for (int j = 0; j < 4; j++) {
+      store_le32(&output[i * 16 + j * 4], w[j]);
+    }
+  }
+}
+
+template <int rounds>
+void bsaes_expand_key(const uint32_t roundkeys[(rounds + 1) * 4],
+                      uint64_t sk[(rounds + 1) * 8]) {
+  // the same round key for all 4 blocks
+  for (int round = 0; round <= rounds; round++) {
+    uint64_t *q = &sk[round * 8];
+    for (int i = 0; i < 4; i++) {
+      bs_interleave_in(&q[i], &q[i + 4], &roundkeys[round * 4]);
+    }
+    bs_ortho(q);
+  }
+}
+
+// run the cipher on one full batch of LANES * 4 blocks, W has LANES 64-bit
+// words
+template <int rounds, class W, bool encrypt>
+BSAES_INLINE void bs_crypt_batch(const W sk[(rounds + 1) * 8],
+                                 const uint8_t *input, uint8_t *output) {
+  const int lanes = sizeof(W) / sizeof(uint64_t);
+
+  W q[8];
+  for (int lane = 0; lane < lanes; lane++) {
+    uint64_t x[8];
+    bs_load(x, &input[lane * 64]);
+    for (int i = 0; i < 8; i++) {
+      q[i][lane] = x[i];
+    }
+  }
+
+  if (encrypt) {
+    bs_encrypt<rounds>(sk, q);
+  } else {
+    bs_decrypt<rounds>(sk, q);
+  }
+
+  for (int lane = 0; lane < lanes; lane++) {
+    uint64_t x[8];
+    for (int i = 0; i < 8; i++) {
+      x[i] = q[i][lane];
+    }
+    bs_store(x, &output[lane * 64]);
+  }
+}
+
+// run the cipher on LANES * 4 blocks at once
+// partial batches are padded with zeros, the work is the same
+template <int rounds, class W, bool encrypt>
+BSAES_INLINE void bs_crypt_blocks(const uint64_t key_sk[(rounds + 1) * 8],
+                                  const uint8_t *input, uint8_t *output,
+                                  size_t blocks) {
+  const int lanes = sizeof(W) / sizeof(uint64_t);
+  const size_t batch = lanes * 4;
+
+  // broadcast the round keys to all lanes
+  W sk[(rounds + 1) * 8];
+  for (int i = 0; i < (rounds + 1) * 8; i++) {
+    for (int lane = 0; lane < lanes; lane++) {
+      sk[i][lane] = key_sk[i];
+    }
+  }
+
+  for (size_t block = 0; block < blocks; block += batch) {
+    size_t count = blocks - block < batch ? blocks - block : batch;
+    if (count < batch) {
+      uint8_t buffer[batch * 16] = {0};
+      memcpy(buffer, &input[block * 16], count * 16);
+      bs_crypt_batch<rounds, W, encrypt>(sk, buffer, buffer);
+      memcpy(&output[block * 16], buffer, count * 16);
+    } else {
+      bs_crypt_batch<rounds, W, encrypt>(sk, &input[block * 16],
+                                         &output[block * 16]);
+    }
+  }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+// 16 blocks in AVX2 registers, callers check cpu_has_avx2() first
+template <int rounds>
+__attribute__((target("avx2"))) void
+bsaes_crypt_blocks_avx2(bool encrypt, const uint64_t sk[(rounds + 1) * 8],
+                        const uint8_t *input, uint8_t *output, size_t blocks) {
+  if (encrypt) {
+    bs_crypt_blocks<rounds, u64x4, true>(sk, input, output, blocks);
+  } else {
+    bs_crypt_blocks<rounds, u64x4, false>(sk, input, output, blocks);
+  }
+}
+#endif
+
+template <int rounds>
+void bsaes_crypt_blocks(bool encrypt, const uint64_t sk[(rounds + 1) * 8],
+                        const uint8_t *input, uint8_t *output, size_t blocks) {
+#if defined(__x86_64__) || defined(__i386__)
+  // 16 blocks only pay off with enough input
+  if (blocks > 8 && cpu_has_avx2()) {
+    bsaes_crypt_blocks_avx2<rounds>(encrypt, sk, input, output, blocks);
+    return;
+  }
+#endif
+  // 8 blocks in SSE2(or NEON) registers
+  if (encrypt) {
+    bs_crypt_blocks<rounds, u64x2, true>(sk, input, output, blocks);
+  } else {
+    bs_crypt_blocks<rounds, u64x2, false>(sk, input, output, blocks);
+  }
+}
+
+template <int rounds>
+void bsaes_cbc_encrypt_multi(const uint64_t *const key_sk[8],
+                             uint8_t ivs[8 * 16], const uint8_t *const input[8],
+                             uint8_t *const output[8], size_t streams,
+                             size_t blocks) {
+  // after bs_ortho, bit 4k + i of a word belongs to block i of the 4, so the
+  // keys of different streams merge with masks
+  // missing streams repeat the first one
+  u64x2 sk[(rounds + 1) * 8];
+  for (int i = 0; i < (rounds + 1) * 8; i++) {
+    for (int lane = 0; lane < 2; lane++) {
+      uint64_t k = 0;
+      for (int block = 0; block < 4; block++) {
+        size_t stream = lane * 4 + block;
+        k |= key_sk[stream < streams ? stream : 0][i] &
+             (0x1111111111111111ULL << block);
+      }
+      sk[i][lane] = k;
+    }
+  }
+
+  uint8_t state[8 * 16] = {0};
+  memcpy(state, ivs, streams * 16);
+  for (size_t i = 0; i < blocks; i++) {
+    // plain text is xored with last cipher text
+    for (size_t j = 0; j < streams; j++) {
+      for (int k = 0; k < 16; k++) {
+        state[j * 16 + k] ^= input[j][i * 16 + k];
+      }
+    }
+    bs_crypt_batch<rounds, u64x2, true>(sk, state, state);
+    for (size_t j = 0; output != nullptr && j < streams; j++) {
+      memcpy(&output[j][i * 16], &state[j * 16], 16);
+    }
+  }
+  memcpy(ivs, state, streams * 16);
+}
+
+// AES-128, AES-192 and AES-256
+#define BSAES_INSTANTIATE(rounds)                                              \
+  template void bsaes_expand_key<rounds>(const uint32_t *, uint64_t *);        \
+  template void bsaes_crypt_blocks<rounds>(                                    \
+      bool, const uint64_t *, const uint8_t *, uint8_t *, size_t);             \
+  template void bsaes_cbc_encrypt_multi<rounds>(                               \
+      const uint64_t *const *, uint8_t *, const uint8_t *const *,              \
+      uint8_t *const *, size_t, size_t);
+
+BSAES_INSTANTIATE(10)
+BSAES_INSTANTIATE(12)
+BSAES_INSTANTIATE(14)
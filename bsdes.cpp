@@ -0,0 +1,1166 @@
+#include "bitslice.h"
+#include "des.h"
+#include "util.h"
+#include <cassert>
+#include <cstring>
+
+// reference:
+// https://www.darkside.com.au/bitslice/
+// Eli Biham, A Fast New DES Implementation in Software, FSE 1997
+
+// bitsliced DES
+// no table lookups indexed by secret data, so it runs in constant time
+//
+// a state of 64 words holds 64 blocks per 64-bit lane, word i holds bit i of
+// every block, and lane j of a word belongs to blocks 64 j .. 64 j + 63
+// all permutations of DES(IP, E, P, IP^-1) only rename words, only the
+// S-boxes compute
+// 1 lane: 64 blocks, AVX2: 4 lanes = 256 blocks
+
+#define BSDES_INLINE inline __attribute__((always_inline))
+
+// S-boxes as boolean circuits, the xor of the 4 outputs(most significant bit
+// first) into x1..x4
+// a1..a6 are the 6 input bits, a1 and a6 select the row
+// the circuits were derived from the S-box tables by Shannon expansion over
+// the best order of inputs, sharing common subfunctions among the 4 outputs
+template <class W>
+BSDES_INLINE void bs_s1(const W &a1, const W &a2, const W &a3, const W &a4,
+                        const W &a5, const W &a6, W &x1, W &x2, W &x3,
+                        W &x4) {
+  W t0 = ~a5;
+  W t1 = t0 ^ a2;
+  W t2 = a4 | a5;
+  W t3 = a4 ^ t2;
+  W t4 = a4 & a2;
+  W t5 = t2 ^ t4;
+  W t6 = t1 ^ t5;
+  W t7 = t6 & a3;
+  W t8 = t1 ^ t7;
+  W t9 = a2 ^ t3;
+  W t10 = t0 ^ t4;
+  W t11 = t9 ^ t10;
+  W t12 = t11 & a3;
+  W t13 = t9 ^ t12;
+  W t14 = t8 ^ t13;
+  W t15 = t14 & a6;
+  W t16 = t8 ^ t15;
+  W t17 = t0 ^ t3;
+  W t18 = a4 ^ t17;
+  W t19 = t18 & a2;
+  W t20 = a4 ^ t19;
+  W t21 = t0 ^ t20;
+  W t22 = t0 & a3;
+  W t23 = t20 ^ t22;
+  W t24 = t1 | t3;
+  W t25 = t2 ^ t20;
+  W t26 = t24 ^ t25;
+  W t27 = t26 & a3;
+  W t28 = t24 ^ t27;
+  W t29 = t23 ^ t28;
+  W t30 = t29 & a6;
+  W t31 = t23 ^ t30;
+  W t32 = t16 ^ t31;
+  W t33 = t32 & a1;
+  W t34 = t16 ^ t33;
+  W t35 = t18 ^ t24;
+  W t36 = a5 ^ t35;
+  W t37 = a5 & a3;
+  W t38 = t35 ^ t37;
+  W t39 = t24 & ~t21;
+  W t40 = t39 ^ t20;
+  W t41 = t40 & a3;
+  W t42 = t39 ^ t41;
+  W t43 = t38 ^ t42;
+  W t44 = t43 & a6;
+  W t45 = t38 ^ t44;
+  W t46 = t7 ^ t9;
+  W t47 = t6 ^ t40;
+  W t48 = t47 ^ a3;
+  W t49 = t46 ^ t48;
+  W t50 = t49 & a6;
+  W t51 = t46 ^ t50;
+  W t52 = t45 ^ t51;
+  W t53 = t52 & a1;
+  W t54 = t45 ^ t53;
+  W t55 = t18 ^ t23;
+  W t56 = t11 ^ t21;
+  W t57 = t10 ^ t19;
+  W t58 = t56 ^ t57;
+  W t59 = t58 & a3;
+  W t60 = t56 ^ t59;
+  W t61 = t55 ^ t60;
+  W t62 = t61 & a6;
+  W t63 = t55 ^ t62;
+  W t64 = t1 | t10;
+  W t65 = t11 & ~t35;
+  W t66 = t64 ^ t65;
+  W t67 = t66 & a3;
+  W t68 = t64 ^ t67;
+  W t69 = t36 ^ t57;
+  W t70 = t20 ^ t64;
+  W t71 = t69 ^ t70;
+  W t72 = t71 & a3;
+  W t73 = t69 ^ t72;
+  W t74 = t68 ^ t73;
+  W t75 = t74 & a6;
+  W t76 = t68 ^ t75;
+  W t77 = t63 ^ t76;
+  W t78 = t77 & a1;
+  W t79 = t63 ^ t78;
+  W t80 = t47 ^ t67;
+  W t81 = t36 ^ t65;
+  W t82 = t81 & a3;
+  W t83 = t36 ^ t82;
+  W t84 = t80 ^ t83;
+  W t85 = t84 & a6;
+  W t86 = t80 ^ t85;
+  W t87 = t3 ^ t36;
+  W t88 = t87 ^ t37;
+  W t89 = a4 ^ t57;
+  W t90 = ~t24;
+  W t91 = t89 ^ t90;
+  W t92 = t91 & a3;
+  W t93 = t89 ^ t92;
+  W t94 = t88 ^ t93;
+  W t95 = t94 & a6;
+  W t96 = t88 ^ t95;
+  W t97 = t86 ^ t96;
+  W t98 = t97 & a1;
+  W t99 = t86 ^ t98;
+  x1 ^= t34;
+  x2 ^= t79;
+  x3 ^= t99;
+  x4 ^= t54;
+}
+
+template <class W>
+BSDES_INLINE void bs_s2(const W &a1, const W &a2, const W &a3, const W &a4,
+                        const W &a5, const W &a6, W &x1, W &x2, W &x3,
+                        W &x4) {
+  W t0 = ~a3;
+  W t1 = t0 | a2;
+  W t2 = t1 ^ a5;
+  W t3 = a2 ^ t1;
+  W t4 = a2 & a5;
+  W t5 = t3 ^ t4;
+  W t6 = t2 ^ t5;
+  W t7 = t6 & a4;
+  W t8 = t2 ^ t7;
+  W t9 = a3 ^ a5;
+  W t10 = a2 ^ t9;
+  W t11 = a2 & a4;
+  W t12 = t9 ^ t11;
+  W t13 = t8 ^ t12;
+  W t14 = t13 & a1;
+  W t15 = t8 ^ t14;
+  W t16 = t7 ^ t10;
+  W t17 = ~a2;
+  W t18 = t0 ^ t17;
+  W t19 = t18 & a5;
+  W t20 = t0 ^ t19;
+  W t21 = t6 ^ t20;
+  W t22 = t20 ^ t7;
+  W t23 = t16 ^ t22;
+  W t24 = t23 & a1;
+  W t25 = t16 ^ t24;
+  W t26 = t15 ^ t25;
+  W t27 = t26 & a6;
+  W t28 = t15 ^ t27;
+  W t29 = a3 ^ t21;
+  W t30 = t29 ^ t10;
+  W t31 = t30 & a4;
+  W t32 = t29 ^ t31;
+  W t33 = t10 & ~t2;
+  W t34 = t3 | t21;
+  W t35 = t33 ^ t34;
+  W t36 = t35 & a4;
+  W t37 = t33 ^ t36;
+  W t38 = t32 ^ t37;
+  W t39 = t38 & a1;
+  W t40 = t32 ^ t39;
+  W t41 = t19 ^ t35;
+  W t42 = t0 ^ t2;
+  W t43 = t41 ^ t42;
+  W t44 = t43 & a4;
+  W t45 = t41 ^ t44;
+  W t46 = t18 ^ t36;
+  W t47 = t45 ^ t46;
+  W t48 = t47 & a1;
+  W t49 = t45 ^ t48;
+  W t50 = t40 ^ t49;
+  W t51 = t50 & a6;
+  W t52 = t40 ^ t51;
+  W t53 = t17 & a4;
+  W t54 = t35 ^ t53;
+  W t55 = t6 & t20;
+  W t56 = t0 ^ t33;
+  W t57 = t55 ^ t56;
+  W t58 = t57 & a4;
+  W t59 = t55 ^ t58;
+  W t60 = t54 ^ t59;
+  W t61 = t60 & a1;
+  W t62 = t54 ^ t61;
+  W t63 = t22 ^ t45;
+  W t64 = t63 ^ a1;
+  W t65 = t62 ^ t64;
+  W t66 = t65 & a6;
+  W t67 = t62 ^ t66;
+  W t68 = t0 | t19;
+  W t69 = t9 & ~t3;
+  W t70 = t68 ^ t69;
+  W t71 = t70 & a4;
+  W t72 = t68 ^ t71;
+  W t73 = t0 ^ t34;
+  W t74 = t73 ^ t71;
+  W t75 = t72 ^ t74;
+  W t76 = t75 & a1;
+  W t77 = t72 ^ t76;
+  W t78 = a5 ^ t29;
+  W t79 = ~t29;
+  W t80 = t78 ^ t79;
+  W t81 = t80 & a4;
+  W t82 = t78 ^ t81;
+  W t83 = t19 ^ t56;
+  W t84 = t83 ^ t53;
+  W t85 = t82 ^ t84;
+  W t86 = t85 & a1;
+  W t87 = t82 ^ t86;
+  W t88 = t77 ^ t87;
+  W t89 = t88 & a6;
+  W t90 = t77 ^ t89;
+  x1 ^= t28;
+  x2 ^= t67;
+  x3 ^= t52;
+  x4 ^= t90;
+}
+
+template <class W>
+BSDES_INLINE void bs_s3(const W &a1, const W &a2, const W &a3, const W &a4,
+                        const W &a5, const W &a6, W &x1, W &x2, W &x3,
+                        W &x4) {
+  W t0 = ~a5;
+  W t1 = t0 | a3;
+  W t2 = a3 & ~a5;
+  W t3 = t1 ^ t2;
+  W t4 = t3 & a2;
+  W t5 = t1 ^ t4;
+  W t6 = ~t3;
+  W t7 = t6 ^ a2;
+  W t8 = t5 ^ t7;
+  W t9 = t8 & a6;
+  W t10 = t5 ^ t9;
+  W t11 = a5 & a2;
+  W t12 = a3 ^ t11;
+  W t13 = t6 ^ t12;
+  W t14 = t13 & a6;
+  W t15 = t6 ^ t14;
+  W t16 = t10 ^ t15;
+  W t17 = t16 & a4;
+  W t18 = t10 ^ t17;
+  W t19 = t4 ^ t13;
+  W t20 = t19 ^ t6;
+  W t21 = t20 & a6;
+  W t22 = t19 ^ t21;
+  W t23 = t2 ^ t4;
+  W t24 = a3 ^ t2;
+  W t25 = t24 ^ a2;
+  W t26 = t23 ^ t25;
+  W t27 = t26 & a6;
+  W t28 = t23 ^ t27;
+  W t29 = t22 ^ t28;
+  W t30 = t29 & a4;
+  W t31 = t22 ^ t30;
+  W t32 = t18 ^ t31;
+  W t33 = t32 & a1;
+  W t34 = t18 ^ t33;
+  W t35 = t26 & ~t13;
+  W t36 = t1 ^ t7;
+  W t37 = t35 ^ t36;
+  W t38 = t37 & a6;
+  W t39 = t35 ^ t38;
+  W t40 = t19 ^ t35;
+  W t41 = t11 ^ t23;
+  W t42 = t40 ^ t41;
+  W t43 = t42 & a6;
+  W t44 = t40 ^ t43;
+  W t45 = t39 ^ t44;
+  W t46 = t45 & a4;
+  W t47 = t39 ^ t46;
+  W t48 = a6 ^ t36;
+  W t49 = a5 ^ t36;
+  W t50 = t25 & a6;
+  W t51 = t49 ^ t50;
+  W t52 = t48 ^ t51;
+  W t53 = t52 & a4;
+  W t54 = t48 ^ t53;
+  W t55 = t47 ^ t54;
+  W t56 = t55 & a1;
+  W t57 = t47 ^ t56;
+  W t58 = a6 ^ t25;
+  W t59 = t0 & a4;
+  W t60 = t58 ^ t59;
+  W t61 = t1 ^ t35;
+  W t62 = t4 & a6;
+  W t63 = t61 ^ t62;
+  W t64 = ~t61;
+  W t65 = t61 & ~t23;
+  W t66 = t64 ^ t65;
+  W t67 = t66 & a6;
+  W t68 = t64 ^ t67;
+  W t69 = t63 ^ t68;
+  W t70 = t69 & a4;
+  W t71 = t63 ^ t70;
+  W t72 = t60 ^ t71;
+  W t73 = t72 & a1;
+  W t74 = t60 ^ t73;
+  W t75 = t49 & t63;
+  W t76 = t1 ^ t42;
+  W t77 = a2 ^ t19;
+  W t78 = t76 ^ t77;
+  W t79 = t78 & a6;
+  W t80 = t76 ^ t79;
+  W t81 = t75 ^ t80;
+  W t82 = t81 & a4;
+  W t83 = t75 ^ t82;
+  W t84 = t13 ^ t76;
+  W t85 = t84 ^ t77;
+  W t86 = t85 & a6;
+  W t87 = t84 ^ t86;
+  W t88 = t87 ^ a4;
+  W t89 = t83 ^ t88;
+  W t90 = t89 & a1;
+  W t91 = t83 ^ t90;
+  x1 ^= t91;
+  x2 ^= t57;
+  x3 ^= t34;
+  x4 ^= t74;
+}
+
+template <class W>
+BSDES_INLINE void bs_s4(const W &a1, const W &a2, const W &a3, const W &a4,
+                        const W &a5, const W &a6, W &x1, W &x2, W &x3,
+                        W &x4) {
+  W t0 = ~a2;
+  W t1 = t0 ^ a5;
+  W t2 = t1 ^ a3;
+  W t3 = t1 & a3;
+  W t4 = t0 ^ t3;
+  W t5 = t2 ^ t4;
+  W t6 = t5 & a4;
+  W t7 = t2 ^ t6;
+  W t8 = t0 | ~a5;
+  W t9 = t8 ^ a5;
+  W t10 = t9 & a3;
+  W t11 = t8 ^ t10;
+  W t12 = a2 ^ t10;
+  W t13 = t11 ^ t12;
+  W t14 = t13 & a4;
+  W t15 = t11 ^ t14;
+  W t16 = t7 ^ t15;
+  W t17 = t16 & a1;
+  W t18 = t7 ^ t17;
+  W t19 = ~t8;
+  W t20 = t0 & a3;
+  W t21 = t19 ^ t20;
+  W t22 = t9 ^ t21;
+  W t23 = t9 & a4;
+  W t24 = t21 ^ t23;
+  W t25 = t4 ^ t20;
+  W t26 = t25 ^ t5;
+  W t27 = t26 & a4;
+  W t28 = t25 ^ t27;
+  W t29 = t24 ^ t28;
+  W t30 = t29 & a1;
+  W t31 = t24 ^ t30;
+  W t32 = t18 ^ t31;
+  W t33 = t32 & a6;
+  W t34 = t18 ^ t33;
+  W t35 = t11 ^ t22;
+  W t36 = t8 & a4;
+  W t37 = t35 ^ t36;
+  W t38 = ~t5;
+  W t39 = t38 ^ t2;
+  W t40 = t39 & a4;
+  W t41 = t38 ^ t40;
+  W t42 = t37 ^ t41;
+  W t43 = t42 & a1;
+  W t44 = t37 ^ t43;
+  W t45 = t3 ^ t26;
+  W t46 = t4 ^ t45;
+  W t47 = t46 & a4;
+  W t48 = t4 ^ t47;
+  W t49 = t0 ^ t22;
+  W t50 = t49 ^ t21;
+  W t51 = t50 & a4;
+  W t52 = t49 ^ t51;
+  W t53 = t48 ^ t52;
+  W t54 = t53 & a1;
+  W t55 = t48 ^ t54;
+  W t56 = t44 ^ t55;
+  W t57 = t56 & a6;
+  W t58 = t44 ^ t57;
+  W t59 = ~t44;
+  W t60 = t55 ^ t59;
+  W t61 = t60 & a6;
+  W t62 = t55 ^ t61;
+  W t63 = ~t31;
+  W t64 = t63 ^ t18;
+  W t65 = t64 & a6;
+  W t66 = t63 ^ t65;
+  x1 ^= t58;
+  x2 ^= t62;
+  x3 ^= t34;
+  x4 ^= t66;
+}
+
+template <class W>
+BSDES_INLINE void bs_s5(const W &a1, const W &a2, const W &a3, const W &a4,
+                        const W &a5, const W &a6, W &x1, W &x2, W &x3,
+                        W &x4) {
+  W t0 = a2 & a5;
+  W t1 = t0 ^ a2;
+  W t2 = t1 & a1;
+  W t3 = t0 ^ t2;
+  W t4 = ~a5;
+  W t5 = t4 ^ a1;
+  W t6 = t3 ^ t5;
+  W t7 = t6 & a3;
+  W t8 = t3 ^ t7;
+  W t9 = a2 ^ a5;
+  W t10 = t9 ^ a1;
+  W t11 = t0 ^ t10;
+  W t12 = t0 & a3;
+  W t13 = t10 ^ t12;
+  W t14 = t8 ^ t13;
+  W t15 = t14 & a6;
+  W t16 = t8 ^ t15;
+  W t17 = a5 | t10;
+  W t18 = ~t9;
+  W t19 = t0 & a1;
+  W t20 = t18 ^ t19;
+  W t21 = t17 ^ t20;
+  W t22 = t21 & a3;
+  W t23 = t17 ^ t22;
+  W t24 = t5 & t17;
+  W t25 = t1 ^ t21;
+  W t26 = t24 ^ t25;
+  W t27 = t26 & a3;
+  W t28 = t24 ^ t27;
+  W t29 = t23 ^ t28;
+  W t30 = t29 & a6;
+  W t31 = t23 ^ t30;
+  W t32 = t16 ^ t31;
+  W t33 = t32 & a4;
+  W t34 = t16 ^ t33;
+  W t35 = t6 & ~t11;
+  W t36 = t6 ^ t17;
+  W t37 = t35 ^ t36;
+  W t38 = t37 & a3;
+  W t39 = t35 ^ t38;
+  W t40 = t36 ^ t9;
+  W t41 = t40 & a3;
+  W t42 = t36 ^ t41;
+  W t43 = t39 ^ t42;
+  W t44 = t43 & a6;
+  W t45 = t39 ^ t44;
+  W t46 = ~t36;
+  W t47 = t1 ^ t36;
+  W t48 = t46 ^ t47;
+  W t49 = t48 & a3;
+  W t50 = t46 ^ t49;
+  W t51 = t0 ^ t5;
+  W t52 = t51 ^ t41;
+  W t53 = t50 ^ t52;
+  W t54 = t53 & a6;
+  W t55 = t50 ^ t54;
+  W t56 = t45 ^ t55;
+  W t57 = t56 & a4;
+  W t58 = t45 ^ t57;
+  W t59 = t21 ^ t35;
+  W t60 = a1 ^ t59;
+  W t61 = a1 & a3;
+  W t62 = t59 ^ t61;
+  W t63 = a5 ^ t20;
+  W t64 = ~t47;
+  W t65 = t63 ^ t64;
+  W t66 = t65 & a3;
+  W t67 = t63 ^ t66;
+  W t68 = t62 ^ t67;
+  W t69 = t68 & a6;
+  W t70 = t62 ^ t69;
+  W t71 = a2 ^ t35;
+  W t72 = t64 ^ t71;
+  W t73 = t72 & a3;
+  W t74 = t64 ^ t73;
+  W t75 = t37 ^ t50;
+  W t76 = t74 ^ t75;
+  W t77 = t76 & a6;
+  W t78 = t74 ^ t77;
+  W t79 = t70 ^ t78;
+  W t80 = t79 & a4;
+  W t81 = t70 ^ t80;
+  W t82 = ~t5;
+  W t83 = t3 ^ t71;
+  W t84 = t82 ^ t83;
+  W t85 = t84 & a3;
+  W t86 = t82 ^ t85;
+  W t87 = t9 & a3;
+  W t88 = t72 ^ t87;
+  W t89 = t86 ^ t88;
+  W t90 = t89 & a6;
+  W t91 = t86 ^ t90;
+  W t92 = ~t60;
+  W t93 = t92 ^ t10;
+  W t94 = t93 & a3;
+  W t95 = t92 ^ t94;
+  W t96 = t95 ^ a6;
+  W t97 = t91 ^ t96;
+  W t98 = t97 & a4;
+  W t99 = t91 ^ t98;
+  x1 ^= t81;
+  x2 ^= t99;
+  x3 ^= t58;
+  x4 ^= t34;
+}
+
+template <class W>
+BSDES_INLINE void bs_s6(const W &a1, const W &a2, const W &a3, const W &a4,
+                        const W &a5, const W &a6, W &x1, W &x2, W &x3,
+                        W &x4) {
+  W t0 = ~a5;
+  W t1 = t0 ^ a2;
+  W t2 = ~a2;
+  W t3 = a5 & a6;
+  W t4 = t1 ^ t3;
+  W t5 = a6 ^ t0;
+  W t6 = t4 ^ t5;
+  W t7 = t6 & a3;
+  W t8 = t4 ^ t7;
+  W t9 = a6 ^ t2;
+  W t10 = t2 & a6;
+  W t11 = a5 ^ t10;
+  W t12 = t9 ^ t11;
+  W t13 = t12 & a3;
+  W t14 = t9 ^ t13;
+  W t15 = t8 ^ t14;
+  W t16 = t15 & a4;
+  W t17 = t8 ^ t16;
+  W t18 = t11 & ~t3;
+  W t19 = t9 ^ t18;
+  W t20 = t19 & a3;
+  W t21 = t9 ^ t20;
+  W t22 = a6 ^ t19;
+  W t23 = a2 ^ t4;
+  W t24 = t22 ^ t23;
+  W t25 = t24 & a3;
+  W t26 = t22 ^ t25;
+  W t27 = t21 ^ t26;
+  W t28 = t27 & a4;
+  W t29 = t21 ^ t28;
+  W t30 = t17 ^ t29;
+  W t31 = t30 & a1;
+  W t32 = t17 ^ t31;
+  W t33 = t2 & a3;
+  W t34 = a5 ^ t33;
+  W t35 = t11 ^ t24;
+  W t36 = t0 ^ t22;
+  W t37 = t35 ^ t36;
+  W t38 = t37 & a3;
+  W t39 = t35 ^ t38;
+  W t40 = t34 ^ t39;
+  W t41 = t40 & a4;
+  W t42 = t34 ^ t41;
+  W t43 = ~t11;
+  W t44 = ~t9;
+  W t45 = t43 ^ t13;
+  W t46 = a5 ^ t44;
+  W t47 = t0 & a3;
+  W t48 = t9 ^ t47;
+  W t49 = t45 ^ t48;
+  W t50 = t49 & a4;
+  W t51 = t45 ^ t50;
+  W t52 = t42 ^ t51;
+  W t53 = t52 & a1;
+  W t54 = t42 ^ t53;
+  W t55 = a5 ^ t48;
+  W t56 = t6 ^ t35;
+  W t57 = t56 ^ a3;
+  W t58 = t55 ^ t57;
+  W t59 = t58 & a4;
+  W t60 = t55 ^ t59;
+  W t61 = t36 & ~t46;
+  W t62 = t46 ^ t61;
+  W t63 = t62 & a3;
+  W t64 = t46 ^ t63;
+  W t65 = t12 ^ t62;
+  W t66 = t65 ^ t1;
+  W t67 = t66 & a3;
+  W t68 = t65 ^ t67;
+  W t69 = t64 ^ t68;
+  W t70 = t69 & a4;
+  W t71 = t64 ^ t70;
+  W t72 = t60 ^ t71;
+  W t73 = t72 & a1;
+  W t74 = t60 ^ t73;
+  W t75 = a5 ^ t56;
+  W t76 = t3 ^ t66;
+  W t77 = t75 ^ t76;
+  W t78 = t77 & a3;
+  W t79 = t75 ^ t78;
+  W t80 = t65 ^ t78;
+  W t81 = t79 ^ t80;
+  W t82 = t81 & a4;
+  W t83 = t79 ^ t82;
+  W t84 = t3 ^ t35;
+  W t85 = t65 & a3;
+  W t86 = t84 ^ t85;
+  W t87 = t1 ^ t85;
+  W t88 = t86 ^ t87;
+  W t89 = t88 & a4;
+  W t90 = t86 ^ t89;
+  W t91 = t83 ^ t90;
+  W t92 = t91 & a1;
+  W t93 = t83 ^ t92;
+  x1 ^= t32;
+  x2 ^= t74;
+  x3 ^= t93;
+  x4 ^= t54;
+}
+
+template <class W>
+BSDES_INLINE void bs_s7(const W &a1, const W &a2, const W &a3, const W &a4,
+                        const W &a5, const W &a6, W &x1, W &x2, W &x3,
+                        W &x4) {
+  W t0 = ~a4;
+  W t1 = t0 ^ a5;
+  W t2 = t0 & a2;
+  W t3 = t1 ^ t2;
+  W t4 = a2 ^ t3;
+  W t5 = a2 & a3;
+  W t6 = t3 ^ t5;
+  W t7 = t0 ^ t4;
+  W t8 = a4 | t1;
+  W t9 = t8 ^ a2;
+  W t10 = t7 ^ t9;
+  W t11 = t10 & a3;
+  W t12 = t7 ^ t11;
+  W t13 = t6 ^ t12;
+  W t14 = t13 & a1;
+  W t15 = t6 ^ t14;
+  W t16 = t1 | t4;
+  W t17 = a4 ^ t8;
+  W t18 = t17 ^ a5;
+  W t19 = t18 & a2;
+  W t20 = t17 ^ t19;
+  W t21 = t16 ^ t20;
+  W t22 = t21 & a3;
+  W t23 = t16 ^ t22;
+  W t24 = t8 ^ t21;
+  W t25 = a2 ^ t7;
+  W t26 = t24 ^ t25;
+  W t27 = t26 & a3;
+  W t28 = t24 ^ t27;
+  W t29 = t23 ^ t28;
+  W t30 = t29 & a1;
+  W t31 = t23 ^ t30;
+  W t32 = t15 ^ t31;
+  W t33 = t32 & a6;
+  W t34 = t15 ^ t33;
+  W t35 = t10 ^ t16;
+  W t36 = t35 ^ a3;
+  W t37 = t0 ^ t10;
+  W t38 = t35 & ~t2;
+  W t39 = t37 ^ t38;
+  W t40 = t39 & a3;
+  W t41 = t37 ^ t40;
+  W t42 = t36 ^ t41;
+  W t43 = t42 & a1;
+  W t44 = t36 ^ t43;
+  W t45 = a2 ^ a4;
+  W t46 = ~t10;
+  W t47 = t45 ^ t46;
+  W t48 = t47 & a3;
+  W t49 = t45 ^ t48;
+  W t50 = t0 ^ t19;
+  W t51 = t50 ^ a3;
+  W t52 = t49 ^ t51;
+  W t53 = t52 & a1;
+  W t54 = t49 ^ t53;
+  W t55 = t44 ^ t54;
+  W t56 = t55 & a6;
+  W t57 = t44 ^ t56;
+  W t58 = t26 ^ t50;
+  W t59 = t4 & ~t2;
+  W t60 = t58 ^ t59;
+  W t61 = t60 & a3;
+  W t62 = t58 ^ t61;
+  W t63 = t12 ^ t62;
+  W t64 = t63 & a1;
+  W t65 = t12 ^ t64;
+  W t66 = ~t7;
+  W t67 = t66 ^ a3;
+  W t68 = t36 ^ t61;
+  W t69 = t67 ^ t68;
+  W t70 = t69 & a1;
+  W t71 = t67 ^ t70;
+  W t72 = t65 ^ t71;
+  W t73 = t72 & a6;
+  W t74 = t65 ^ t73;
+  W t75 = ~t9;
+  W t76 = t75 ^ t1;
+  W t77 = t76 & a3;
+  W t78 = t75 ^ t77;
+  W t79 = t78 ^ a1;
+  W t80 = a4 ^ t20;
+  W t81 = t80 ^ t77;
+  W t82 = ~t59;
+  W t83 = t82 ^ a3;
+  W t84 = t81 ^ t83;
+  W t85 = t84 & a1;
+  W t86 = t81 ^ t85;
+  W t87 = t79 ^ t86;
+  W t88 = t87 & a6;
+  W t89 = t79 ^ t88;
+  x1 ^= t74;
+  x2 ^= t34;
+  x3 ^= t57;
+  x4 ^= t89;
+}
+
+template <class W>
+BSDES_INLINE void bs_s8(const W &a1, const W &a2, const W &a3, const W &a4,
+                        const W &a5, const W &a6, W &x1, W &x2, W &x3,
+                        W &x4) {
+  W t0 = ~a5;
+  W t1 = t0 | a2;
+  W t2 = t1 ^ a3;
+  W t3 = a2 ^ t0;
+  W t4 = a2 & a3;
+  W t5 = t3 ^ t4;
+  W t6 = t2 ^ t5;
+  W t7 = t6 & a4;
+  W t8 = t2 ^ t7;
+  W t9 = ~t1;
+  W t10 = t0 & a3;
+  W t11 = t9 ^ t10;
+  W t12 = a2 ^ t10;
+  W t13 = t11 ^ t12;
+  W t14 = t13 & a4;
+  W t15 = t11 ^ t14;
+  W t16 = t8 ^ t15;
+  W t17 = t16 & a1;
+  W t18 = t8 ^ t17;
+  W t19 = ~t3;
+  W t20 = t19 ^ a3;
+  W t21 = t1 ^ t20;
+  W t22 = t1 & a4;
+  W t23 = t20 ^ t22;
+  W t24 = t2 & t13;
+  W t25 = t3 & a4;
+  W t26 = t24 ^ t25;
+  W t27 = t23 ^ t26;
+  W t28 = t27 & a1;
+  W t29 = t23 ^ t28;
+  W t30 = t18 ^ t29;
+  W t31 = t30 & a6;
+  W t32 = t18 ^ t31;
+  W t33 = a5 ^ t12;
+  W t34 = a5 & a4;
+  W t35 = t33 ^ t34;
+  W t36 = t4 | t21;
+  W t37 = t36 ^ a4;
+  W t38 = t35 ^ t37;
+  W t39 = t38 & a1;
+  W t40 = t35 ^ t39;
+  W t41 = t4 ^ t11;
+  W t42 = t41 ^ t12;
+  W t43 = t42 & a4;
+  W t44 = t41 ^ t43;
+  W t45 = t21 ^ t42;
+  W t46 = t0 ^ t20;
+  W t47 = t45 ^ t46;
+  W t48 = t47 & a4;
+  W t49 = t45 ^ t48;
+  W t50 = t44 ^ t49;
+  W t51 = t50 & a1;
+  W t52 = t44 ^ t51;
+  W t53 = t40 ^ t52;
+  W t54 = t53 & a6;
+  W t55 = t40 ^ t54;
+  W t56 = t27 ^ t37;
+  W t57 = t16 ^ t35;
+  W t58 = t56 ^ t57;
+  W t59 = t58 & a1;
+  W t60 = t56 ^ t59;
+  W t61 = ~t56;
+  W t62 = a4 ^ t12;
+  W t63 = t61 ^ t62;
+  W t64 = t63 & a1;
+  W t65 = t61 ^ t64;
+  W t66 = t60 ^ t65;
+  W t67 = t66 & a6;
+  W t68 = t60 ^ t67;
+  W t69 = ~t29;
+  W t70 = t3 ^ t41;
+  W t71 = t11 & a4;
+  W t72 = t70 ^ t71;
+  W t73 = a3 ^ t33;
+  W t74 = t73 ^ t47;
+  W t75 = t74 & a4;
+  W t76 = t73 ^ t75;
+  W t77 = t72 ^ t76;
+  W t78 = t77 & a1;
+  W t79 = t72 ^ t78;
+  W t80 = t69 ^ t79;
+  W t81 = t80 & a6;
+  W t82 = t69 ^ t81;
+  x1 ^= t32;
+  x2 ^= t68;
+  x3 ^= t55;
+  x4 ^= t82;
+}
+
+// the position of each S-box output bit after P
+struct bs_p_table {
+  int pos[32];
+};
+
+constexpr bs_p_table make_p_table() {
+  bs_p_table t = {};
+  for (int i = 0; i < 32; i++) {
+    t.pos[p[i] - 1] = i;
+  }
+  return t;
+}
+
+constexpr bs_p_table p_table = make_p_table();
+
+// l ^= f(r, k), k holds the 48 bits of the subkey
+// K is a mask of all ones or zeros when all blocks share the key, or W for a
+// key per block
+template <class W, class K>
+BSDES_INLINE void bs_round(W l[32], const W r[32], const K k[48]) {
+  // expansion and key
+  W a[48];
+  for (int i = 0; i < 48; i++) {
+    a[i] = r[e[i] - 1] ^ k[i];
+  }
+
+  // S-boxes and P
+  const int *pos = p_table.pos;
+  bs_s1(a[0], a[1], a[2], a[3], a[4], a[5], l[pos[0]], l[pos[1]], l[pos[2]],
+        l[pos[3]]);
+  bs_s2(a[6], a[7], a[8], a[9], a[10], a[11], l[pos[4]], l[pos[5]], l[pos[6]],
+        l[pos[7]]);
+  bs_s3(a[12], a[13], a[14], a[15], a[16], a[17], l[pos[8]], l[pos[9]],
+        l[pos[10]], l[pos[11]]);
+  bs_s4(a[18], a[19], a[20], a[21], a[22], a[23], l[pos[12]], l[pos[13]],
+        l[pos[14]], l[pos[15]]);
+  bs_s5(a[24], a[25], a[26], a[27], a[28], a[29], l[pos[16]], l[pos[17]],
+        l[pos[18]], l[pos[19]]);
+  bs_s6(a[30], a[31], a[32], a[33], a[34], a[35], l[pos[20]], l[pos[21]],
+        l[pos[22]], l[pos[23]]);
+  bs_s7(a[36], a[37], a[38], a[39], a[40], a[41], l[pos[24]], l[pos[25]],
+        l[pos[26]], l[pos[27]]);
+  bs_s8(a[42], a[43], a[44], a[45], a[46], a[47], l[pos[28]], l[pos[29]],
+        l[pos[30]], l[pos[31]]);
+}
+
+// passes DES passes on a bitsliced state, d[i] holds bit i + 1 of the blocks
+// k holds 48 words for each of the 16 rounds of each pass
+template <class W, class K>
+BSDES_INLINE void bs_des(W d[64], const K *k, int passes) {
+  // IP
+  W l[32], r[32];
+  for (int i = 0; i < 32; i++) {
+    l[i] = d[ip[i] - 1];
+    r[i] = d[ip[i + 32] - 1];
+  }
+
+  // the halves take turns instead of being swapped after each round
+  W *x = l, *y = r;
+  for (int pass = 0; pass < passes; pass++) {
+    for (int round = 0; round < 16; round += 2) {
+      bs_round(x, y, &k[(pass * 16 + round) * 48]);
+      bs_round(y, x, &k[(pass * 16 + round + 1) * 48]);
+    }
+    // R16 L16 is the input of the next pass, IP^-1 and IP cancel out
+    W *t = x;
+    x = y;
+    y = t;
+  }
+
+  // IP^-1 of R16 L16
+  for (int i = 0; i < 64; i++) {
+    int bit = ip1[i] - 1;
+    d[i] = bit < 32 ? x[bit] : y[bit - 32];
+  }
+}
+
+// run the cipher on one batch of 64 * LANES blocks
+template <class W, class K>
+BSDES_INLINE void bs_crypt_batch(const K *k, int passes, const uint8_t *input,
+                                 uint8_t *output) {
+  const int lanes = sizeof(W) / sizeof(uint64_t);
+
+  // block i of lane j as a big endian number in word i
+  uint64_t x[64 * lanes];
+  for (int lane = 0; lane < lanes; lane++) {
+    for (int i = 0; i < 64; i++) {
+      const uint8_t *block = &input[(lane * 64 + i) * 8];
+      x[i * lanes + lane] =
+          ((uint64_t)load_be32(&block[0]) << 32) | load_be32(&block[4]);
+    }
+  }
+  W q[64];
+  memcpy(q, x, sizeof(q));
+
+  // now word 63 - i holds bit i + 1 of each block
+  bs_transpose(q);
+  W d[64];
+  for (int i = 0; i < 64; i++) {
+    d[i] = q[63 - i];
+  }
+  bs_des(d, k, passes);
+  for (int i = 0; i < 64; i++) {
+    q[63 - i] = d[i];
+  }
+  bs_transpose(q);
+
+  memcpy(x, q, sizeof(q));
+  for (int lane = 0; lane < lanes; lane++) {
+    for (int i = 0; i < 64; i++) {
+      uint8_t *block = &output[(lane * 64 + i) * 8];
+      store_be32(&block[0], x[i * lanes + lane] >> 32);
+      store_be32(&block[4], x[i * lanes + lane]);
+    }
+  }
+}
+
+// run the cipher on batches of 64 * LANES blocks
+// a partial batch is padded with zeros, the work is the same
+template <class W>
+BSDES_INLINE void bs_crypt_blocks(const uint64_t *k, int passes,
+                                  const uint8_t *input, uint8_t *output,
+                                  size_t blocks) {
+  const int lanes = sizeof(W) / sizeof(uint64_t);
+  const size_t batch = lanes * 64;
+
+  for (size_t block = 0; block < blocks; block += batch) {
+    size_t count = blocks - block < batch ? blocks - block : batch;
+    if (count < batch) {
+      uint8_t buffer[batch * 8] = {0};
+      memcpy(buffer, &input[block * 8], count * 8);
+      bs_crypt_batch<W>(k, passes, buffer, buffer);
+      memcpy(&output[block * 8], buffer, count * 8);
+    } else {
+      bs_crypt_batch<W>(k, passes, &input[block * 8], &output[block * 8]);
+    }
+  }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+// 256 blocks in AVX2 registers, callers check cpu_has_avx2() first
+__attribute__((target("avx2"))) void
+bsdes_crypt_blocks_avx2(const uint64_t *k, int passes, const uint8_t *input,
+                        uint8_t *output, size_t blocks) {
+  bs_crypt_blocks<u64x4>(k, passes, input, output, blocks);
+}
+#endif
+
+void bsdes_crypt_blocks(const uint64_t *const subkeys[], int passes,
+                        const uint8_t *input, uint8_t *output, size_t blocks) {
+  assert(passes <= 3);
+
+  // each subkey bit as a mask of all ones or zeros, bit i of a subkey is
+  // bit i + 1 of the standard
+  uint64_t k[3 * 16 * 48];
+  for (int pass = 0; pass < passes; pass++) {
+    for (int round = 0; round < 16; round++) {
+      for (int i = 0; i < 48; i++) {
+        k[(pass * 16 + round) * 48 + i] =
+            0 - ((subkeys[pass][round] >> i) & 1);
+      }
+    }
+  }
+
+  size_t block = 0;
+#if defined(__x86_64__) || defined(__i386__)
+  // full batches of 256 blocks, the rest 64 at a time
+  if (blocks >= 256 && cpu_has_avx2()) {
+    block = blocks - blocks % 256;
+    bsdes_crypt_blocks_avx2(k, passes, input, output, block);
+  }
+#endif
+  bs_crypt_blocks<uint64_t>(k, passes, &input[block * 8], &output[block * 8],
+                            blocks - block);
+}
+
+// key search: one key per block instead of one block per key
+// the plain text is the same in all blocks, and each bit of a subkey is a bit
+// of the key, so the subkey words are copies of the 56 key words
+
+// the key bit(from 0) of each subkey bit, from PC1, the shifts and PC2
+struct bs_key_table {
+  int bit[16][48];
+};
+
+constexpr bs_key_table make_key_table() {
+  bs_key_table t = {};
+  // the key bit in each bit of C and D, in the order of des_init
+  int cd[56] = {};
+  for (int i = 0; i < 56; i++) {
+    cd[i] = pc1[i] - 1;
+  }
+  for (int round = 0; round < 16; round++) {
+    // rotate once in rounds 1, 2, 9, 16, twice in the others
+    int shifts =
+        (round == 0 || round == 1 || round == 8 || round == 15) ? 1 : 2;
+    for (int shift = 0; shift < shifts; shift++) {
+      for (int half = 0; half < 56; half += 28) {
+        int first = cd[half];
+        for (int i = 0; i < 27; i++) {
+          cd[half + i] = cd[half + i + 1];
+        }
+        cd[half + 27] = first;
+      }
+    }
+    for (int i = 0; i < 48; i++) {
+      t.bit[round][i] = cd[pc2[i] - 1];
+    }
+  }
+  return t;
+}
+
+constexpr bs_key_table key_table = make_key_table();
+
+// the 64 bits of a block as all ones or zeros, bit i + 1 of block in word i
+template <class W> BSDES_INLINE void bs_broadcast(W d[64], uint64_t block) {
+  for (int i = 0; i < 64; i++) {
+    d[i] = W{} + (0 - ((block >> (63 - i)) & 1));
+  }
+}
+
+// try the keys of one search, see bsdes_key_search
+// the lowest bits of the key index go to lanes, the others are walked in Gray
+// code order: the next key differs in a single bit, which appears in at most
+// 16 subkey words, so only those are updated between batches
+template <class W>
+BSDES_INLINE size_t bs_key_search(uint64_t plain, uint64_t cipher,
+                                  uint64_t key, const int *bits, int count,
+                                  uint64_t *found, size_t max_found) {
+  const int lanes = sizeof(W) / sizeof(uint64_t);
+  const int lane_bits = lanes == 1 ? 6 : 8;
+  int inner = count < lane_bits ? count : lane_bits;
+  int outer = count - inner;
+
+  // each key bit as a word, the inner bits count up across the lanes
+  uint64_t key_bits[64 * lanes];
+  for (int i = 0; i < 64; i++) {
+    for (int lane = 0; lane < lanes; lane++) {
+      key_bits[i * lanes + lane] = 0 - ((key >> (63 - i)) & 1);
+    }
+  }
+  const uint64_t patterns[6] = {0xAAAAAAAAAAAAAAAAULL, 0xCCCCCCCCCCCCCCCCULL,
+                                0xF0F0F0F0F0F0F0F0ULL, 0xFF00FF00FF00FF00ULL,
+                                0xFFFF0000FFFF0000ULL, 0xFFFFFFFF00000000ULL};
+  for (int i = 0; i < inner; i++) {
+    for (int lane = 0; lane < lanes; lane++) {
+      key_bits[bits[i] * lanes + lane] ^=
+          i < 6 ? patterns[i] : 0 - (uint64_t)((lane >> (i - 6)) & 1);
+    }
+  }
+  W key_words[64];
+  memcpy(key_words, key_bits, sizeof(key_words));
+
+  W k[16 * 48];
+  for (int round = 0; round < 16; round++) {
+    for (int i = 0; i < 48; i++) {
+      k[round * 48 + i] = key_words[key_table.bit[round][i]];
+    }
+  }
+
+  // the subkey words of each outer bit
+  int uses[56][16];
+  int uses_count[56] = {0};
+  for (int i = 0; i < outer; i++) {
+    for (int j = 0; j < 16 * 48; j++) {
+      if (key_table.bit[j / 48][j % 48] == bits[inner + i]) {
+        uses[i][uses_count[i]++] = j;
+      }
+    }
+  }
+
+  W d0[64];
+  W c[64];
+  bs_broadcast(d0, plain);
+  bs_broadcast(c, cipher);
+
+  size_t num_found = 0;
+  for (uint64_t step = 0; step >> outer == 0; step++) {
+    if (step > 0) {
+      // Gray code: step ^ (step >> 1) flips bit ctz(step)
+      int bit = __builtin_ctzll(step);
+      for (int i = 0; i < uses_count[bit]; i++) {
+        k[uses[bit][i]] = ~k[uses[bit][i]];
+      }
+    }
+
+    W d[64];
+    memcpy(d, d0, sizeof(d));
+    bs_des(d, k, 1);
+
+    // a lane is a match if all bits agree
+    W diff = d[0] ^ c[0];
+    for (int i = 1; i < 64; i++) {
+      diff |= d[i] ^ c[i];
+    }
+    uint64_t mismatch[lanes];
+    memcpy(mismatch, &diff, sizeof(mismatch));
+    for (int lane = 0; lane < lanes; lane++) {
+      // lanes past 2^inner repeat keys
+      for (int b = 0; b < 64 && (lane * 64 + b) >> inner == 0; b++) {
+        if ((mismatch[lane] >> b) & 1) {
+          continue;
+        }
+        uint64_t index = (uint64_t)(lane * 64 + b) |
+                         ((step ^ (step >> 1)) << inner);
+        uint64_t candidate = key;
+        for (int i = 0; i < count; i++) {
+          candidate ^= ((index >> i) & 1) << (63 - bits[i]);
+        }
+        if (num_found < max_found) {
+          found[num_found] = candidate;
+        }
+        num_found++;
+      }
+    }
+  }
+  return num_found;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+// 256 keys in AVX2 registers, callers check cpu_has_avx2() first
+__attribute__((target("avx2"))) size_t
+bsdes_key_search_avx2(uint64_t plain, uint64_t cipher, uint64_t key,
+                      const int *bits, int count, uint64_t *found,
+                      size_t max_found) {
+  return bs_key_search<u64x4>(plain, cipher, key, bits, count, found,
+                              max_found);
+}
+#endif
+
+size_t bsdes_key_search(uint64_t plain, uint64_t cipher, uint64_t key,
+                        const int *bits, int count, uint64_t *found,
+                        size_t max_found) {
+#if defined(__x86_64__) || defined(__i386__)
+  // 256 keys only pay off with enough keys
+  if (count >= 8 && cpu_has_avx2()) {
+    return bsdes_key_search_avx2(plain, cipher, key, bits, count, found,
+                                 max_found);
+  }
+#endif
+  return bs_key_search<uint64_t>(plain, cipher, key, bits, count, found,
+                                 max_found);
+}
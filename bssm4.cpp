@@ -0,0 +1,346 @@
+#include "bitslice.h"
+#include "sm4.h"
+#include "util.h"
+#include <cassert>
+#include <cstring>
+
+// reference:
+// https://eprint.iacr.org/2009/191.pdf
+// https://eprint.iacr.org/2018/301.pdf
+
+// bitsliced SM4
+// no table lookups indexed by secret data, so it runs in constant time
+//
+// a state of 128 words holds 64 blocks per 64-bit lane, 32 words for each of
+// X_i to X_{i+3}, word j of them holds bit j of every block
+// lane j of a word belongs to blocks 64 j .. 64 j + 63
+// the rotations of L only rename words, only the S-boxes and xors compute
+// 1 lane: 64 blocks, AVX2: 4 lanes = 256 blocks
+
+#define BSSM4_INLINE inline __attribute__((always_inline))
+
+// S-box as boolean circuit, q[i] is bit i of the byte
+// the SM4 S-box is affine equivalent to the AES one(see sm4ni.cpp), so the
+// non-linear section is the one of Boyar and Peralta(see bsaes.cpp), with
+// the linear transformations around it composed with the affine maps
+// the constant of the affine map on the input is not in the circuit, it is
+// xored into the round keys instead: the circuit computes sbox(x ^ 0x75)
+// 138 gates and 5 NOTs
+template <class W> BSSM4_INLINE void bssm4_sbox(W q[8]) {
+  W x0, x1, x2, x3, x4, x5, x6, x7;
+  W p0, p1, p2, p3, p4, p5, p6, p7, p8, p9;
+  W y0, y1, y2, y3, y4, y5, y6, y7, y8, y9;
+  W y10, y11, y12, y13, y14, y15, y16, y17, y18, y19;
+  W y20, y21;
+  W t2, t3, t4, t5, t6, t7, t8, t9, t10, t11;
+  W t12, t13, t14, t15, t16, t17, t18, t19, t20, t21;
+  W t22, t23, t24, t25, t26, t27, t28, t29, t30, t31;
+  W t32, t33, t34, t35, t36, t37, t38, t39, t40, t41;
+  W t42, t43, t44, t45;
+  W z0, z1, z2, z3, z4, z5, z6, z7, z8, z9;
+  W z10, z11, z12, z13, z14, z15, z16, z17;
+  W r0, r1, r2, r3, r4, r5, r6, r7, r8, r9;
+  W r10, r11, r12, r13, r14, r15, r16, r17, r18, r19;
+  W r20, r21, r22, r23, r24, r25, r26, r27, r28, r29;
+  W r30, r31;
+  W s0, s1, s2, s3, s4, s5, s6, s7;
+
+  x0 = q[0];
+  x1 = q[1];
+  x2 = q[2];
+  x3 = q[3];
+  x4 = q[4];
+  x5 = q[5];
+  x6 = q[6];
+  x7 = q[7];
+
+  // top linear transformation
+  y12 = x1 ^ x4;
+  y4 = x2 ^ x5;
+  p0 = x0 ^ x6;
+  p1 = x3 ^ x7;
+  p2 = x1 ^ p0;
+  p3 = x2 ^ x6;
+  y6 = y12 ^ p1;
+  p4 = x4 ^ y4;
+  p5 = x5 ^ y6;
+  p6 = x7 ^ y12;
+  y3 = y12 ^ y4;
+  y21 = x0 ^ p5;
+  y18 = x0 ^ p6;
+  p7 = x1 ^ p1;
+  y19 = x2 ^ x7;
+  y5 = x2 ^ y12;
+  y9 = x2 ^ p2;
+  y17 = x3 ^ x4;
+  y0 = x3 ^ p3;
+  y1 = x3 ^ y3;
+  p8 = x4 ^ x5;
+  y2 = x5 ^ p2;
+  p9 = x6 ^ x7;
+  y10 = x7 ^ y4;
+  y14 = y4 ^ p2;
+  y13 = p0 ^ p4;
+  y20 = p0 ^ p5;
+  y11 = p1 ^ p4;
+  y15 = p3 ^ p6;
+  y16 = p3 ^ p7;
+  y7 = p8 ^ p9;
+  y8 = x5;
+
+  // non-linear section
+  t2 = y12 & y15;
+  t3 = y3 & y6;
+  t4 = t3 ^ t2;
+  t5 = y4 & y0;
+  t6 = t5 ^ t2;
+  t7 = y13 & y16;
+  t8 = y5 & y1;
+  t9 = t8 ^ t7;
+  t10 = y2 & y7;
+  t11 = t10 ^ t7;
+  t12 = y9 & y11;
+  t13 = y14 & y17;
+  t14 = t13 ^ t12;
+  t15 = y8 & y10;
+  t16 = t15 ^ t12;
+  t17 = t4 ^ t14;
+  t18 = t6 ^ t16;
+  t19 = t9 ^ t14;
+  t20 = t11 ^ t16;
+  t21 = t17 ^ y20;
+  t22 = t18 ^ y19;
+  t23 = t19 ^ y21;
+  t24 = t20 ^ y18;
+  t25 = t21 ^ t22;
+  t26 = t21 & t23;
+  t27 = t24 ^ t26;
+  t28 = t25 & t27;
+  t29 = t28 ^ t22;
+  t30 = t23 ^ t24;
+  t31 = t22 ^ t26;
+  t32 = t31 & t30;
+  t33 = t32 ^ t24;
+  t34 = t23 ^ t33;
+  t35 = t27 ^ t33;
+  t36 = t24 & t35;
+  t37 = t36 ^ t34;
+  t38 = t27 ^ t36;
+  t39 = t29 & t38;
+  t40 = t25 ^ t39;
+  t41 = t40 ^ t37;
+  t42 = t29 ^ t33;
+  t43 = t29 ^ t40;
+  t44 = t33 ^ t37;
+  t45 = t42 ^ t41;
+  z0 = t44 & y15;
+  z1 = t37 & y6;
+  z2 = t33 & y0;
+  z3 = t43 & y16;
+  z4 = t40 & y1;
+  z5 = t29 & y7;
+  z6 = t42 & y11;
+  z7 = t45 & y17;
+  z8 = t41 & y10;
+  z9 = t44 & y12;
+  z10 = t37 & y3;
+  z11 = t33 & y4;
+  z12 = t43 & y13;
+  z13 = t40 & y5;
+  z14 = t29 & y2;
+  z15 = t42 & y9;
+  z16 = t45 & y14;
+  z17 = t41 & y8;
+
+  // bottom linear transformation
+  r0 = z0 ^ z4;
+  r1 = z11 ^ z14;
+  r2 = z1 ^ z9;
+  r3 = z2 ^ z7;
+  r4 = z3 ^ z8;
+  r5 = z10 ^ z15;
+  r6 = r0 ^ r3;
+  r7 = z5 ^ z6;
+  r8 = z9 ^ r5;
+  r9 = z12 ^ z16;
+  r10 = z13 ^ z17;
+  r11 = z13 ^ r1;
+  r12 = r4 ^ r6;
+  r13 = z0 ^ z6;
+  r14 = z2 ^ z4;
+  r15 = z3 ^ z15;
+  r16 = z5 ^ z11;
+  r17 = z7 ^ z12;
+  r18 = z10 ^ r11;
+  r19 = z14 ^ r8;
+  r20 = z16 ^ r0;
+  r21 = z16 ^ r8;
+  r22 = r1 ^ r2;
+  r23 = r1 ^ r4;
+  r24 = r2 ^ r9;
+  r25 = r2 ^ r11;
+  r26 = r5 ^ r7;
+  s0 = r6 ^ ~r7;
+  r27 = r9 ^ r23;
+  r28 = r10 ^ r14;
+  s6 = r10 ^ ~r19;
+  s5 = r12 ^ r18;
+  s7 = r12 ^ ~r21;
+  r29 = r13 ^ r17;
+  r30 = r15 ^ r20;
+  r31 = r16 ^ r24;
+  s3 = r22 ^ r29;
+  s1 = r25 ^ ~r30;
+  s2 = r26 ^ r27;
+  s4 = r28 ^ ~r31;
+
+  q[0] = s0;
+  q[1] = s1;
+  q[2] = s2;
+  q[3] = s3;
+  q[4] = s4;
+  q[5] = s5;
+  q[6] = s6;
+  q[7] = s7;
+}
+
+// xored into the round keys for bssm4_sbox, 0x75 in each byte
+const uint32_t bssm4_key_fold = 0x75757575;
+
+// X_{i+4} = X_i xor L(tau(X_{i+1} xor X_{i+2} xor X_{i+3} xor rk_i))
+// X_{i+4} replaces X_i in x0
+// k holds the 32 bits of rk_i, each as a mask of all ones or zeros
+// x0 never overlaps the other words, without __restrict__ the compiler
+// reloads them after each store to x0
+template <class W>
+BSSM4_INLINE void bssm4_round(W *__restrict__ x0, const W *x1, const W *x2,
+                              const W *x3, const uint64_t k[32]) {
+  W a[32];
+  for (int j = 0; j < 32; j++) {
+    a[j] = x1[j] ^ x2[j] ^ x3[j] ^ k[j];
+  }
+
+  // tau: the S-box on each byte
+  for (int i = 0; i < 4; i++) {
+    bssm4_sbox(&a[i * 8]);
+  }
+
+  // L: bit j of x <<< n is bit j - n of x
+#pragma GCC unroll 32
+  for (int j = 0; j < 32; j++) {
+    x0[j] ^= a[j] ^ a[(j - 2) & 31] ^ a[(j - 10) & 31] ^ a[(j - 18) & 31] ^
+             a[(j - 24) & 31];
+  }
+}
+
+// run the cipher on one batch of 64 * LANES blocks
+template <class W>
+BSSM4_INLINE void bssm4_crypt_batch(const uint64_t k[32 * 32],
+                                    const uint8_t *input, uint8_t *output) {
+  const int lanes = sizeof(W) / sizeof(uint64_t);
+
+  // both halves of block i of lane j as big endian numbers in word i
+  uint64_t x[2][64 * lanes];
+  for (int lane = 0; lane < lanes; lane++) {
+    for (int i = 0; i < 64; i++) {
+      const uint8_t *block = &input[(lane * 64 + i) * 16];
+      for (int half = 0; half < 2; half++) {
+        x[half][i * lanes + lane] =
+            ((uint64_t)load_be32(&block[half * 8]) << 32) |
+            load_be32(&block[half * 8 + 4]);
+      }
+    }
+  }
+  W q[2][64];
+  memcpy(q, x, sizeof(q));
+
+  // now q[half][j] holds bit j of the half, X_0 is the upper 32 bits of
+  // the first half
+  bs_transpose(q[0]);
+  bs_transpose(q[1]);
+  W *x0 = &q[0][32], *x1 = &q[0][0], *x2 = &q[1][32], *x3 = &q[1][0];
+  for (int round = 0; round < 32; round++) {
+    bssm4_round(x0, x1, x2, x3, &k[round * 32]);
+    // X_{i+4} is the last word of the next round
+    W *t = x0;
+    x0 = x1;
+    x1 = x2;
+    x2 = x3;
+    x3 = t;
+  }
+
+  // x0 to x3 are X_32 to X_35 again
+  // R(X_32, X_33, X_34, X_35) = (X_35, X_34, X_33, X_32)
+  W y[2][64];
+  memcpy(&y[0][32], x3, 32 * sizeof(W));
+  memcpy(&y[0][0], x2, 32 * sizeof(W));
+  memcpy(&y[1][32], x1, 32 * sizeof(W));
+  memcpy(&y[1][0], x0, 32 * sizeof(W));
+  bs_transpose(y[0]);
+  bs_transpose(y[1]);
+
+  memcpy(x, y, sizeof(y));
+  for (int lane = 0; lane < lanes; lane++) {
+    for (int i = 0; i < 64; i++) {
+      uint8_t *block = &output[(lane * 64 + i) * 16];
+      for (int half = 0; half < 2; half++) {
+        store_be32(&block[half * 8], x[half][i * lanes + lane] >> 32);
+        store_be32(&block[half * 8 + 4], x[half][i * lanes + lane]);
+      }
+    }
+  }
+}
+
+// run the cipher on batches of 64 * LANES blocks
+// a partial batch is padded with zeros, the work is the same
+template <class W>
+BSSM4_INLINE void bssm4_crypt_lanes(const uint64_t k[32 * 32],
+                                    const uint8_t *input, uint8_t *output,
+                                    size_t blocks) {
+  const int lanes = sizeof(W) / sizeof(uint64_t);
+  const size_t batch = lanes * 64;
+
+  for (size_t block = 0; block < blocks; block += batch) {
+    size_t count = blocks - block < batch ? blocks - block : batch;
+    if (count < batch) {
+      uint8_t buffer[batch * 16] = {0};
+      memcpy(buffer, &input[block * 16], count * 16);
+      bssm4_crypt_batch<W>(k, buffer, buffer);
+      memcpy(&output[block * 16], buffer, count * 16);
+    } else {
+      bssm4_crypt_batch<W>(k, &input[block * 16], &output[block * 16]);
+    }
+  }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+// 256 blocks in AVX2 registers, callers check cpu_has_avx2() first
+__attribute__((target("avx2"))) void
+bssm4_crypt_blocks_avx2(const uint64_t k[32 * 32], const uint8_t *input,
+                        uint8_t *output, size_t blocks) {
+  bssm4_crypt_lanes<u64x4>(k, input, output, blocks);
+}
+#endif
+
+void bssm4_crypt_blocks(const uint32_t rk[32], const uint8_t *input,
+                        uint8_t *output, size_t blocks) {
+  // each round key bit as a mask of all ones or zeros
+  uint64_t k[32 * 32];
+  for (int round = 0; round < 32; round++) {
+    uint32_t key = rk[round] ^ bssm4_key_fold;
+    for (int j = 0; j < 32; j++) {
+      k[round * 32 + j] = 0 - (uint64_t)((key >> j) & 1);
+    }
+  }
+
+  size_t block = 0;
+#if defined(__x86_64__) || defined(__i386__)
+  // full batches of 256 blocks, the rest 64 at a time
+  if (blocks >= 256 && cpu_has_avx2()) {
+    block = blocks - blocks % 256;
+    bssm4_crypt_blocks_avx2(k, input, output, block);
+  }
+#endif
+  bssm4_crypt_lanes<uint64_t>(k, &input[block * 16], &output[block * 16],
+                              blocks - block);
+}
@@ -10,20 +10,305 @@
 void des_cbc(bool encrypt, const std::vector<uint8_t> &input,
              const std::vector<uint8_t> &key, const std::vector<uint8_t> &iv,
              std::vector<uint8_t> &output);
+// Triple DES(EDE3), key of 24 bytes K1 || K2 || K3
+void des3_cbc(bool encrypt, const std::vector<uint8_t> &input,
+              const std::vector<uint8_t> &key, const std::vector<uint8_t> &iv,
+              std::vector<uint8_t> &output);
+// aes_*: AES-128, AES-192 or AES-256 for a key of 16, 24 or 32 bytes
+// aes128_*: the same, the key must be 16 bytes
+void aes_cbc(bool encrypt, const std::vector<uint8_t> &input,
+             const std::vector<uint8_t> &key, const std::vector<uint8_t> &iv,
+             std::vector<uint8_t> &output);
 void aes128_cbc(bool encrypt, const std::vector<uint8_t> &input,
                 const std::vector<uint8_t> &key, const std::vector<uint8_t> &iv,
                 std::vector<uint8_t> &output);
+
+// AES implementation used by all AES functions
+// Auto picks the fastest one supported by the cpu at runtime
+// Bitslice runs in constant time, at its best on independent blocks
+// VPAES runs in constant time on single blocks as well, needs SSSE3
+enum class AESBackend { Auto, Table, AESNI, Bitslice, VPAES };
+// returns false if the backend is not supported by the cpu
+// not thread-safe, meant for tests and benchmarks
+bool aes_set_backend(AESBackend backend);
+
 void sm4_cbc(bool encrypt, const std::vector<uint8_t> &input,
              const std::vector<uint8_t> &key, const std::vector<uint8_t> &iv,
              std::vector<uint8_t> &output);
 
+// contexts hold the expanded keys, so many messages under the same key pay
+// for the key schedule only once in *_init
+// des_cbc, aes_cbc and sm4_cbc are *_init followed by one call
+struct des_context {
+  // in encryption and decryption order
+  uint64_t subkeys[16];
+  uint64_t dec_subkeys[16];
+};
+void des_init(des_context &ctx, const std::vector<uint8_t> &key);
+
+// DES implementation used by all DES functions except the key search
+// Auto uses Bitslice on many independent blocks, Table otherwise
+// Table has 8 tables of 64 entries(2 KiB), PairedTable merges pairs of
+// sboxes into 4 tables of 4096 entries(64 KiB), half the lookups per round
+// Bitslice runs in constant time
+// all of them are portable
+// not thread-safe, meant for tests and benchmarks
+enum class DESBackend { Auto, Table, PairedTable, Bitslice };
+void des_set_backend(DESBackend backend);
+void des_cbc_encrypt(const des_context &ctx, const std::vector<uint8_t> &input,
+                     const std::vector<uint8_t> &iv,
+                     std::vector<uint8_t> &output);
+void des_cbc_decrypt(const des_context &ctx, const std::vector<uint8_t> &input,
+                     const std::vector<uint8_t> &iv,
+                     std::vector<uint8_t> &output);
+
+struct des3_context {
+  des_context keys[3];
+};
+// key of 24 bytes
+void des3_init(des3_context &ctx, const std::vector<uint8_t> &key);
+void des3_cbc_encrypt(const des3_context &ctx,
+                      const std::vector<uint8_t> &input,
+                      const std::vector<uint8_t> &iv,
+                      std::vector<uint8_t> &output);
+void des3_cbc_decrypt(const des3_context &ctx,
+                      const std::vector<uint8_t> &input,
+                      const std::vector<uint8_t> &iv,
+                      std::vector<uint8_t> &output);
+
+struct aes_context {
+  // 10, 12 or 14
+  int rounds;
+  // resolved by aes_init, for serial blocks(CBC encryption) and independent
+  // ones, later aes_set_backend() calls do not apply
+  AESBackend serial_backend;
+  AESBackend parallel_backend;
+  // round keys, and round keys of the equivalent inverse cipher
+  uint32_t roundkeys[(14 + 1) * 4];
+  uint32_t dec_roundkeys[(14 + 1) * 4];
+  // round keys in bitsliced form
+  uint64_t bs_roundkeys[(14 + 1) * 8];
+  // round keys of the vector permute cipher
+  uint32_t vp_roundkeys[(14 + 1) * 4];
+  uint32_t vp_dec_roundkeys[(14 + 1) * 4];
+};
+// key of 16, 24 or 32 bytes
+void aes_init(aes_context &ctx, const std::vector<uint8_t> &key);
+void aes_cbc_encrypt(const aes_context &ctx, const std::vector<uint8_t> &input,
+                     const std::vector<uint8_t> &iv,
+                     std::vector<uint8_t> &output);
+void aes_cbc_decrypt(const aes_context &ctx, const std::vector<uint8_t> &input,
+                     const std::vector<uint8_t> &iv,
+                     std::vector<uint8_t> &output);
+
+// SM4 implementation used by all SM4 functions
+// Auto picks per run of independent blocks: Bitslice on 256 blocks or more
+// with AVX2, else AESNI when the cpu supports it at runtime, else Bitslice
+// padded to a full batch, Table only when selected, serial blocks(CBC
+// encryption) always use the tables
+// AESNI computes the sbox with AESENCLAST on 4 or 8 independent blocks
+// (CBC decryption, CTR), needs AES-NI and SSSE3
+// Bitslice runs in constant time on 64 or 256 independent blocks
+enum class SM4Backend { Auto, Table, AESNI, Bitslice };
+// returns false if the backend is not supported by the cpu
+// not thread-safe, meant for tests and benchmarks
+bool sm4_set_backend(SM4Backend backend);
+
+struct sm4_context {
+  // in encryption and decryption order
+  uint32_t rk[32];
+  uint32_t dec_rk[32];
+};
+void sm4_init(sm4_context &ctx, const std::vector<uint8_t> &key);
+void sm4_cbc_encrypt(const sm4_context &ctx, const std::vector<uint8_t> &input,
+                     const std::vector<uint8_t> &iv,
+                     std::vector<uint8_t> &output);
+void sm4_cbc_decrypt(const sm4_context &ctx, const std::vector<uint8_t> &input,
+                     const std::vector<uint8_t> &iv,
+                     std::vector<uint8_t> &output);
+
+// CBC encryption of many independent messages, each with its own context and
+// iv, output sizes are set like *_cbc_encrypt
+// several messages are encrypted together, so the serial chains of CBC
+// overlap, it pays off for messages of a few hundred bytes or more
+template <class Context> struct cbc_job {
+  const Context *ctx;
+  const std::vector<uint8_t> *input;
+  const std::vector<uint8_t> *iv;
+  std::vector<uint8_t> *output;
+};
+void aes_cbc_encrypt_batch(const std::vector<cbc_job<aes_context>> &jobs);
+void sm4_cbc_encrypt_batch(const std::vector<cbc_job<sm4_context>> &jobs);
+
+// CMAC(RFC 4493, NIST SP 800-38B, GB/T 15852.1 MAC algorithm 5), 16-byte tags
+// the subkeys are derived once in *_cmac_init, a message is fed to
+// *_cmac_update in pieces of any size and needs no output buffer
+struct cmac_state {
+  // CBC-MAC of the blocks so far
+  uint8_t mac[16];
+  // the last block is held back, it is processed with a subkey
+  uint8_t buffer[16];
+  size_t buffered;
+};
+// start a new message
+void cmac_start(cmac_state &state);
+
+struct aes_cmac_context {
+  aes_context key;
+  uint8_t k1[16];
+  uint8_t k2[16];
+};
+// key of 16, 24 or 32 bytes
+void aes_cmac_init(aes_cmac_context &ctx, const std::vector<uint8_t> &key);
+void aes_cmac_update(const aes_cmac_context &ctx, cmac_state &state,
+                     const std::vector<uint8_t> &input);
+void aes_cmac_final(const aes_cmac_context &ctx, const cmac_state &state,
+                    std::vector<uint8_t> &tag);
+void aes_cmac(const aes_cmac_context &ctx, const std::vector<uint8_t> &input,
+              std::vector<uint8_t> &tag);
+
+struct sm4_cmac_context {
+  sm4_context key;
+  uint8_t k1[16];
+  uint8_t k2[16];
+};
+void sm4_cmac_init(sm4_cmac_context &ctx, const std::vector<uint8_t> &key);
+void sm4_cmac_update(const sm4_cmac_context &ctx, cmac_state &state,
+                     const std::vector<uint8_t> &input);
+void sm4_cmac_final(const sm4_cmac_context &ctx, const cmac_state &state,
+                    std::vector<uint8_t> &tag);
+void sm4_cmac(const sm4_cmac_context &ctx, const std::vector<uint8_t> &input,
+              std::vector<uint8_t> &tag);
+
+// CMAC of many independent messages, like cbc_job the CBC-MAC chains of
+// several messages overlap
+template <class Context> struct cmac_job {
+  const Context *ctx;
+  const std::vector<uint8_t> *input;
+  std::vector<uint8_t> *tag;
+};
+void aes_cmac_batch(const std::vector<cmac_job<aes_cmac_context>> &jobs);
+void sm4_cmac_batch(const std::vector<cmac_job<sm4_cmac_context>> &jobs);
+
+// CTR mode, encryption and decryption are the same
+// iv is the initial counter block, incremented as a 128-bit big endian number
+// input of any length, large inputs are processed by multiple threads
+void aes_ctr(const std::vector<uint8_t> &input, const std::vector<uint8_t> &key,
+             const std::vector<uint8_t> &iv, std::vector<uint8_t> &output);
+void aes128_ctr(const std::vector<uint8_t> &input,
+                const std::vector<uint8_t> &key, const std::vector<uint8_t> &iv,
+                std::vector<uint8_t> &output);
+void sm4_ctr(const std::vector<uint8_t> &input, const std::vector<uint8_t> &key,
+             const std::vector<uint8_t> &iv, std::vector<uint8_t> &output);
+// DES has 8-byte blocks, the counter is a 64-bit big endian number
+void des_ctr(const std::vector<uint8_t> &input, const std::vector<uint8_t> &key,
+             const std::vector<uint8_t> &iv, std::vector<uint8_t> &output);
+
+// GCM mode, authenticated encryption with associated data(aad)
+// iv of 12 bytes is recommended, other lengths are hashed into the counter
+// the tag is 16 bytes
+void aes_gcm_encrypt(const std::vector<uint8_t> &input,
+                     const std::vector<uint8_t> &key,
+                     const std::vector<uint8_t> &iv,
+                     const std::vector<uint8_t> &aad,
+                     std::vector<uint8_t> &output, std::vector<uint8_t> &tag);
+// returns false and clears output if the tag does not match
+bool aes_gcm_decrypt(const std::vector<uint8_t> &input,
+                     const std::vector<uint8_t> &key,
+                     const std::vector<uint8_t> &iv,
+                     const std::vector<uint8_t> &aad,
+                     const std::vector<uint8_t> &tag,
+                     std::vector<uint8_t> &output);
+void aes128_gcm_encrypt(const std::vector<uint8_t> &input,
+                        const std::vector<uint8_t> &key,
+                        const std::vector<uint8_t> &iv,
+                        const std::vector<uint8_t> &aad,
+                        std::vector<uint8_t> &output,
+                        std::vector<uint8_t> &tag);
+bool aes128_gcm_decrypt(const std::vector<uint8_t> &input,
+                        const std::vector<uint8_t> &key,
+                        const std::vector<uint8_t> &iv,
+                        const std::vector<uint8_t> &aad,
+                        const std::vector<uint8_t> &tag,
+                        std::vector<uint8_t> &output);
+// SM4-GCM(RFC 8998), the same interface
+void sm4_gcm_encrypt(const std::vector<uint8_t> &input,
+                     const std::vector<uint8_t> &key,
+                     const std::vector<uint8_t> &iv,
+                     const std::vector<uint8_t> &aad,
+                     std::vector<uint8_t> &output, std::vector<uint8_t> &tag);
+bool sm4_gcm_decrypt(const std::vector<uint8_t> &input,
+                     const std::vector<uint8_t> &key,
+                     const std::vector<uint8_t> &iv,
+                     const std::vector<uint8_t> &aad,
+                     const std::vector<uint8_t> &tag,
+                     std::vector<uint8_t> &output);
+
+// XTS mode(IEEE 1619) for storage, the key is a data key followed by a tweak
+// key of the same size, 32 or 64 bytes in total
+// input is a range of consecutive sectors starting at sector number sector,
+// the last one may be partial
+// sector_size and input size must be multiples of 16
+struct aes_xts_context {
+  aes_context data_key;
+  aes_context tweak_key;
+};
+void aes_xts_init(aes_xts_context &ctx, const std::vector<uint8_t> &key);
+void aes_xts_encrypt(const aes_xts_context &ctx, uint64_t sector,
+                     size_t sector_size, const std::vector<uint8_t> &input,
+                     std::vector<uint8_t> &output);
+void aes_xts_decrypt(const aes_xts_context &ctx, uint64_t sector,
+                     size_t sector_size, const std::vector<uint8_t> &input,
+                     std::vector<uint8_t> &output);
+
 // stream cipher
+// RC4 keeps its state between rc4_crypt calls, so a stream can be processed
+// in pieces of any size
+struct rc4_context {
+  uint8_t s[256];
+  uint8_t i;
+  uint8_t j;
+};
+// key of 1 to 256 bytes, drop > 0 discards that many bytes of keystream first
+// (RC4-drop[n], e.g. 768 or 3072)
+void rc4_init(rc4_context &ctx, const std::vector<uint8_t> &key,
+              size_t drop = 0);
+// encrypt or decrypt the next input.size() bytes of the stream, input and
+// output may be the same vector
+void rc4_crypt(rc4_context &ctx, const std::vector<uint8_t> &input,
+               std::vector<uint8_t> &output);
+// one-shot RC4 without drop
 void rc4(const std::vector<uint8_t> &input, const std::vector<uint8_t> &key,
          std::vector<uint8_t> &output);
 
+// RC4 of many independent messages, each with its own key, output sizes are
+// set like rc4_crypt
+// the key schedules and keystreams of 4 messages run interleaved, so their
+// serial chains overlap, it pays off for many short messages
+struct rc4_job {
+  const std::vector<uint8_t> *key;
+  const std::vector<uint8_t> *input;
+  std::vector<uint8_t> *output;
+};
+// drop applies to every message
+void rc4_batch(const std::vector<rc4_job> &jobs, size_t drop = 0);
+
 // reverse lfsr
 void bm(const std::vector<uint8_t> &input, std::vector<uint8_t> &output);
 
+// DES key search with a known plain text and cipher text block
+// the candidates agree with key except on the bits set in mask, parity bits
+// (the last bit of each byte) are not key bits and are taken from key
+// the candidates are split into des_key_search_parts(mask) parts of up to
+// 2^20 keys, so parts can be searched by different threads
+uint64_t des_key_search_parts(const std::vector<uint8_t> &mask);
+// append the keys of part that encrypt plain to cipher to found
+void des_key_search(const std::vector<uint8_t> &plain,
+                    const std::vector<uint8_t> &cipher,
+                    const std::vector<uint8_t> &key,
+                    const std::vector<uint8_t> &mask, uint64_t part,
+                    std::vector<std::vector<uint8_t>> &found);
+
 // digest
 void md4(const std::vector<uint8_t> &input, std::vector<uint8_t> &output);
 void sha224(const std::vector<uint8_t> &input, std::vector<uint8_t> &output);
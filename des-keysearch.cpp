@@ -0,0 +1,135 @@
+#include "crypto.h"
+#include "util.h"
+#include <stdio.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+// known plain text DES key search, for auditing legacy systems
+// the keyspace is split into parts, threads take parts in turn
+// a reduced keyspace takes seconds, e.g. with 28 unknown bits:
+// des-keysearch -p 0123456789abcdef -c 85e813540f0ab405
+//               -k 1334577900000000 -m 00000000fefefefe
+
+#define eprintf(...) fprintf(stderr, __VA_ARGS__)
+
+void usage(char *name) {
+  eprintf("Usage: %s OPTIONS\n", name);
+  eprintf("       OPTIONS:\n");
+  eprintf("         -p: plain text block in hex\n");
+  eprintf("         -c: cipher text block in hex\n");
+  eprintf("         -k: key in hex with the known bits(all 0 when omitted)\n");
+  eprintf("         -m: unknown bits of the key in hex(all when omitted)\n");
+  eprintf("         -a: find all keys instead of stopping at the first\n");
+}
+
+void print_hex(const std::vector<uint8_t> &data) {
+  for (auto byte : data) {
+    printf("%02x", byte);
+  }
+}
+
+int main(int argc, char *argv[]) {
+  int c;
+  std::string plain;
+  std::string cipher;
+  std::string key = "0000000000000000";
+  std::string mask = "ffffffffffffffff";
+  bool all = false;
+  while ((c = getopt(argc, argv, "ac:k:m:p:")) != -1) {
+    switch (c) {
+    case 'a':
+      all = true;
+      break;
+    case 'c':
+      cipher = optarg;
+      break;
+    case 'k':
+      key = optarg;
+      break;
+    case 'm':
+      mask = optarg;
+      break;
+    case 'p':
+      plain = optarg;
+      break;
+    default:
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  std::vector<uint8_t> vec_plain = parse_hex_new(plain);
+  std::vector<uint8_t> vec_cipher = parse_hex_new(cipher);
+  std::vector<uint8_t> vec_key = parse_hex_new(key);
+  std::vector<uint8_t> vec_mask = parse_hex_new(mask);
+  if (vec_plain.size() != 8 || vec_cipher.size() != 8 ||
+      vec_key.size() != 8 || vec_mask.size() != 8) {
+    eprintf("Blocks, key and mask must be 8 bytes\n");
+    usage(argv[0]);
+    return 1;
+  }
+
+  // unknown key bits, parity bits do not count
+  int unknown = 0;
+  for (auto byte : vec_mask) {
+    unknown += __builtin_popcount(byte & 0xfe);
+  }
+  uint64_t parts = des_key_search_parts(vec_mask);
+  // keys per part
+  double part_keys = (double)((uint64_t)1 << unknown) / parts;
+  eprintf("Searching 2^%d keys in %llu parts\n", unknown,
+          (unsigned long long)parts);
+
+  uint64_t begin = get_time_us();
+  uint64_t last_report = begin;
+  uint64_t parts_done = 0;
+  bool stop = false;
+  std::vector<std::vector<uint8_t>> keys;
+
+  // small parts in any order, a shared counter hands them out
+#pragma omp parallel for schedule(dynamic)
+  for (uint64_t part = 0; part < parts; part++) {
+    bool skip;
+#pragma omp atomic read
+    skip = stop;
+    if (skip) {
+      continue;
+    }
+
+    std::vector<std::vector<uint8_t>> found;
+    des_key_search(vec_plain, vec_cipher, vec_key, vec_mask, part, found);
+
+#pragma omp critical
+    {
+      parts_done++;
+      for (auto &k : found) {
+        printf("Found key: ");
+        print_hex(k);
+        printf("\n");
+        fflush(stdout);
+        keys.push_back(k);
+        if (!all) {
+#pragma omp atomic write
+          stop = true;
+        }
+      }
+      // progress every 10 seconds
+      uint64_t now = get_time_us();
+      if (now - last_report > 10000000) {
+        last_report = now;
+        double elapsed = (now - begin) / 1000000.0;
+        eprintf("%.2lf%% done, %.0lf keys/s, elapsed %.2lf s\n",
+                100.0 * parts_done / parts, parts_done * part_keys / elapsed,
+                elapsed);
+      }
+    }
+  }
+
+  double elapsed = (get_time_us() - begin) / 1000000.0;
+  printf("%zu keys found, %.0lf keys searched, %.0lf keys/s, elapsed %.2lf "
+         "s\n",
+         keys.size(), parts_done * part_keys, parts_done * part_keys / elapsed,
+         elapsed);
+  return keys.empty() ? 1 : 0;
+}
@@ -1,4 +1,7 @@
 #include "crypto.h"
+#include "des.h"
+#include "modes.h"
+#include "util.h"
 #include <cassert>
 #include <vector>
 
@@ -9,28 +12,6 @@ using namespace std;
 // tables are taken
 // from https://en.wikipedia.org/wiki/DES_supplementary_material
 
-// Initial permutation
-const int ip[] = {58, 50, 42, 34, 26, 18, 10, 2, 60, 52, 44, 36, 28, 20, 12, 4,
-                  62, 54, 46, 38, 30, 22, 14, 6, 64, 56, 48, 40, 32, 24, 16, 8,
-                  57, 49, 41, 33, 25, 17, 9,  1, 59, 51, 43, 35, 27, 19, 11, 3,
-                  61, 53, 45, 37, 29, 21, 13, 5, 63, 55, 47, 39, 31, 23, 15, 7};
-
-// Final permutation
-const int ip1[] = {40, 8,  48, 16, 56, 24, 64, 32, 39, 7,  47, 15, 55,
-                   23, 63, 31, 38, 6,  46, 14, 54, 22, 62, 30, 37, 5,
-                   45, 13, 53, 21, 61, 29, 36, 4,  44, 12, 52, 20, 60,
-                   28, 35, 3,  43, 11, 51, 19, 59, 27, 34, 2,  42, 10,
-                   50, 18, 58, 26, 33, 1,  41, 9,  49, 17, 57, 25};
-
-// Expansion
-const int e[] = {32, 1,  2,  3,  4,  5,  4,  5,  6,  7,  8,  9,  8,  9,  10, 11,
-                 12, 13, 12, 13, 14, 15, 16, 17, 16, 17, 18, 19, 20, 21, 20, 21,
-                 22, 23, 24, 25, 24, 25, 26, 27, 28, 29, 28, 29, 30, 31, 32, 1};
-
-// Permutation
-const int p[] = {16, 7, 20, 21, 29, 12, 28, 17, 1,  15, 23, 26, 5,  18, 31, 10,
-                 2,  8, 24, 14, 32, 27, 3,  9,  19, 13, 30, 6,  22, 11, 4,  25};
-
 // 8 S-boxes
 const int s[8][64] = {
     {14, 4,  13, 1, 2,  15, 11, 8,  3,  10, 6,  12, 5,  9,  0, 7,
@@ -66,52 +47,17 @@ const int s[8][64] = {
      7,  11, 4,  1, 9,  12, 14, 2,  0,  6,  10, 13, 15, 3,  5,  8,
      2,  1,  14, 7, 4,  10, 8,  13, 15, 12, 9,  0,  3,  5,  6,  11}};
 
-// preprocessed S-box
-bool preprocessed = false;
-uint64_t s_preprocessed[8][64] = {{0}};
-
-// key schedule
-const int pc1[] = { // left
-    57, 49, 41, 33, 25, 17, 9, 1, 58, 50, 42, 34, 26, 18, 10, 2, 59, 51, 43, 25,
-    27, 19, 11, 3, 60, 52, 44, 36,
-    // right
-    63, 55, 47, 39, 31, 23, 15, 7, 62, 54, 46, 38, 30, 22, 14, 6, 61, 53, 45,
-    37, 29, 21, 13, 5, 28, 20, 12, 4};
-
-const int pc2[] = {14, 17, 11, 24, 1,  5,  3,  28, 15, 6,  21, 10,
-                   23, 19, 12, 4,  26, 8,  16, 7,  27, 20, 13, 2,
-                   41, 52, 31, 37, 47, 55, 30, 40, 51, 45, 33, 48,
-                   44, 49, 39, 56, 34, 53, 46, 42, 50, 36, 29, 32};
-
 // reverse 8bit number
 // https://stackoverflow.com/questions/2602823/in-c-c-whats-the-simplest-way-to-reverse-the-order-of-bits-in-a-byte
-inline uint8_t reverse(uint8_t b) {
+constexpr uint8_t reverse(uint8_t b) {
   b = (b & 0xF0) >> 4 | (b & 0x0F) << 4;
   b = (b & 0xCC) >> 2 | (b & 0x33) << 2;
   b = (b & 0xAA) >> 1 | (b & 0x55) << 1;
   return b;
 }
 
-// reverse 32bit number
-// https://helloacm.com/how-to-reverse-bits-for-32-bit-unsigned-integer-in-cc/
-inline uint32_t reverse32(uint32_t n) {
-  n = ((n >> 1) & 0x55555555) | ((n << 1) & 0xaaaaaaaa);
-  n = ((n >> 2) & 0x33333333) | ((n << 2) & 0xcccccccc);
-  n = ((n >> 4) & 0x0f0f0f0f) | ((n << 4) & 0xf0f0f0f0);
-  n = ((n >> 8) & 0x00ff00ff) | ((n << 8) & 0xff00ff00);
-  n = ((n >> 16) & 0x0000ffff) | ((n << 16) & 0xffff0000);
-  return n;
-}
-
-// reverse 32bit number within 4bits
-inline uint32_t reverse32_4(uint32_t n) {
-  n = ((n >> 1) & 0x55555555) | ((n << 1) & 0xaaaaaaaa);
-  n = ((n >> 2) & 0x33333333) | ((n << 2) & 0xcccccccc);
-  return n;
-}
-
 template <int N>
-inline uint64_t apply_permutation(uint64_t input, const int perm[N]) {
+constexpr uint64_t apply_permutation(uint64_t input, const int perm[N]) {
   uint64_t output = 0;
   for (int i = N - 1; i >= 0; i--) {
     output = (output << 1) | ((input & ((uint64_t)1 << (perm[i] - 1))) != 0);
@@ -122,100 +68,133 @@ inline uint64_t apply_permutation(uint64_t input, const int perm[N]) {
 // 28bit shift rotate right
 inline uint64_t rotate(uint64_t num) { return (num >> 1) | ((num & 1) << 27); }
 
+constexpr uint32_t rotl32(uint32_t x, int n) {
+  return (x << n) | (x >> (32 - n));
+}
+
 // Richard Outerbridge's optimization
 // https://crypto.stackexchange.com/questions/59190/des-how-does-richard-outerbridges-initial-permutation-operate/59212#59212
-// IP
-inline uint64_t inital_permutation(uint64_t input) {
-  // a faster implementation of:
-  // uint64_t after_ip = apply_permutation<64>(init_data, ip);
-  uint32_t leftt = reverse32(input);
-  uint32_t right = reverse32(input >> 32);
+// the block is two big endian words, bit 1 is the msb of left
+// IP with delta swaps, then both halves are rotated left by 1, so that the
+// 6-bit groups of E are byte aligned in right and in right >>> 4
+inline void initial_permutation(uint32_t &left, uint32_t &right) {
   uint32_t work;
 
-  work = ((right >> 4) ^ leftt) & 0x0f0f0f0f;
-  leftt ^= work;
-  right ^= (work << 4);
+  work = ((left >> 4) ^ right) & 0x0f0f0f0f;
+  right ^= work;
+  left ^= (work << 4);
 
-  work = ((leftt >> 16) ^ right) & 0x0000ffff;
+  work = ((left >> 16) ^ right) & 0x0000ffff;
   right ^= work;
-  leftt ^= (work << 16);
+  left ^= (work << 16);
 
-  work = ((right >> 2) ^ leftt) & 0x33333333;
-  leftt ^= work;
+  work = ((right >> 2) ^ left) & 0x33333333;
+  left ^= work;
   right ^= (work << 2);
 
-  work = ((leftt >> 8) ^ right) & 0x00ff00ff;
+  work = ((right >> 8) ^ left) & 0x00ff00ff;
+  left ^= work;
+  right ^= (work << 8);
+
+  right = rotl32(right, 1);
+  work = (left ^ right) & 0xaaaaaaaa;
+  left ^= work;
   right ^= work;
-  leftt ^= (work << 8);
+  left = rotl32(left, 1);
+}
 
-  work = ((right >> 1) ^ leftt) & 0x55555555;
-  leftt ^= work;
-  right ^= (work << 1);
+// IP^{-1} with the swaps of IP in reverse order, left and right are L16 and
+// R16 rotated left by 1, the output is IP^{-1}(R16 L16)
+inline void final_permutation(uint32_t &left, uint32_t &right) {
+  uint32_t work;
+
+  right = rotl32(right, 31);
+  work = (left ^ right) & 0xaaaaaaaa;
+  left ^= work;
+  right ^= work;
+  left = rotl32(left, 31);
+
+  work = ((left >> 8) ^ right) & 0x00ff00ff;
+  right ^= work;
+  left ^= (work << 8);
+
+  work = ((left >> 2) ^ right) & 0x33333333;
+  right ^= work;
+  left ^= (work << 2);
+
+  work = ((right >> 16) ^ left) & 0x0000ffff;
+  left ^= work;
+  right ^= (work << 16);
 
-  return (((uint64_t)reverse32_4(leftt)) << 32) | reverse32_4(right);
+  work = ((right >> 4) ^ left) & 0x0f0f0f0f;
+  left ^= work;
+  right ^= (work << 4);
+
+  // R16 comes first
+  work = left;
+  left = right;
+  right = work;
 }
 
-// preprocess sbox and p into one
-void preprocess() {
+// sbox and p in one table for each sbox, 2 KiB
+// computed at compile time, so there is nothing to initialize
+// indexed by the 6 input bits, the first one is the msb
+// the output is rotated left by 1 like the halves of the block
+struct des_sp_table {
+  uint32_t sp[8][64];
+};
+
+constexpr des_sp_table make_sp_table() {
+  des_sp_table t = {};
   for (int box = 0; box < 8; box++) {
-    for (uint64_t window = 0; window < (1 << 6); window++) {
-      // row: bit 0 | bit 5
-      // col: bit 1 | bit 2 | bit 3 | bit 4
-      // index = row << 4 | col
-      uint64_t row = ((window & 1) << 1) | (window >> 5);
-      uint64_t col = ((window & 0x2) << 2) | ((window & 0x4)) |
-                     ((window & 0x8) >> 2) | ((window & 0x10) >> 4);
-      uint64_t index = (row << 4) | col;
-      uint64_t sbox = s[box][index];
-      // reverse bit order in sbox
-      sbox = ((sbox & 0x1) << 3) | ((sbox & 0x2) << 1) | ((sbox & 0x4) >> 1) |
-             ((sbox & 0x8) >> 3);
-      sbox = sbox << (box * 4);
-      s_preprocessed[box][window] = apply_permutation<32>(sbox, p);
+    for (uint32_t window = 0; window < (1 << 6); window++) {
+      // row: first bit | last bit
+      // col: the middle 4 bits
+      uint32_t row = ((window >> 4) & 0x2) | (window & 0x1);
+      uint32_t col = (window >> 1) & 0xf;
+      uint32_t sbox = s[box][(row << 4) | col];
+      // the 4 output bits of the sbox are bits 4 box + 1 .. 4 box + 4
+      uint32_t before_p = sbox << (28 - box * 4);
+      uint32_t after_p = 0;
+      for (int i = 0; i < 32; i++) {
+        after_p |= ((before_p >> (32 - p[i])) & 1) << (31 - i);
+      }
+      t.sp[box][window] = rotl32(after_p, 1);
     }
   }
+  return t;
 }
 
-// optimization of:
-// uint64_t after_expansion = apply_permutation<48>(right, e);
-inline uint64_t expansion(uint64_t input) {
-  uint64_t res = 0;
-  // 0: 5 4 3 2 1 32
-  res |= ((input & 0b11111) << 1) | ((input & ((uint64_t)1 << 31)) >> 31);
-  // 6: 9 8 7 6 5 4
-  res |= ((input & (0b111111LL << 3)) << 3);
-  // 12: 13 12 11 10 9 8
-  res |= ((input & (0b111111LL << 7)) << 5);
-  // 18: 17 16 15 14 13 12
-  res |= ((input & (0b111111LL << 11)) << 7);
-  // 24: 21 20 19 18 17 16
-  res |= ((input & (0b111111LL << 15)) << 9);
-  // 32: 25 24 23 22 21 20
-  res |= ((input & (0b111111LL << 19)) << 11);
-  // 40: 29 28 27 26 25 24
-  res |= ((input & (0b111111LL << 23)) << 13);
-  // 48: 1 32 31 30 29 28
-  res |= ((input & (0b11111LL << 27)) << 15) | ((input & 1) << 47);
-
-  return res;
+constexpr des_sp_table sp_table = make_sp_table();
+
+// two sboxes in one table, indexed by 12 input bits, 64 KiB
+// halves the lookups of a round, at the cost of a footprint beyond L1 on
+// many cpus
+// pairs: sbox 1 and 3, 5 and 7, 2 and 4, 6 and 8, the first one in the
+// upper 6 bits of the index
+struct des_sp12_table {
+  uint32_t sp[4][1 << 12];
+};
+
+constexpr des_sp12_table make_sp12_table() {
+  des_sp12_table t = {};
+  for (int pair = 0; pair < 4; pair++) {
+    // pair 0: sbox 0 and 2, pair 1: 4 and 6, pair 2: 1 and 3, ...
+    int high = ((pair & 1) << 2) | (pair >> 1);
+    for (uint32_t index = 0; index < (1 << 12); index++) {
+      t.sp[pair][index] = sp_table.sp[high][index >> 6] ^
+                          sp_table.sp[high + 2][index & 0x3f];
+    }
+  }
+  return t;
 }
 
-void des_cbc(bool encrypt, const vector<uint8_t> &input,
-             const vector<uint8_t> &key, const vector<uint8_t> &iv,
-             vector<uint8_t> &output) {
-  // block size = 8 bytes
-  assert(iv.size() == 8);
-  assert((input.size() % 8) == 0);
-  output.resize(input.size());
+constexpr des_sp12_table sp12_table = make_sp12_table();
+
+void des_init(des_context &ctx, const vector<uint8_t> &key) {
   // key size = 8 bytes
   assert(key.size() == 8);
 
-  // do some preprocessing
-  if (!preprocessed) {
-    preprocess();
-    preprocessed = true;
-  }
-
   // convert key to 64bit integer
   uint64_t init_key = 0;
   for (int i = 0; i < 8; i++) {
@@ -232,7 +211,6 @@ void des_cbc(bool encrypt, const vector<uint8_t> &input,
   uint64_t right = after_pc1 & ((1 << 28) - 1);
 
   // 16 subkeys
-  uint64_t subkeys[16];
   for (int i = 0; i <= 15; i++) {
     // rotate
     left = rotate(left);
@@ -248,86 +226,352 @@ void des_cbc(bool encrypt, const vector<uint8_t> &input,
     // PC2
     uint64_t after_pc2 = apply_permutation<48>(current_key, pc2);
     // use reverse subkeys for decrypt
-    if (encrypt) {
-      subkeys[i] = after_pc2;
-    } else {
-      subkeys[15 - i] = after_pc2;
+    ctx.subkeys[i] = after_pc2;
+    ctx.dec_subkeys[15 - i] = after_pc2;
+  }
+}
+
+// subkeys in the layout of the rounds, 2 words per round
+// the 6 bits for sbox 1, 3, 5, 7 are the bytes of the first word, to be
+// xored with right >>> 4, those for sbox 2, 4, 6, 8 are in the second word
+void des_round_keys(const uint64_t subkeys[16], uint32_t keys[32]) {
+  for (int round = 0; round < 16; round++) {
+    uint32_t group[8];
+    for (int box = 0; box < 8; box++) {
+      // bit i of subkeys is bit i + 1 of the standard, the first bit of each
+      // group goes to the msb
+      group[box] = reverse((subkeys[round] >> (box * 6)) << 2);
     }
+    keys[round * 2] =
+        (group[0] << 24) | (group[2] << 16) | (group[4] << 8) | group[6];
+    keys[round * 2 + 1] =
+        (group[1] << 24) | (group[3] << 16) | (group[5] << 8) | group[7];
   }
+}
 
-  // convert iv to 64bit integer
-  uint64_t init_iv = 0;
-  for (int i = 0; i < 8; i++) {
-    // reverse bit order
-    init_iv |= (uint64_t)(reverse(iv[i])) << (8 * i);
+// one round: f(right) with 8 lookups into sp_table, or 4 into sp12_table
+template <bool paired>
+inline uint32_t des_f(uint32_t right, const uint32_t keys[2]) {
+  uint32_t work = rotl32(right, 28) ^ keys[0];
+  uint32_t res;
+  if (paired) {
+    res = sp12_table.sp[0][((work >> 18) & 0xfc0) | ((work >> 16) & 0x3f)] ^
+          sp12_table.sp[1][((work >> 2) & 0xfc0) | (work & 0x3f)];
+  } else {
+    res = sp_table.sp[6][work & 0x3f] ^ sp_table.sp[4][(work >> 8) & 0x3f] ^
+          sp_table.sp[2][(work >> 16) & 0x3f] ^
+          sp_table.sp[0][(work >> 24) & 0x3f];
   }
+  work = right ^ keys[1];
+  if (paired) {
+    res ^= sp12_table.sp[2][((work >> 18) & 0xfc0) | ((work >> 16) & 0x3f)] ^
+           sp12_table.sp[3][((work >> 2) & 0xfc0) | (work & 0x3f)];
+  } else {
+    res ^= sp_table.sp[7][work & 0x3f] ^ sp_table.sp[5][(work >> 8) & 0x3f] ^
+           sp_table.sp[3][(work >> 16) & 0x3f] ^
+           sp_table.sp[1][(work >> 24) & 0x3f];
+  }
+  return res;
+}
 
-  // for each block
-  for (size_t offset = 0; offset < input.size(); offset += 8) {
-    // convert data to 64bit integer
-    uint64_t init_data = 0;
-    for (int i = 0; i < 8; i++) {
-      // reverse bit order
-      init_data |= (uint64_t)(reverse(input[offset + i])) << (8 * i);
+// one block with the tables, passes DES passes between IP and IP^{-1}
+template <int passes, bool paired>
+inline void des_crypt_block(const uint32_t keys[passes][32], uint32_t &left,
+                            uint32_t &right) {
+  initial_permutation(left, right);
+
+  for (int pass = 0; pass < passes; pass++) {
+    if (pass > 0) {
+      // R16 L16 of the last pass is the input of this one, IP^{-1} and IP
+      // cancel out
+      uint32_t work = left;
+      left = right;
+      right = work;
     }
-    // in encryption, plain text is xored with last iv
-    if (encrypt) {
-      init_data ^= init_iv;
+    // the halves take turns instead of being swapped after each round
+    for (int round = 0; round < 16; round += 2) {
+      left ^= des_f<paired>(right, &keys[pass][round * 2]);
+      right ^= des_f<paired>(left, &keys[pass][round * 2 + 2]);
     }
+  }
 
-    // ip
-    // uint64_t after_ip = apply_permutation<64>(init_data, ip);
-    // optimized to:
-    uint64_t after_ip = inital_permutation(init_data);
-    // printf("after ip: %llx\n", after_ip);
-
-    // swap left and right before first round
-    uint64_t left = after_ip & (((uint64_t)1 << 32) - 1);
-    uint64_t right = after_ip >> 32;
-
-    for (int round = 0; round < 16; round++) {
-      // expand
-      // uint64_t after_expansion = apply_permutation<48>(right, e);
-      // optimized to:
-      uint64_t after_expansion = expansion(right);
-
-      // xor with subkey
-      uint64_t xored = after_expansion ^ subkeys[round];
-
-      // split xored into 8 6-bit groups and pass to each s-box and p
-      uint64_t after_sbox_p = 0;
-      for (int box = 0; box < 8; box += 1) {
-        uint64_t window = (xored >> (box * 6)) & ((1 << 6) - 1);
-        uint64_t sbox_p = s_preprocessed[box][window];
-        after_sbox_p ^= sbox_p;
-      }
+  final_permutation(left, right);
+}
+
+DESBackend des_backend = DESBackend::Auto;
+
+void des_set_backend(DESBackend backend) { des_backend = backend; }
+
+// bitsliced DES pays off from this many blocks
+const size_t bsdes_min_blocks = 16;
+
+// resolve DESBackend::Auto for a run of independent blocks
+DESBackend des_get_backend(size_t blocks) {
+  if (des_backend == DESBackend::Auto) {
+    return blocks >= bsdes_min_blocks ? DESBackend::Bitslice
+                                      : DESBackend::Table;
+  }
+  return des_backend;
+}
+
+// ECB with the tables
+template <int passes, bool paired>
+void des_table_crypt_blocks(const uint32_t keys[passes][32],
+                            const uint8_t *input, uint8_t *output,
+                            size_t blocks) {
+  for (size_t offset = 0; offset < blocks * 8; offset += 8) {
+    uint32_t left = load_be32(&input[offset]);
+    uint32_t right = load_be32(&input[offset + 4]);
+    des_crypt_block<passes, paired>(keys, left, right);
+    store_be32(&output[offset], left);
+    store_be32(&output[offset + 4], right);
+  }
+}
 
-      uint64_t new_left = right;
-      uint64_t new_right = left ^ after_sbox_p;
-      left = new_left;
-      right = new_right;
+// ECB on independent blocks, bitsliced if there are enough of them
+template <int passes>
+void des_crypt_blocks(const uint64_t *const subkeys[passes],
+                      const uint8_t *input, uint8_t *output, size_t blocks) {
+  DESBackend backend = des_get_backend(blocks);
+  if (backend == DESBackend::Bitslice) {
+    bsdes_crypt_blocks(subkeys, passes, input, output, blocks);
+    return;
+  }
+
+  uint32_t keys[passes][32];
+  for (int pass = 0; pass < passes; pass++) {
+    des_round_keys(subkeys[pass], keys[pass]);
+  }
+  if (backend == DESBackend::PairedTable) {
+    des_table_crypt_blocks<passes, true>(keys, input, output, blocks);
+  } else {
+    des_table_crypt_blocks<passes, false>(keys, input, output, blocks);
+  }
+}
+
+// CBC encryption with the tables
+template <int passes, bool paired>
+void des_table_cbc_encrypt(const uint32_t keys[passes][32],
+                           const vector<uint8_t> &input,
+                           const vector<uint8_t> &iv, vector<uint8_t> &output) {
+  // the block as two big endian words
+  uint32_t left = load_be32(&iv[0]);
+  uint32_t right = load_be32(&iv[4]);
+  for (size_t offset = 0; offset < input.size(); offset += 8) {
+    // in encryption, plain text is xored with last cipher text
+    left ^= load_be32(&input[offset]);
+    right ^= load_be32(&input[offset + 4]);
+    des_crypt_block<passes, paired>(keys, left, right);
+    store_be32(&output[offset], left);
+    store_be32(&output[offset + 4], right);
+  }
+}
+
+// des_crypt_blocks as a block_fn, key is the subkeys of each pass
+template <int passes>
+void des_ecb_crypt(const void *key, const uint8_t *input, uint8_t *output,
+                   size_t blocks) {
+  des_crypt_blocks<passes>((const uint64_t *const *)key, input, output,
+                           blocks);
+}
+
+// CBC with passes DES passes per block, 1 for DES and 3 for Triple DES
+template <int passes>
+void des_cbc_crypt(bool encrypt, const uint64_t *const subkeys[passes],
+                   const vector<uint8_t> &input, const vector<uint8_t> &iv,
+                   vector<uint8_t> &output) {
+  // block size = 8 bytes
+  assert(iv.size() == 8);
+  assert((input.size() % 8) == 0);
+  output.resize(input.size());
+
+  if (!encrypt) {
+    cbc_decrypt(des_ecb_crypt<passes>, subkeys, 8, &iv[0], input.data(),
+                output.data(), input.size() / 8);
+    return;
+  }
+
+  // blocks depend on each other, one at a time
+  DESBackend backend = des_get_backend(1);
+  if (backend == DESBackend::Bitslice) {
+    uint8_t block[8];
+    for (size_t offset = 0; offset < input.size(); offset += 8) {
+      const uint8_t *cur_iv = offset == 0 ? &iv[0] : &output[offset - 8];
+      for (int i = 0; i < 8; i++) {
+        block[i] = input[offset + i] ^ cur_iv[i];
+      }
+      bsdes_crypt_blocks(subkeys, passes, block, &output[offset], 1);
     }
+    return;
+  }
+
+  uint32_t keys[passes][32];
+  for (int pass = 0; pass < passes; pass++) {
+    des_round_keys(subkeys[pass], keys[pass]);
+  }
+  if (backend == DESBackend::PairedTable) {
+    des_table_cbc_encrypt<passes, true>(keys, input, iv, output);
+  } else {
+    des_table_cbc_encrypt<passes, false>(keys, input, iv, output);
+  }
+}
+
+void des_cbc_encrypt(const des_context &ctx, const vector<uint8_t> &input,
+                     const vector<uint8_t> &iv, vector<uint8_t> &output) {
+  const uint64_t *subkeys[1] = {ctx.subkeys};
+  des_cbc_crypt<1>(true, subkeys, input, iv, output);
+}
+
+void des_cbc_decrypt(const des_context &ctx, const vector<uint8_t> &input,
+                     const vector<uint8_t> &iv, vector<uint8_t> &output) {
+  const uint64_t *subkeys[1] = {ctx.dec_subkeys};
+  des_cbc_crypt<1>(false, subkeys, input, iv, output);
+}
+
+void des_cbc(bool encrypt, const vector<uint8_t> &input,
+             const vector<uint8_t> &key, const vector<uint8_t> &iv,
+             vector<uint8_t> &output) {
+  des_context ctx;
+  des_init(ctx, key);
+  if (encrypt) {
+    des_cbc_encrypt(ctx, input, iv, output);
+  } else {
+    des_cbc_decrypt(ctx, input, iv, output);
+  }
+}
+
+void des3_init(des3_context &ctx, const vector<uint8_t> &key) {
+  // key size = 24 bytes
+  assert(key.size() == 24);
+
+  for (int i = 0; i < 3; i++) {
+    des_init(ctx.keys[i],
+             vector<uint8_t>(key.begin() + i * 8, key.begin() + i * 8 + 8));
+  }
+}
+
+void des3_cbc_encrypt(const des3_context &ctx, const vector<uint8_t> &input,
+                      const vector<uint8_t> &iv, vector<uint8_t> &output) {
+  // encrypt with K1, decrypt with K2, encrypt with K3
+  const uint64_t *subkeys[3] = {ctx.keys[0].subkeys, ctx.keys[1].dec_subkeys,
+                                ctx.keys[2].subkeys};
+  des_cbc_crypt<3>(true, subkeys, input, iv, output);
+}
+
+void des3_cbc_decrypt(const des3_context &ctx, const vector<uint8_t> &input,
+                      const vector<uint8_t> &iv, vector<uint8_t> &output) {
+  // decrypt with K3, encrypt with K2, decrypt with K1
+  const uint64_t *subkeys[3] = {ctx.keys[2].dec_subkeys, ctx.keys[1].subkeys,
+                                ctx.keys[0].dec_subkeys};
+  des_cbc_crypt<3>(false, subkeys, input, iv, output);
+}
+
+void des3_cbc(bool encrypt, const vector<uint8_t> &input,
+              const vector<uint8_t> &key, const vector<uint8_t> &iv,
+              vector<uint8_t> &output) {
+  des3_context ctx;
+  des3_init(ctx, key);
+  if (encrypt) {
+    des3_cbc_encrypt(ctx, input, iv, output);
+  } else {
+    des3_cbc_decrypt(ctx, input, iv, output);
+  }
+}
+
+// blocks of keystream per chunk, chunks are split among threads
+const size_t des_ctr_chunk = 1024;
+
+void des_ctr(const vector<uint8_t> &input, const vector<uint8_t> &key,
+             const vector<uint8_t> &iv, vector<uint8_t> &output) {
+  // initial counter block = 8 bytes
+  assert(iv.size() == 8);
+  output.resize(input.size());
 
-    // concat right and left
-    uint64_t after_rounds = (left << 32) | right;
-    // apply IP^{-1}
-    uint64_t after_ip1 = apply_permutation<64>(after_rounds, ip1);
+  des_context ctx;
+  des_init(ctx, key);
+  const uint64_t *subkeys[1] = {ctx.subkeys};
 
-    // in decryption, plain text is xored with iv
-    if (!encrypt) {
-      after_ip1 ^= init_iv;
+  uint64_t counter = ((uint64_t)load_be32(&iv[0]) << 32) | load_be32(&iv[4]);
+  size_t chunks = (input.size() + des_ctr_chunk * 8 - 1) / (des_ctr_chunk * 8);
+
+  // the counter of each chunk is known in advance
+#pragma omp parallel for if (chunks > 1)
+  for (size_t chunk = 0; chunk < chunks; chunk++) {
+    size_t offset = chunk * des_ctr_chunk * 8;
+    size_t bytes = input.size() - offset;
+    if (bytes > des_ctr_chunk * 8) {
+      bytes = des_ctr_chunk * 8;
     }
-    // write to output in reverse bit order
-    for (int i = 0; i < 8; i++) {
-      // reverse bit order
-      output[offset + i] = reverse((after_ip1 >> (8 * i)) & 0xff);
+    size_t blocks = (bytes + 7) / 8;
+
+    uint8_t counters[des_ctr_chunk * 8];
+    uint8_t keystream[des_ctr_chunk * 8];
+    for (size_t i = 0; i < blocks; i++) {
+      uint64_t cur = counter + chunk * des_ctr_chunk + i;
+      store_be32(&counters[i * 8], cur >> 32);
+      store_be32(&counters[i * 8 + 4], cur);
     }
-    // in encryption, cipher text is used as new iv
-    if (encrypt) {
-      init_iv = after_ip1;
-    } else {
-      // in decryption, cipher text is used as new iv
-      init_iv = init_data;
+    des_crypt_blocks<1>(subkeys, counters, keystream, blocks);
+
+    // out = in xor E(counter)
+    xor_bytes(&output[offset], &input[offset], keystream, bytes);
+  }
+}
+
+// keys per part of a key search, 2^20 keys take a few milliseconds
+const size_t des_key_search_bits = 20;
+
+// the key bits set in mask, numbered from 0 like des.h minus 1
+static vector<int> des_key_bits(const vector<uint8_t> &mask) {
+  assert(mask.size() == 8);
+  vector<int> bits;
+  for (int i = 0; i < 64; i++) {
+    // the last bit of each byte is parity
+    if (i % 8 != 7 && ((mask[i / 8] >> (7 - i % 8)) & 1)) {
+      bits.push_back(i);
     }
   }
+  return bits;
+}
+
+uint64_t des_key_search_parts(const vector<uint8_t> &mask) {
+  size_t count = des_key_bits(mask).size();
+  return count > des_key_search_bits
+             ? (uint64_t)1 << (count - des_key_search_bits)
+             : 1;
+}
+
+void des_key_search(const vector<uint8_t> &plain,
+                    const vector<uint8_t> &cipher, const vector<uint8_t> &key,
+                    const vector<uint8_t> &mask, uint64_t part,
+                    vector<vector<uint8_t>> &found) {
+  // block size = 8 bytes, key size = 8 bytes
+  assert(plain.size() == 8 && cipher.size() == 8 && key.size() == 8);
+  vector<int> bits = des_key_bits(mask);
+  size_t count = bits.size() < des_key_search_bits ? bits.size()
+                                                   : des_key_search_bits;
+
+  // the bits above the part are taken from the part number
+  uint64_t base = 0;
+  for (int i = 0; i < 8; i++) {
+    base |= (uint64_t)(key[i] & ~(mask[i] & 0xfe)) << (56 - 8 * i);
+  }
+  for (size_t i = count; i < bits.size(); i++) {
+    base |= ((part >> (i - count)) & 1) << (63 - bits[i]);
+  }
+
+  // more than one key is rare, a block has 64 bits and a key 56
+  uint64_t keys[16];
+  size_t num_keys =
+      bsdes_key_search(((uint64_t)load_be32(&plain[0]) << 32) |
+                           load_be32(&plain[4]),
+                       ((uint64_t)load_be32(&cipher[0]) << 32) |
+                           load_be32(&cipher[4]),
+                       base, bits.data(), count, keys, 16);
+  for (size_t i = 0; i < num_keys && i < 16; i++) {
+    vector<uint8_t> res(8);
+    store_be32(&res[0], keys[i] >> 32);
+    store_be32(&res[4], keys[i]);
+    found.push_back(res);
+  }
 }
@@ -0,0 +1,66 @@
+#ifndef __DES_H__
+#define __DES_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+// internal interface between des.cpp and bitsliced DES(bsdes.cpp)
+// tables are taken
+// from https://en.wikipedia.org/wiki/DES_supplementary_material
+// bits are numbered from 1, bit 1 is the most significant bit of the first
+// byte
+
+// Initial permutation
+const int ip[] = {58, 50, 42, 34, 26, 18, 10, 2, 60, 52, 44, 36, 28, 20, 12, 4,
+                  62, 54, 46, 38, 30, 22, 14, 6, 64, 56, 48, 40, 32, 24, 16, 8,
+                  57, 49, 41, 33, 25, 17, 9,  1, 59, 51, 43, 35, 27, 19, 11, 3,
+                  61, 53, 45, 37, 29, 21, 13, 5, 63, 55, 47, 39, 31, 23, 15, 7};
+
+// Final permutation
+const int ip1[] = {40, 8,  48, 16, 56, 24, 64, 32, 39, 7,  47, 15, 55,
+                   23, 63, 31, 38, 6,  46, 14, 54, 22, 62, 30, 37, 5,
+                   45, 13, 53, 21, 61, 29, 36, 4,  44, 12, 52, 20, 60,
+                   28, 35, 3,  43, 11, 51, 19, 59, 27, 34, 2,  42, 10,
+                   50, 18, 58, 26, 33, 1,  41, 9,  49, 17, 57, 25};
+
+// Expansion
+const int e[] = {32, 1,  2,  3,  4,  5,  4,  5,  6,  7,  8,  9,  8,  9,  10, 11,
+                 12, 13, 12, 13, 14, 15, 16, 17, 16, 17, 18, 19, 20, 21, 20, 21,
+                 22, 23, 24, 25, 24, 25, 26, 27, 28, 29, 28, 29, 30, 31, 32, 1};
+
+// Permutation
+const int p[] = {16, 7, 20, 21, 29, 12, 28, 17, 1,  15, 23, 26, 5,  18, 31, 10,
+                 2,  8, 24, 14, 32, 27, 3,  9,  19, 13, 30, 6,  22, 11, 4,  25};
+
+// key schedule
+const int pc1[] = { // left
+    57, 49, 41, 33, 25, 17, 9, 1, 58, 50, 42, 34, 26, 18, 10, 2, 59, 51, 43, 35,
+    27, 19, 11, 3, 60, 52, 44, 36,
+    // right
+    63, 55, 47, 39, 31, 23, 15, 7, 62, 54, 46, 38, 30, 22, 14, 6, 61, 53, 45,
+    37, 29, 21, 13, 5, 28, 20, 12, 4};
+
+const int pc2[] = {14, 17, 11, 24, 1,  5,  3,  28, 15, 6,  21, 10,
+                   23, 19, 12, 4,  26, 8,  16, 7,  27, 20, 13, 2,
+                   41, 52, 31, 37, 47, 55, 30, 40, 51, 45, 33, 48,
+                   44, 49, 39, 56, 34, 53, 46, 42, 50, 36, 29, 32};
+
+// bitsliced DES, constant time
+// ECB on independent blocks, each block goes through passes(1 for DES, 3 for
+// Triple DES) DES passes between one IP and one IP^-1, pass i with
+// subkeys[i], 16 subkeys in the order of use like des_context
+// 64 blocks at a time, 256 with AVX2
+void bsdes_crypt_blocks(const uint64_t *const subkeys[], int passes,
+                        const uint8_t *input, uint8_t *output, size_t blocks);
+
+// bitsliced known plain text key search, 64 keys at a time, 256 with AVX2
+// blocks and keys are big endian numbers, bit 63 is bit 1 of des.h
+// tries the 2^count keys that agree with key except on the key bits
+// bits[0..count), numbered from 0 like des.h minus 1
+// stores up to max_found keys that encrypt plain to cipher in found, returns
+// the number of such keys
+size_t bsdes_key_search(uint64_t plain, uint64_t cipher, uint64_t key,
+                        const int *bits, int count, uint64_t *found,
+                        size_t max_found);
+
+#endif
@@ -24,6 +24,16 @@ $OPENSSL enc -v -aes-128-cbc -iv 00000000000000000000000000000000 -K e0e0e0e0f1f
 diff input decrypted
 rm output decrypted
 
+# aes256
+$OPENSSL enc -v -aes-256-cbc -iv 00000000000000000000000000000000 -K e0e0e0e0f1f1f1f1e0e0e0e0f1f1f1f1e0e0e0e0f1f1f1f1e0e0e0e0f1f1f1f1 -in input -out output
+./crypto -v -a aes256 -i 00000000000000000000000000000000 -k e0e0e0e0f1f1f1f1e0e0e0e0f1f1f1f1e0e0e0e0f1f1f1f1e0e0e0e0f1f1f1f1 -d output decrypted
+diff input decrypted
+rm output decrypted
+./crypto -v -a aes256 -i 00000000000000000000000000000000 -k e0e0e0e0f1f1f1f1e0e0e0e0f1f1f1f1e0e0e0e0f1f1f1f1e0e0e0e0f1f1f1f1 -e input output
+$OPENSSL enc -v -aes-256-cbc -iv 00000000000000000000000000000000 -K e0e0e0e0f1f1f1f1e0e0e0e0f1f1f1f1e0e0e0e0f1f1f1f1e0e0e0e0f1f1f1f1 -d -in output -out decrypted
+diff input decrypted
+rm output decrypted
+
 # sm4
 $OPENSSL enc -v -sm4-cbc -iv 00000000000000000000000000000000 -K e0e0e0e0f1f1f1f1e0e0e0e0f1f1f1f1 -in input -out output
 ./crypto -v -a sm4 -i 00000000000000000000000000000000 -k e0e0e0e0f1f1f1f1e0e0e0e0f1f1f1f1 -d output decrypted
@@ -34,6 +44,24 @@ $OPENSSL enc -v -sm4-cbc -iv 00000000000000000000000000000000 -K e0e0e0e0f1f1f1f
 diff input decrypted
 rm output decrypted
 
+# aes ctr
+$OPENSSL enc -v -aes-128-ctr -iv 000102030405060708090a0b0c0dfffe -K e0e0e0e0f1f1f1f1e0e0e0e0f1f1f1f1 -in input -out output
+./crypto -v -a aes128-ctr -i 000102030405060708090a0b0c0dfffe -k e0e0e0e0f1f1f1f1e0e0e0e0f1f1f1f1 -d output decrypted
+diff input decrypted
+rm output decrypted
+
+# aes192 ctr
+$OPENSSL enc -v -aes-192-ctr -iv 000102030405060708090a0b0c0dfffe -K e0e0e0e0f1f1f1f1e0e0e0e0f1f1f1f1e0e0e0e0f1f1f1f1 -in input -out output
+./crypto -v -a aes192-ctr -i 000102030405060708090a0b0c0dfffe -k e0e0e0e0f1f1f1f1e0e0e0e0f1f1f1f1e0e0e0e0f1f1f1f1 -d output decrypted
+diff input decrypted
+rm output decrypted
+
+# sm4 ctr
+$OPENSSL enc -v -sm4-ctr -iv 000102030405060708090a0b0c0dfffe -K e0e0e0e0f1f1f1f1e0e0e0e0f1f1f1f1 -in input -out output
+./crypto -v -a sm4-ctr -i 000102030405060708090a0b0c0dfffe -k e0e0e0e0f1f1f1f1e0e0e0e0f1f1f1f1 -d output decrypted
+diff input decrypted
+rm output decrypted
+
 # rc4
 $OPENSSL enc -v -rc4 -K e0e0e0e0f1f1f1f1e0e0e0e0f1f1f1f1 -in input -out output
 ./crypto -v -a rc4 -k e0e0e0e0f1f1f1f1e0e0e0e0f1f1f1f1 -d output decrypted
@@ -0,0 +1,236 @@
+#include "ghash.h"
+#include "util.h"
+#include <cstdlib>
+#include <cstring>
+
+// reference:
+// https://nvlpubs.nist.gov/nistpubs/Legacy/SP/nistspecialpublication800-38d.pdf
+// https://www.intel.com/content/dam/www/public/us/en/documents/white-papers/carry-less-multiplication-instruction-in-gcm-mode-paper.pdf
+// https://github.com/Mbed-TLS/mbedtls/blob/development/library/gcm.c
+
+// GCM bit order: bit 0 of the field element is the MSB of byte 0, so the
+// block is a big endian 128-bit number and multiplication by x is a right
+// shift, reduced by R = 0xE1 || 0^120
+
+// reduction of the 4 bits shifted out by a 4-bit step
+const uint64_t last4[16] = {0x0000, 0x1c20, 0x3840, 0x2460, 0x7080, 0x6ca0,
+                            0x48c0, 0x54e0, 0xe100, 0xfd20, 0xd940, 0xc560,
+                            0x9180, 0x8da0, 0xa9c0, 0xb5e0};
+
+inline uint64_t load_be64(const uint8_t *p) {
+  return ((uint64_t)load_be32(p) << 32) | load_be32(&p[4]);
+}
+
+inline void store_be64(uint8_t *p, uint64_t v) {
+  store_be32(p, v >> 32);
+  store_be32(&p[4], v);
+}
+
+void ghash_init_table(ghash_key &key, const uint8_t h[16]) {
+  uint64_t vh = load_be64(&h[0]);
+  uint64_t vl = load_be64(&h[8]);
+
+  // nibble 0b1000 is x^0, table[8] = H
+  key.table_hi[0] = 0;
+  key.table_lo[0] = 0;
+  key.table_hi[8] = vh;
+  key.table_lo[8] = vl;
+  // table[4] = H * x, table[2] = H * x^2, table[1] = H * x^3
+  for (int i = 4; i > 0; i >>= 1) {
+    uint64_t reduce = (vl & 1) ? 0xe100000000000000ULL : 0;
+    vl = (vh << 63) | (vl >> 1);
+    vh = (vh >> 1) ^ reduce;
+    key.table_hi[i] = vh;
+    key.table_lo[i] = vl;
+  }
+  // the rest by linearity
+  for (int i = 2; i <= 8; i *= 2) {
+    for (int j = 1; j < i; j++) {
+      key.table_hi[i + j] = key.table_hi[i] ^ key.table_hi[j];
+      key.table_lo[i + j] = key.table_lo[i] ^ key.table_lo[j];
+    }
+  }
+}
+
+// x = x * H, 4 bits at a time from the last byte
+void ghash_mul_table(const ghash_key &key, uint8_t x[16]) {
+  int lo = x[15] & 0xf;
+  uint64_t zh = key.table_hi[lo];
+  uint64_t zl = key.table_lo[lo];
+
+  for (int i = 15; i >= 0; i--) {
+    lo = x[i] & 0xf;
+    int hi = (x[i] >> 4) & 0xf;
+
+    if (i != 15) {
+      // z = z * x^4 + table[lo]
+      int rem = zl & 0xf;
+      zl = (zh << 60) | (zl >> 4);
+      zh = (zh >> 4) ^ (last4[rem] << 48);
+      zh ^= key.table_hi[lo];
+      zl ^= key.table_lo[lo];
+    }
+
+    // z = z * x^4 + table[hi]
+    int rem = zl & 0xf;
+    zl = (zh << 60) | (zl >> 4);
+    zh = (zh >> 4) ^ (last4[rem] << 48);
+    zh ^= key.table_hi[hi];
+    zl ^= key.table_lo[hi];
+  }
+
+  store_be64(&x[0], zh);
+  store_be64(&x[8], zl);
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+
+#define CLMUL_TARGET __attribute__((target("pclmul,ssse3")))
+
+// reverse the bytes, so that the field element is a little endian 128-bit
+// number with reflected bits
+CLMUL_TARGET inline __m128i byte_reflect(__m128i x) {
+  const __m128i mask =
+      _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+  return _mm_shuffle_epi8(x, mask);
+}
+
+// 256-bit carry-less product of a and b, not reduced
+CLMUL_TARGET inline void clmul_mul(__m128i a, __m128i b, __m128i &lo,
+                                   __m128i &hi) {
+  __m128i t0 = _mm_clmulepi64_si128(a, b, 0x00);
+  __m128i t1 = _mm_clmulepi64_si128(a, b, 0x10);
+  __m128i t2 = _mm_clmulepi64_si128(a, b, 0x01);
+  __m128i t3 = _mm_clmulepi64_si128(a, b, 0x11);
+  t1 = _mm_xor_si128(t1, t2);
+  lo = _mm_xor_si128(t0, _mm_slli_si128(t1, 8));
+  hi = _mm_xor_si128(t3, _mm_srli_si128(t1, 8));
+}
+
+// reduce a 256-bit product modulo x^128 + x^7 + x^2 + x + 1
+// the product of reflected operands is shifted by one bit first
+CLMUL_TARGET inline __m128i clmul_reduce(__m128i lo, __m128i hi) {
+  // shift [hi:lo] left by 1
+  __m128i t0 = _mm_srli_epi32(lo, 31);
+  __m128i t1 = _mm_srli_epi32(hi, 31);
+  lo = _mm_slli_epi32(lo, 1);
+  hi = _mm_slli_epi32(hi, 1);
+  __m128i t2 = _mm_srli_si128(t0, 12);
+  t1 = _mm_slli_si128(t1, 4);
+  t0 = _mm_slli_si128(t0, 4);
+  lo = _mm_or_si128(lo, t0);
+  hi = _mm_or_si128(hi, t1);
+  hi = _mm_or_si128(hi, t2);
+
+  // first phase
+  t0 = _mm_slli_epi32(lo, 31);
+  t1 = _mm_slli_epi32(lo, 30);
+  t2 = _mm_slli_epi32(lo, 25);
+  t0 = _mm_xor_si128(t0, t1);
+  t0 = _mm_xor_si128(t0, t2);
+  t1 = _mm_srli_si128(t0, 4);
+  t0 = _mm_slli_si128(t0, 12);
+  lo = _mm_xor_si128(lo, t0);
+
+  // second phase
+  t2 = _mm_srli_epi32(lo, 1);
+  t0 = _mm_srli_epi32(lo, 2);
+  __m128i t3 = _mm_srli_epi32(lo, 7);
+  t2 = _mm_xor_si128(t2, t0);
+  t2 = _mm_xor_si128(t2, t3);
+  t2 = _mm_xor_si128(t2, t1);
+  lo = _mm_xor_si128(lo, t2);
+  return _mm_xor_si128(hi, lo);
+}
+
+CLMUL_TARGET inline __m128i clmul_gfmul(__m128i a, __m128i b) {
+  __m128i lo, hi;
+  clmul_mul(a, b, lo, hi);
+  return clmul_reduce(lo, hi);
+}
+
+CLMUL_TARGET void ghash_init_clmul(ghash_key &key, const uint8_t h[16]) {
+  __m128i h1 = byte_reflect(_mm_loadu_si128((const __m128i *)h));
+  __m128i power = h1;
+  for (int i = 0; i < 4; i++) {
+    _mm_storeu_si128((__m128i *)key.h_powers[i], power);
+    power = clmul_gfmul(power, h1);
+  }
+}
+
+CLMUL_TARGET void ghash_update_clmul(const ghash_key &key, uint8_t state[16],
+                                     const uint8_t *input, size_t blocks) {
+  __m128i h1 = _mm_loadu_si128((const __m128i *)key.h_powers[0]);
+  __m128i h2 = _mm_loadu_si128((const __m128i *)key.h_powers[1]);
+  __m128i h3 = _mm_loadu_si128((const __m128i *)key.h_powers[2]);
+  __m128i h4 = _mm_loadu_si128((const __m128i *)key.h_powers[3]);
+  __m128i x = byte_reflect(_mm_loadu_si128((const __m128i *)state));
+
+  size_t i = 0;
+  // aggregated reduction:
+  // X' = (X + C1) H^4 + C2 H^3 + C3 H^2 + C4 H, one reduction per 4 blocks
+  for (; i + 4 <= blocks; i += 4) {
+    __m128i c1 = byte_reflect(_mm_loadu_si128((const __m128i *)&input[i * 16]));
+    __m128i c2 =
+        byte_reflect(_mm_loadu_si128((const __m128i *)&input[i * 16 + 16]));
+    __m128i c3 =
+        byte_reflect(_mm_loadu_si128((const __m128i *)&input[i * 16 + 32]));
+    __m128i c4 =
+        byte_reflect(_mm_loadu_si128((const __m128i *)&input[i * 16 + 48]));
+
+    __m128i lo, hi, lo_sum, hi_sum;
+    clmul_mul(_mm_xor_si128(x, c1), h4, lo_sum, hi_sum);
+    clmul_mul(c2, h3, lo, hi);
+    lo_sum = _mm_xor_si128(lo_sum, lo);
+    hi_sum = _mm_xor_si128(hi_sum, hi);
+    clmul_mul(c3, h2, lo, hi);
+    lo_sum = _mm_xor_si128(lo_sum, lo);
+    hi_sum = _mm_xor_si128(hi_sum, hi);
+    clmul_mul(c4, h1, lo, hi);
+    lo_sum = _mm_xor_si128(lo_sum, lo);
+    hi_sum = _mm_xor_si128(hi_sum, hi);
+    x = clmul_reduce(lo_sum, hi_sum);
+  }
+
+  // tail, one block at a time
+  for (; i < blocks; i++) {
+    __m128i c = byte_reflect(_mm_loadu_si128((const __m128i *)&input[i * 16]));
+    x = clmul_gfmul(_mm_xor_si128(x, c), h1);
+  }
+
+  _mm_storeu_si128((__m128i *)state, byte_reflect(x));
+}
+
+#else
+
+// not available on this architecture, never selected
+void ghash_init_clmul(ghash_key &, const uint8_t[16]) { abort(); }
+
+void ghash_update_clmul(const ghash_key &, uint8_t[16], const uint8_t *,
+                        size_t) {
+  abort();
+}
+
+#endif
+
+void ghash_init(ghash_key &key, const uint8_t h[16], bool clmul) {
+  key.clmul = clmul;
+  if (clmul) {
+    ghash_init_clmul(key, h);
+  } else {
+    ghash_init_table(key, h);
+  }
+}
+
+void ghash_update(const ghash_key &key, uint8_t state[16],
+                  const uint8_t *input, size_t blocks) {
+  if (key.clmul) {
+    ghash_update_clmul(key, state, input, blocks);
+    return;
+  }
+  for (size_t i = 0; i < blocks; i++) {
+    xor_bytes(state, state, &input[i * 16], 16);
+    ghash_mul_table(key, state);
+  }
+}
@@ -0,0 +1,24 @@
+#ifndef __GHASH_H__
+#define __GHASH_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+// GHASH of GCM, multiplication in GF(2^128) by a fixed H
+struct ghash_key {
+  // use PCLMULQDQ
+  bool clmul;
+  // 4-bit table(Shoup): table[i] = i * H, high and low 64 bits
+  uint64_t table_hi[16];
+  uint64_t table_lo[16];
+  // H^1..H^4 in byte reflected order for PCLMULQDQ
+  uint8_t h_powers[4][16];
+};
+
+// clmul: use PCLMULQDQ, callers check cpu_has_pclmul() first
+void ghash_init(ghash_key &key, const uint8_t h[16], bool clmul);
+// state = (state xor block) * H for each block of input
+void ghash_update(const ghash_key &key, uint8_t state[16],
+                  const uint8_t *input, size_t blocks);
+
+#endif
@@ -16,8 +16,10 @@ void usage(char *name) {
   eprintf("         -e: encrypt\n");
   eprintf("         -D: digest\n");
   eprintf("         -l: lfsr\n");
-  eprintf("         -a algo: use algo (one of: des, aes128, sm4, rc4, bm, "
-          "sha224, sha256, sm3, sha3_224, sha3_256, sha3_384, sha3_512)\n");
+  eprintf("         -a algo: use algo (one of: des, des3, des-ctr, aes128, "
+          "aes192, aes256, aes128-ctr, aes192-ctr, aes256-ctr, aes128-gcm, "
+          "aes192-gcm, aes256-gcm, sm4, sm4-ctr, sm4-gcm, rc4, bm, sha224, "
+          "sha256, sm3, sha3_224, sha3_256, sha3_384, sha3_512)\n");
   eprintf("         -k: key in hex\n");
   eprintf("         -i: iv in hex(all 0 when omitted)\n");
   eprintf("         -v: verbose\n");
@@ -121,6 +123,14 @@ int main(int argc, char *argv[]) {
   }
   fclose(fp);
 
+  // aes128, aes192 and aes256 are told apart by the key size
+  if (algo.compare(0, 3, "aes") == 0 && algo.size() >= 6 &&
+      vec_key.size() * 8 != (size_t)atoi(algo.substr(3, 3).c_str())) {
+    eprintf("Key of %s must be %s bits\n", algo.c_str(),
+            algo.substr(3, 3).c_str());
+    return 1;
+  }
+
   if (algo == "des") {
     if (mode == Mode::Encrypt) {
       // pad to 8 bytes
@@ -131,12 +141,22 @@ int main(int argc, char *argv[]) {
       // unpad to 8 bytes
       pkcs7_unpad(vec_output, 8);
     }
-  } else if (algo == "aes128") {
+  } else if (algo == "des3") {
+    if (mode == Mode::Encrypt) {
+      // pad to 8 bytes
+      pkcs7_pad(vec_input, 8);
+    }
+    des3_cbc(mode == Mode::Encrypt, vec_input, vec_key, vec_iv, vec_output);
+    if (mode == Mode::Decrypt) {
+      // unpad to 8 bytes
+      pkcs7_unpad(vec_output, 8);
+    }
+  } else if (algo == "aes128" || algo == "aes192" || algo == "aes256") {
     if (mode == Mode::Encrypt) {
       // pad to 16 bytes
       pkcs7_pad(vec_input, 16);
     }
-    aes128_cbc(mode == Mode::Encrypt, vec_input, vec_key, vec_iv, vec_output);
+    aes_cbc(mode == Mode::Encrypt, vec_input, vec_key, vec_iv, vec_output);
     if (mode == Mode::Decrypt) {
       // unpad to 16 bytes
       pkcs7_unpad(vec_output, 16);
@@ -151,6 +171,45 @@ int main(int argc, char *argv[]) {
       // unpad to 16 bytes
       pkcs7_unpad(vec_output, 16);
     }
+  } else if (algo == "aes128-ctr" || algo == "aes192-ctr" ||
+             algo == "aes256-ctr") {
+    // no padding in ctr mode
+    aes_ctr(vec_input, vec_key, vec_iv, vec_output);
+  } else if (algo == "sm4-ctr") {
+    sm4_ctr(vec_input, vec_key, vec_iv, vec_output);
+  } else if (algo == "des-ctr") {
+    des_ctr(vec_input, vec_key, vec_iv, vec_output);
+  } else if (algo == "aes128-gcm" || algo == "aes192-gcm" ||
+             algo == "aes256-gcm" || algo == "sm4-gcm") {
+    // no aad, the tag is appended to the cipher text
+    std::vector<uint8_t> vec_aad;
+    std::vector<uint8_t> vec_tag;
+    bool sm4 = algo == "sm4-gcm";
+    if (mode == Mode::Encrypt) {
+      if (sm4) {
+        sm4_gcm_encrypt(vec_input, vec_key, vec_iv, vec_aad, vec_output,
+                        vec_tag);
+      } else {
+        aes_gcm_encrypt(vec_input, vec_key, vec_iv, vec_aad, vec_output,
+                        vec_tag);
+      }
+      vec_output.insert(vec_output.end(), vec_tag.begin(), vec_tag.end());
+    } else {
+      if (vec_input.size() < 16) {
+        eprintf("Input too short for the tag\n");
+        return 1;
+      }
+      vec_tag.assign(vec_input.end() - 16, vec_input.end());
+      vec_input.resize(vec_input.size() - 16);
+      bool ok = sm4 ? sm4_gcm_decrypt(vec_input, vec_key, vec_iv, vec_aad,
+                                      vec_tag, vec_output)
+                    : aes_gcm_decrypt(vec_input, vec_key, vec_iv, vec_aad,
+                                      vec_tag, vec_output);
+      if (!ok) {
+        eprintf("Authentication failed\n");
+        return 1;
+      }
+    }
   } else if (algo == "rc4") {
     rc4(vec_input, vec_key, vec_output);
   } else if (algo == "bm") {
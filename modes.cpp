@@ -0,0 +1,488 @@
+#include "modes.h"
+#include "crypto.h"
+#include "ghash.h"
+#include "util.h"
+#include <cassert>
+#include <cstring>
+#include <vector>
+
+// reference:
+// https://nvlpubs.nist.gov/nistpubs/Legacy/SP/nistspecialpublication800-38a.pdf
+// https://nvlpubs.nist.gov/nistpubs/SpecialPublications/NIST.SP.800-38b.pdf
+// https://nvlpubs.nist.gov/nistpubs/Legacy/SP/nistspecialpublication800-38d.pdf
+// https://nvlpubs.nist.gov/nistpubs/Legacy/SP/nistspecialpublication800-38e.pdf
+
+void ctr128_add(uint8_t counter[16], uint64_t n) {
+  // add with carry from the last byte
+  for (int i = 15; i >= 0 && n != 0; i--) {
+    n += counter[i];
+    counter[i] = n & 0xFF;
+    n >>= 8;
+  }
+}
+
+// keystream blocks generated per call of encrypt_blocks
+// enough for the widest kernel(256 blocks of bitsliced SM4 with AVX2)
+const size_t ctr_batch = 256;
+
+// blocks per thread, 64 KiB
+const size_t ctr_chunk = 4096;
+
+// CTR mode on one chunk
+static void ctr128_crypt_chunk(block_fn encrypt_blocks, const void *key,
+                               const uint8_t counter[16], const uint8_t *input,
+                               uint8_t *output, size_t length) {
+  // counter as two 64-bit halves
+  uint64_t counter_hi = ((uint64_t)load_be32(&counter[0]) << 32) |
+                        load_be32(&counter[4]);
+  uint64_t counter_lo = ((uint64_t)load_be32(&counter[8]) << 32) |
+                        load_be32(&counter[12]);
+
+  uint8_t counters[ctr_batch * 16];
+  uint8_t keystream[ctr_batch * 16];
+  for (size_t offset = 0; offset < length; offset += ctr_batch * 16) {
+    size_t bytes = length - offset;
+    if (bytes > ctr_batch * 16) {
+      bytes = ctr_batch * 16;
+    }
+    size_t blocks = (bytes + 15) / 16;
+
+    for (size_t i = 0; i < blocks; i++) {
+      store_be32(&counters[i * 16], counter_hi >> 32);
+      store_be32(&counters[i * 16 + 4], counter_hi);
+      store_be32(&counters[i * 16 + 8], counter_lo >> 32);
+      store_be32(&counters[i * 16 + 12], counter_lo);
+      counter_lo++;
+      if (counter_lo == 0) {
+        counter_hi++;
+      }
+    }
+    encrypt_blocks(key, counters, keystream, blocks);
+
+    // out = in xor E(counter)
+    xor_bytes(&output[offset], &input[offset], keystream, bytes);
+  }
+}
+
+void ctr128_crypt(block_fn encrypt_blocks, const void *key,
+                  const uint8_t iv[16], const uint8_t *input, uint8_t *output,
+                  size_t length) {
+  size_t chunks = (length + ctr_chunk * 16 - 1) / (ctr_chunk * 16);
+
+  // the counter of each chunk is known in advance
+  // so chunks can be processed in any order
+#pragma omp parallel for if (chunks > 1)
+  for (size_t chunk = 0; chunk < chunks; chunk++) {
+    size_t offset = chunk * ctr_chunk * 16;
+    size_t bytes = length - offset;
+    if (bytes > ctr_chunk * 16) {
+      bytes = ctr_chunk * 16;
+    }
+
+    uint8_t counter[16];
+    memcpy(counter, iv, 16);
+    ctr128_add(counter, chunk * ctr_chunk);
+    ctr128_crypt_chunk(encrypt_blocks, key, counter, &input[offset],
+                       &output[offset], bytes);
+  }
+}
+
+// multi-stream CBC on messages [begin, end)
+static void cbc128_encrypt_streams(cbc_multi_fn encrypt_streams, size_t width,
+                                   const cbc_stream *streams, size_t begin,
+                                   size_t end) {
+  // position and blocks left of each stream, active ones first
+  const uint8_t *input[8];
+  uint8_t *output[8];
+  size_t left[8];
+  const void *keys[8];
+  uint8_t *mac[8];
+  const uint8_t *last[8];
+  // last cipher text of each stream
+  uint8_t chain[8 * 16];
+  size_t active = 0;
+  size_t next = begin;
+
+  while (true) {
+    // refill idle streams
+    for (; active < width && next < end; next++) {
+      if (streams[next].blocks == 0 && streams[next].last == nullptr) {
+        continue;
+      }
+      input[active] = streams[next].input;
+      output[active] = streams[next].output;
+      left[active] = streams[next].blocks;
+      keys[active] = streams[next].key;
+      mac[active] = streams[next].mac;
+      last[active] = streams[next].last;
+      if (left[active] == 0) {
+        input[active] = last[active];
+        left[active] = 1;
+        last[active] = nullptr;
+      }
+      memcpy(&chain[active * 16], streams[next].iv, 16);
+      active++;
+    }
+    if (active == 0) {
+      break;
+    }
+
+    // run all streams until the shortest one finishes
+    size_t blocks = left[0];
+    for (size_t i = 1; i < active; i++) {
+      if (left[i] < blocks) {
+        blocks = left[i];
+      }
+    }
+    // CBC-MAC when there is no cipher text, active streams are never empty
+    bool mac_only = output[0] == nullptr;
+    encrypt_streams(keys, chain, input, mac_only ? nullptr : output, active,
+                    blocks);
+
+    for (size_t i = 0; i < active;) {
+      input[i] += blocks * 16;
+      if (!mac_only) {
+        output[i] += blocks * 16;
+      }
+      left[i] -= blocks;
+      if (left[i] == 0 && last[i] != nullptr) {
+        input[i] = last[i];
+        left[i] = 1;
+        last[i] = nullptr;
+      }
+      if (left[i] > 0) {
+        i++;
+        continue;
+      }
+      if (mac[i] != nullptr) {
+        memcpy(mac[i], &chain[i * 16], 16);
+      }
+      // finished, move the last active stream here
+      active--;
+      input[i] = input[active];
+      output[i] = output[active];
+      left[i] = left[active];
+      keys[i] = keys[active];
+      mac[i] = mac[active];
+      last[i] = last[active];
+      memcpy(&chain[i * 16], &chain[active * 16], 16);
+    }
+  }
+}
+
+void cbc128_encrypt_multi(cbc_multi_fn encrypt_streams, size_t width,
+                          const cbc_stream *streams, size_t count) {
+  assert(width >= 1 && width <= 8);
+
+  // cut the messages into ranges of about ctr_chunk blocks for threads
+  std::vector<size_t> ranges = {0};
+  size_t blocks = 0;
+  for (size_t i = 0; i < count; i++) {
+    blocks += streams[i].blocks + (streams[i].last != nullptr ? 1 : 0);
+    if (blocks >= ctr_chunk) {
+      ranges.push_back(i + 1);
+      blocks = 0;
+    }
+  }
+  if (ranges.back() != count) {
+    ranges.push_back(count);
+  }
+
+  size_t count_ranges = ranges.size() - 1;
+#pragma omp parallel for if (count_ranges > 1)
+  for (size_t i = 0; i < count_ranges; i++) {
+    cbc128_encrypt_streams(encrypt_streams, width, streams, ranges[i],
+                           ranges[i + 1]);
+  }
+}
+
+// blocks decrypted per call of decrypt_blocks
+// a full batch of the widest bitsliced kernels
+const size_t cbc_batch = 256;
+
+void cbc_decrypt(block_fn decrypt_blocks, const void *key, size_t block_size,
+                 const uint8_t *iv, const uint8_t *input, uint8_t *output,
+                 size_t blocks) {
+  assert(block_size <= 16);
+  uint8_t buffer[cbc_batch * 16];
+  uint8_t cur_iv[16];
+  memcpy(cur_iv, iv, block_size);
+  for (size_t block = 0; block < blocks; block += cbc_batch) {
+    size_t count = blocks - block < cbc_batch ? blocks - block : cbc_batch;
+    const uint8_t *in = &input[block * block_size];
+    uint8_t *out = &output[block * block_size];
+    decrypt_blocks(key, in, buffer, count);
+    // xor with last cipher text, each cipher text block is read before its
+    // plain text is written
+    for (size_t offset = 0; offset < count * block_size; offset += block_size) {
+      for (size_t i = 0; i < block_size; i++) {
+        uint8_t cipher = in[offset + i];
+        out[offset + i] = buffer[offset + i] ^ cur_iv[i];
+        cur_iv[i] = cipher;
+      }
+    }
+  }
+}
+
+// x * 2 in GF(2^128) of CMAC, big endian, modulo x^128 + x^7 + x^2 + x + 1
+static void cmac128_double(const uint8_t input[16], uint8_t output[16]) {
+  uint8_t carry = input[0] >> 7;
+  for (int i = 0; i < 15; i++) {
+    output[i] = (input[i] << 1) | (input[i + 1] >> 7);
+  }
+  output[15] = (input[15] << 1) ^ (carry ? 0x87 : 0);
+}
+
+void cmac_start(cmac_state &state) {
+  memset(state.mac, 0, 16);
+  state.buffered = 0;
+}
+
+void cmac128_subkeys(block_fn encrypt_blocks, const void *key, uint8_t k1[16],
+                     uint8_t k2[16]) {
+  uint8_t l[16] = {0};
+  encrypt_blocks(key, l, l, 1);
+  cmac128_double(l, k1);
+  cmac128_double(k1, k2);
+}
+
+void cmac128_update(cbc_mac_fn mac_blocks, const void *key, cmac_state &state,
+                    const uint8_t *input, size_t length) {
+  // the last block of the message is held back in buffer for cmac128_final,
+  // so a block is only processed when more input follows it
+  if (state.buffered > 0 && length > 16 - state.buffered) {
+    size_t bytes = 16 - state.buffered;
+    memcpy(&state.buffer[state.buffered], input, bytes);
+    mac_blocks(key, state.mac, state.buffer, 1);
+    state.buffered = 0;
+    input += bytes;
+    length -= bytes;
+  }
+  if (state.buffered == 0 && length > 16) {
+    // full blocks straight from input, keep at least one byte
+    size_t blocks = (length - 1) / 16;
+    mac_blocks(key, state.mac, input, blocks);
+    input += blocks * 16;
+    length -= blocks * 16;
+  }
+  memcpy(&state.buffer[state.buffered], input, length);
+  state.buffered += length;
+}
+
+// the last block xor K1 if complete, padded with 10* xor K2 otherwise
+static void cmac128_last_block(const uint8_t k1[16], const uint8_t k2[16],
+                               const uint8_t *input, size_t length,
+                               uint8_t block[16]) {
+  if (length == 16) {
+    xor_bytes(block, input, k1, 16);
+  } else {
+    uint8_t padded[16] = {0};
+    memcpy(padded, input, length);
+    padded[length] = 0x80;
+    xor_bytes(block, padded, k2, 16);
+  }
+}
+
+void cmac128_final(cbc_mac_fn mac_blocks, const void *key,
+                   const uint8_t k1[16], const uint8_t k2[16],
+                   const cmac_state &state, uint8_t tag[16]) {
+  uint8_t block[16];
+  cmac128_last_block(k1, k2, state.buffer, state.buffered, block);
+  memcpy(tag, state.mac, 16);
+  mac_blocks(key, tag, block, 1);
+}
+
+void cmac128_multi(cbc_multi_fn mac_streams, size_t width,
+                   const cmac_stream *streams, size_t count) {
+  // CBC-MAC of all blocks but the last one straight from input, then the last
+  // block with the subkey applied
+  const uint8_t zero[16] = {0};
+  std::vector<uint8_t> last(count * 16);
+  std::vector<cbc_stream> cbc(count);
+  for (size_t i = 0; i < count; i++) {
+    const cmac_stream &stream = streams[i];
+    size_t blocks = stream.length == 0 ? 0 : (stream.length - 1) / 16;
+    cmac128_last_block(stream.k1, stream.k2, &stream.input[blocks * 16],
+                       stream.length - blocks * 16, &last[i * 16]);
+    cbc[i] = {stream.key, zero,       stream.input, nullptr,
+              blocks,     stream.tag, &last[i * 16]};
+  }
+  cbc128_encrypt_multi(mac_streams, width, cbc.data(), count);
+}
+
+// GHASH of data, the last partial block is padded with zeros
+static void ghash_padded(const ghash_key &key, uint8_t state[16],
+                         const uint8_t *data, size_t length) {
+  ghash_update(key, state, data, length / 16);
+  if (length % 16) {
+    uint8_t block[16] = {0};
+    memcpy(block, &data[length / 16 * 16], length % 16);
+    ghash_update(key, state, block, 1);
+  }
+}
+
+// GHASH of the lengths in bits, as two 64-bit big endian numbers
+static void ghash_lengths(const ghash_key &key, uint8_t state[16],
+                          uint64_t a_bytes, uint64_t b_bytes) {
+  uint8_t block[16];
+  store_be32(&block[0], (a_bytes * 8) >> 32);
+  store_be32(&block[4], a_bytes * 8);
+  store_be32(&block[8], (b_bytes * 8) >> 32);
+  store_be32(&block[12], b_bytes * 8);
+  ghash_update(key, state, block, 1);
+}
+
+void gcm128_crypt(bool encrypt, block_fn encrypt_blocks, const void *key,
+                  bool clmul, const uint8_t *iv, size_t iv_length,
+                  const uint8_t *aad, size_t aad_length, const uint8_t *input,
+                  uint8_t *output, size_t length, uint8_t tag[16]) {
+  // H = E(0^128)
+  uint8_t h[16] = {0};
+  encrypt_blocks(key, h, h, 1);
+  ghash_key hash_key;
+  ghash_init(hash_key, h, clmul);
+
+  // pre-counter block J0
+  uint8_t j0[16] = {0};
+  if (iv_length == 12) {
+    // IV || 0^31 || 1
+    memcpy(j0, iv, 12);
+    j0[15] = 1;
+  } else {
+    // GHASH(IV || 0^s || 0^64 || len(IV))
+    ghash_padded(hash_key, j0, iv, iv_length);
+    ghash_lengths(hash_key, j0, 0, iv_length);
+  }
+
+  uint8_t state[16] = {0};
+  ghash_padded(hash_key, state, aad, aad_length);
+
+  // only the last 32 bits of the counter are incremented(inc32)
+  uint32_t counter_lo = load_be32(&j0[12]) + 1;
+  uint8_t counters[ctr_batch * 16];
+  uint8_t keystream[ctr_batch * 16];
+  for (size_t i = 0; i < ctr_batch; i++) {
+    memcpy(&counters[i * 16], j0, 12);
+  }
+
+  // one pass: the batch of cipher text is hashed while still in cache
+  for (size_t offset = 0; offset < length; offset += ctr_batch * 16) {
+    size_t bytes = length - offset;
+    if (bytes > ctr_batch * 16) {
+      bytes = ctr_batch * 16;
+    }
+    size_t blocks = (bytes + 15) / 16;
+
+    for (size_t i = 0; i < blocks; i++) {
+      store_be32(&counters[i * 16 + 12], counter_lo++);
+    }
+    encrypt_blocks(key, counters, keystream, blocks);
+
+    if (encrypt) {
+      xor_bytes(&output[offset], &input[offset], keystream, bytes);
+      ghash_padded(hash_key, state, &output[offset], bytes);
+    } else {
+      // hash first, input and output may be the same buffer
+      ghash_padded(hash_key, state, &input[offset], bytes);
+      xor_bytes(&output[offset], &input[offset], keystream, bytes);
+    }
+  }
+
+  // T = E(J0) xor GHASH(A || C || len(A) || len(C))
+  ghash_lengths(hash_key, state, aad_length, length);
+  encrypt_blocks(key, j0, tag, 1);
+  xor_bytes(tag, tag, state, 16);
+}
+
+bool gcm128_decrypt(block_fn encrypt_blocks, const void *key, bool clmul,
+                    const std::vector<uint8_t> &input,
+                    const std::vector<uint8_t> &iv,
+                    const std::vector<uint8_t> &aad,
+                    const std::vector<uint8_t> &tag,
+                    std::vector<uint8_t> &output) {
+  assert(iv.size() > 0);
+  output.resize(input.size());
+
+  uint8_t expected[16];
+  gcm128_crypt(false, encrypt_blocks, key, clmul, iv.data(), iv.size(),
+               aad.data(), aad.size(), input.data(), output.data(),
+               input.size(), expected);
+
+  // compare in constant time
+  uint8_t diff = tag.size() != 16;
+  for (size_t i = 0; i < 16 && i < tag.size(); i++) {
+    diff |= tag[i] ^ expected[i];
+  }
+  if (diff) {
+    // never release unauthenticated plain text
+    output.clear();
+    return false;
+  }
+  return true;
+}
+
+// XTS mode on one sector
+static void xts128_crypt_sector(block_fn crypt_blocks, const void *key,
+                                const uint8_t tweak[16], const uint8_t *input,
+                                uint8_t *output, size_t length) {
+  // tweak as two 64-bit little endian halves
+  uint64_t tweak_lo = ((uint64_t)load_le32(&tweak[4]) << 32) |
+                      load_le32(&tweak[0]);
+  uint64_t tweak_hi = ((uint64_t)load_le32(&tweak[12]) << 32) |
+                      load_le32(&tweak[8]);
+
+  uint8_t tweaks[ctr_batch * 16];
+  uint8_t buffer[ctr_batch * 16];
+  for (size_t offset = 0; offset < length; offset += ctr_batch * 16) {
+    size_t bytes = length - offset;
+    if (bytes > ctr_batch * 16) {
+      bytes = ctr_batch * 16;
+    }
+    size_t blocks = bytes / 16;
+
+    for (size_t i = 0; i < blocks; i++) {
+      store_le32(&tweaks[i * 16], tweak_lo);
+      store_le32(&tweaks[i * 16 + 4], tweak_lo >> 32);
+      store_le32(&tweaks[i * 16 + 8], tweak_hi);
+      store_le32(&tweaks[i * 16 + 12], tweak_hi >> 32);
+      // T = T * alpha in GF(2^128), x^128 = x^7 + x^2 + x + 1
+      uint64_t carry = tweak_hi >> 63;
+      tweak_hi = (tweak_hi << 1) | (tweak_lo >> 63);
+      tweak_lo = (tweak_lo << 1) ^ (0x87 & (0 - carry));
+    }
+
+    // out = E(in xor T) xor T, the whole batch in one call
+    xor_bytes(buffer, &input[offset], tweaks, bytes);
+    crypt_blocks(key, buffer, buffer, blocks);
+    xor_bytes(&output[offset], buffer, tweaks, bytes);
+  }
+}
+
+void xts128_crypt(block_fn crypt_blocks, const void *key,
+                  block_fn encrypt_tweak, const void *tweak_key,
+                  uint64_t first_sector, size_t sector_size,
+                  const uint8_t *input, uint8_t *output, size_t length) {
+  // no cipher text stealing
+  assert(sector_size > 0 && (sector_size % 16) == 0);
+  assert((length % 16) == 0);
+  size_t sectors = (length + sector_size - 1) / sector_size;
+
+  // the tweak of each sector only depends on the sector number
+#pragma omp parallel for if (length > ctr_chunk * 16 && sectors > 1)
+  for (size_t i = 0; i < sectors; i++) {
+    size_t offset = i * sector_size;
+    size_t bytes = length - offset;
+    if (bytes > sector_size) {
+      bytes = sector_size;
+    }
+
+    // T = E(K2, sector number as a 128-bit little endian number)
+    uint64_t sector = first_sector + i;
+    uint8_t tweak[16] = {0};
+    store_le32(&tweak[0], sector);
+    store_le32(&tweak[4], sector >> 32);
+    encrypt_tweak(tweak_key, tweak, tweak, 1);
+    xts128_crypt_sector(crypt_blocks, key, tweak, &input[offset],
+                        &output[offset], bytes);
+  }
+}
@@ -0,0 +1,121 @@
+#ifndef __MODES_H__
+#define __MODES_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// block cipher modes shared by AES and SM4(128-bit blocks)
+// cbc_decrypt also serves DES(64-bit blocks)
+
+// encrypt or decrypt independent blocks(ECB) with an expanded key
+typedef void (*block_fn)(const void *key, const uint8_t *input,
+                         uint8_t *output, size_t blocks);
+
+// CBC encryption of the same number of blocks in several streams, stream i
+// with keys[i] from input[i] to output[i], ivs[i * 16] is its last cipher text
+// streams is at most the width passed to cbc128_encrypt_multi
+// output is null for CBC-MAC, only ivs is updated then
+typedef void (*cbc_multi_fn)(const void *const keys[], uint8_t *ivs,
+                             const uint8_t *const input[],
+                             uint8_t *const output[], size_t streams,
+                             size_t blocks);
+
+// CBC-MAC of one stream: mac = E(mac ^ block) for each block, no output
+typedef void (*cbc_mac_fn)(const void *key, uint8_t mac[16],
+                           const uint8_t *input, size_t blocks);
+
+// counter += n, as a 128-bit big endian number
+void ctr128_add(uint8_t counter[16], uint64_t n);
+
+// CTR mode, the counter starts from iv and is incremented as a 128-bit big
+// endian number
+// large inputs are split into counter-aligned chunks for multiple threads
+void ctr128_crypt(block_fn encrypt_blocks, const void *key,
+                  const uint8_t iv[16], const uint8_t *input, uint8_t *output,
+                  size_t length);
+
+// GCM mode, returns the 16-byte tag in tag
+// ciphertext is authenticated in the same pass as the keystream
+// clmul: use PCLMULQDQ for GHASH, see ghash_init
+void gcm128_crypt(bool encrypt, block_fn encrypt_blocks, const void *key,
+                  bool clmul, const uint8_t *iv, size_t iv_length,
+                  const uint8_t *aad, size_t aad_length, const uint8_t *input,
+                  uint8_t *output, size_t length, uint8_t tag[16]);
+
+// GCM decryption checked against tag, output is resized to input
+// on a mismatch output is cleared and false is returned, unauthenticated
+// plain text is never released
+bool gcm128_decrypt(block_fn encrypt_blocks, const void *key, bool clmul,
+                    const std::vector<uint8_t> &input,
+                    const std::vector<uint8_t> &iv,
+                    const std::vector<uint8_t> &aad,
+                    const std::vector<uint8_t> &tag,
+                    std::vector<uint8_t> &output);
+
+// XTS mode(IEEE 1619) over consecutive sectors starting at first_sector
+// crypt_blocks encrypts or decrypts with the data key, encrypt_tweak
+// encrypts the sector number with the tweak key
+// sector_size and length must be multiples of 16, the last sector may be
+// shorter than sector_size
+// sectors are independent and split among threads for large inputs
+void xts128_crypt(block_fn crypt_blocks, const void *key,
+                  block_fn encrypt_tweak, const void *tweak_key,
+                  uint64_t first_sector, size_t sector_size,
+                  const uint8_t *input, uint8_t *output, size_t length);
+
+// one message of a multi-stream CBC encryption
+// output is null for CBC-MAC, for all messages of a call or none
+// mac receives the last cipher text if not null
+// last is one more block after the blocks of input if not null
+struct cbc_stream {
+  const void *key;
+  const uint8_t *iv;
+  const uint8_t *input;
+  uint8_t *output;
+  size_t blocks;
+  uint8_t *mac;
+  const uint8_t *last;
+};
+
+// CBC encryption of many independent messages
+// up to width(at most 8) messages advance together in encrypt_streams, so the
+// latency of one chain hides behind the others
+// a finished message hands its stream to the next one
+// large batches are split among threads by message
+void cbc128_encrypt_multi(cbc_multi_fn encrypt_streams, size_t width,
+                          const cbc_stream *streams, size_t count);
+
+// CBC decryption of blocks of block_size bytes(at most 16)
+// decrypt_blocks decrypts independent blocks, input and output may be the same
+void cbc_decrypt(block_fn decrypt_blocks, const void *key, size_t block_size,
+                 const uint8_t *iv, const uint8_t *input, uint8_t *output,
+                 size_t blocks);
+
+// CMAC(NIST SP 800-38B), see cmac_state in crypto.h
+struct cmac_state;
+// K1 = 2 L and K2 = 4 L in GF(2^128), L = E(0)
+void cmac128_subkeys(block_fn encrypt_blocks, const void *key, uint8_t k1[16],
+                     uint8_t k2[16]);
+void cmac128_update(cbc_mac_fn mac_blocks, const void *key, cmac_state &state,
+                    const uint8_t *input, size_t length);
+void cmac128_final(cbc_mac_fn mac_blocks, const void *key,
+                   const uint8_t k1[16], const uint8_t k2[16],
+                   const cmac_state &state, uint8_t tag[16]);
+
+// one message of a CMAC batch, k1 and k2 from cmac128_subkeys
+struct cmac_stream {
+  const void *key;
+  const uint8_t *k1;
+  const uint8_t *k2;
+  const uint8_t *input;
+  size_t length;
+  uint8_t *tag;
+};
+
+// CMAC of many independent messages, the CBC-MAC chains advance together in
+// mac_streams like cbc128_encrypt_multi
+void cmac128_multi(cbc_multi_fn mac_streams, size_t width,
+                   const cmac_stream *streams, size_t count);
+
+#endif
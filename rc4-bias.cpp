@@ -0,0 +1,269 @@
+#include "crypto.h"
+#include "util.h"
+#include <algorithm>
+#include <math.h>
+#include <omp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <vector>
+
+// RC4 keystream biases over many random keys, for auditing protocols
+// counts each of the first bytes of the keystream by position, e.g. the
+// second byte is 0 twice as often as it should be (Mantin and Shamir), and
+// the digraphs of consecutive bytes by the i of RC4 at the first byte, as each
+// bias of Fluhrer and McGrew holds for some values of i only, e.g. (0, 0) at
+// i = 1 and (255, 255) at all i but 254
+// the keys only depend on the seed and their index, so the counts are the
+// same for any number of threads, a small run to check:
+// rc4-bias -n 1000000 -b 16 -s 1
+
+#define eprintf(...) fprintf(stderr, __VA_ARGS__)
+
+void usage(char *name) {
+  eprintf("Usage: %s OPTIONS\n", name);
+  eprintf("       OPTIONS:\n");
+  eprintf("         -n: number of keys(default 1000000)\n");
+  eprintf("         -l: key length in bytes(default 16)\n");
+  eprintf("         -b: keystream bytes counted per key(default 256)\n");
+  eprintf("         -d: keystream bytes dropped before counting(default 0)\n");
+  eprintf("         -s: seed of the keys(default 0)\n");
+  eprintf("         -t: number of biases reported(default 10)\n");
+}
+
+// the splitmix64 sequence of the seed
+uint64_t splitmix64(uint64_t &state) {
+  uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+// key number index takes the next words of the sequence after the keys
+// before it
+void make_key(uint64_t seed, uint64_t index, std::vector<uint8_t> &key) {
+  uint64_t words = (key.size() + 7) / 8;
+  uint64_t state = seed + index * words * 0x9e3779b97f4a7c15ULL;
+  for (size_t i = 0; i < key.size(); i += 8) {
+    uint64_t word = splitmix64(state);
+    for (size_t j = i; j < i + 8 && j < key.size(); j++) {
+      key[j] = word >> (8 * (j - i));
+    }
+  }
+}
+
+struct bias {
+  // position of the byte from 1, or i of the first byte of the digraph
+  size_t position;
+  // the byte, or the digraph as first << 8 | second
+  int value;
+  uint64_t count;
+  double expected;
+  double z;
+};
+
+// larger |z| first, ties in the order of the cells, so the report is
+// deterministic
+bool stronger(const bias &a, const bias &b) {
+  if (fabs(a.z) != fabs(b.z)) {
+    return fabs(a.z) > fabs(b.z);
+  }
+  return a.position < b.position ||
+         (a.position == b.position && a.value < b.value);
+}
+
+// the cells with the largest |z|, the cells are numbered position << bits |
+// value, each of probability p out of trials[position], positions without
+// trials are skipped
+std::vector<bias> largest_biases(const std::vector<uint64_t> &counts,
+                                 int bits, size_t first_position,
+                                 const std::vector<uint64_t> &trials,
+                                 double p, size_t top) {
+  // the top cells so far in a heap, the weakest at the front
+  std::vector<bias> biases;
+  for (size_t i = 0; i < counts.size() && top > 0; i++) {
+    uint64_t n = trials[i >> bits];
+    if (n == 0) {
+      continue;
+    }
+    double expected = n * p;
+    double z = (counts[i] - expected) / sqrt(n * p * (1 - p));
+    bias b = {first_position + (i >> bits), (int)(i & ((1 << bits) - 1)),
+              counts[i], expected, z};
+    if (biases.size() < top) {
+      biases.push_back(b);
+      std::push_heap(biases.begin(), biases.end(), stronger);
+    } else if (stronger(b, biases.front())) {
+      std::pop_heap(biases.begin(), biases.end(), stronger);
+      biases.back() = b;
+      std::push_heap(biases.begin(), biases.end(), stronger);
+    }
+  }
+  std::sort_heap(biases.begin(), biases.end(), stronger);
+  return biases;
+}
+
+// two-sided p value of z under the normal approximation, times the number of
+// cells tested(Bonferroni)
+double p_value(double z, size_t cells) {
+  double p = erfc(fabs(z) / sqrt(2.0)) * cells;
+  return p < 1 ? p : 1;
+}
+
+int main(int argc, char *argv[]) {
+  int c;
+  uint64_t keys = 1000000;
+  size_t key_length = 16;
+  size_t bytes = 256;
+  size_t drop = 0;
+  uint64_t seed = 0;
+  size_t top = 10;
+  while ((c = getopt(argc, argv, "b:d:l:n:s:t:")) != -1) {
+    switch (c) {
+    case 'b':
+      bytes = strtoull(optarg, NULL, 0);
+      break;
+    case 'd':
+      drop = strtoull(optarg, NULL, 0);
+      break;
+    case 'l':
+      key_length = strtoull(optarg, NULL, 0);
+      break;
+    case 'n':
+      keys = strtoull(optarg, NULL, 0);
+      break;
+    case 's':
+      seed = strtoull(optarg, NULL, 0);
+      break;
+    case 't':
+      top = strtoull(optarg, NULL, 0);
+      break;
+    default:
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  if (key_length < 1 || key_length > 256 || bytes < 2 || keys < 1) {
+    eprintf("Keys must be 1 to 256 bytes, at least 2 bytes and 1 key are "
+            "counted\n");
+    usage(argv[0]);
+    return 1;
+  }
+  printf("%llu keys of %zu bytes, seed %llu, counting bytes %zu to %zu\n",
+         (unsigned long long)keys, key_length, (unsigned long long)seed,
+         drop + 1, drop + bytes);
+
+  // keys are handed out in chunks, each encrypted by one rc4_batch call
+  const uint64_t chunk = 1024;
+  // keystreams of a group of chunks are generated, then counted, about 2 MiB
+  // so they stay in cache while the counts of each i are taken
+  uint64_t group = std::max<uint64_t>(1, (2 << 20) / bytes / chunk) * chunk;
+
+  // byte_counts[r * 256 + v]: byte r is v
+  std::vector<uint64_t> byte_counts(bytes * 256);
+  // digraph_counts[i << 16 | a << 8 | b]: b follows a, a output at i
+  // a single table of 128 MiB, each thread counts the positions of its own
+  // range of i
+  std::vector<uint64_t> digraph_counts(256 * 65536);
+
+  // the keystream is the encryption of zeros
+  std::vector<uint8_t> zeros(bytes);
+  std::vector<std::vector<uint8_t>> keystreams(std::min(group, keys));
+
+  uint64_t begin = get_time_us();
+  uint64_t last_report = begin;
+
+  for (uint64_t first = 0; first < keys; first += group) {
+    uint64_t count = keys - first < group ? keys - first : group;
+    uint64_t chunks = (count + chunk - 1) / chunk;
+#pragma omp parallel
+    {
+      std::vector<std::vector<uint8_t>> chunk_keys(
+          chunk, std::vector<uint8_t>(key_length));
+      std::vector<rc4_job> jobs;
+#pragma omp for schedule(dynamic)
+      for (uint64_t c = 0; c < chunks; c++) {
+        uint64_t start = c * chunk;
+        uint64_t end = std::min(start + chunk, count);
+        jobs.clear();
+        for (uint64_t k = start; k < end; k++) {
+          make_key(seed, first + k, chunk_keys[k - start]);
+          jobs.push_back({&chunk_keys[k - start], &zeros, &keystreams[k]});
+        }
+        // already inside a parallel region, rc4_batch runs on this thread
+        rc4_batch(jobs, drop);
+      }
+
+      // i of byte r is (drop + r + 1) mod 256, thread t counts the bytes and
+      // digraphs at i in [i0, i1), one i at a time, so its 512 KiB of
+      // digraph counts stay in cache
+      int threads = omp_get_num_threads();
+      int thread = omp_get_thread_num();
+      size_t i0 = 256 * thread / threads;
+      size_t i1 = 256 * (thread + 1) / threads;
+      for (size_t i = i0; i < i1; i++) {
+        for (uint64_t k = 0; k < count; k++) {
+          const uint8_t *z = keystreams[k].data();
+          for (size_t r = (i - drop - 1) & 255; r < bytes; r += 256) {
+            byte_counts[r * 256 + z[r]]++;
+            if (r + 1 < bytes) {
+              digraph_counts[i << 16 | z[r] << 8 | z[r + 1]]++;
+            }
+          }
+        }
+      }
+    }
+
+    // progress every 10 seconds
+    uint64_t now = get_time_us();
+    if (now - last_report > 10000000) {
+      last_report = now;
+      uint64_t done = first + count;
+      double elapsed = (now - begin) / 1000000.0;
+      eprintf("%.2lf%% done, %.0lf keys/s, elapsed %.2lf s\n",
+              100.0 * done / keys, done / elapsed, elapsed);
+    }
+  }
+
+  double elapsed = (get_time_us() - begin) / 1000000.0;
+  printf("%llu keys, %.0lf keys/s, %.0lf MiB/s of keystream, elapsed %.2lf "
+         "s\n",
+         (unsigned long long)keys, keys / elapsed,
+         (double)keys * (drop + bytes) / elapsed / 1024.0 / 1024.0, elapsed);
+
+  std::vector<uint64_t> byte_trials(bytes, keys);
+  printf("Byte biases, largest |z| of %zu cells, p corrected for all "
+         "cells:\n",
+         byte_counts.size());
+  for (auto &b : largest_biases(byte_counts, 8, drop + 1, byte_trials,
+                                1.0 / 256, top)) {
+    printf("  byte %zu = 0x%02x: %llu times, %.4lf of expected, z = %.2lf, "
+           "p = %.3g\n",
+           b.position, b.value, (unsigned long long)b.count,
+           b.count / b.expected, b.z, p_value(b.z, byte_counts.size()));
+  }
+
+  // digraphs at each i, consecutive digraphs overlap, the normal
+  // approximation is close enough to rank them
+  std::vector<uint64_t> digraph_trials(256);
+  for (size_t r = 0; r + 1 < bytes; r++) {
+    digraph_trials[(drop + r + 1) & 255] += keys;
+  }
+  size_t digraph_cells = 0;
+  for (uint64_t n : digraph_trials) {
+    digraph_cells += n > 0 ? 65536 : 0;
+  }
+  printf("Digraph biases by i of the first byte, largest |z| of %zu "
+         "cells:\n",
+         digraph_cells);
+  for (auto &b : largest_biases(digraph_counts, 16, 0, digraph_trials,
+                                1.0 / 65536, top)) {
+    printf("  i = %zu, (0x%02x, 0x%02x): %llu times, %.4lf of expected, z = "
+           "%.2lf, p = %.3g\n",
+           b.position, b.value >> 8, b.value & 0xff,
+           (unsigned long long)b.count, b.count / b.expected, b.z,
+           p_value(b.z, digraph_cells));
+  }
+  return 0;
+}
@@ -1,34 +1,264 @@
 #include "crypto.h"
+#include "util.h"
+#include <algorithm>
 #include <cassert>
+#include <cstring>
 
-void rc4(const std::vector<uint8_t> &input, const std::vector<uint8_t> &key,
-         std::vector<uint8_t> &output) {
-  assert(key.size() <= 256);
-  output.resize(input.size());
+// keystream is generated a block at a time, then xored in one pass
+static const size_t rc4_block = 256;
+
+// one step of the generator with i already advanced, x holds s[i] on entry
+// and s[i + 1] on return
+// s[i + 1] is loaded before the swap and fixed up when j == i + 1: a load
+// after the store to s[j] would have to wait for j, or the cpu guesses and
+// pays for the rare alias
+static inline void rc4_step(uint8_t *s, uint8_t i, uint8_t &j, uint8_t &x,
+                            uint8_t *output) {
+  uint8_t i1 = i + 1;
+  j += x;
+  uint8_t sj = s[j];
+  uint8_t next = s[i1];
+  s[i] = sj;
+  s[j] = x;
+  *output = s[(uint8_t)(x + sj)];
+  x = j == i1 ? x : next;
+}
+
+// one step of key scheduling, x like rc4_step
+static inline void rc4_ksa_step(uint8_t *s, uint8_t i, uint8_t &j, uint8_t &x,
+                                uint8_t key) {
+  uint8_t i1 = i + 1;
+  j += x + key;
+  uint8_t sj = s[j];
+  uint8_t next = s[i1];
+  s[i] = sj;
+  s[j] = x;
+  x = j == i1 ? x : next;
+}
+
+// pseudo random generation of the next length bytes of keystream
+static void rc4_keystream(rc4_context &ctx, uint8_t *output, size_t length) {
+  uint8_t *s = ctx.s;
+  // the indices wrap around as uint8_t
+  uint8_t i = ctx.i;
+  uint8_t j = ctx.j;
+  uint8_t x = s[(uint8_t)(i + 1)];
+  for (size_t k = 0; k < length; k++) {
+    i++;
+    rc4_step(s, i, j, x, &output[k]);
+  }
+  ctx.i = i;
+  ctx.j = j;
+}
+
+// key of 1 to 256 bytes repeated to 256
+static void rc4_expand_key(const std::vector<uint8_t> &key, uint8_t *output) {
+  assert(!key.empty() && key.size() <= 256);
+  for (size_t i = 0; i < 256; i += key.size()) {
+    memcpy(&output[i], key.data(),
+           256 - i < key.size() ? 256 - i : key.size());
+  }
+}
+
+// RC4-drop[n]: the first n bytes of keystream are generated and thrown away
+static void rc4_drop(rc4_context &ctx, size_t drop) {
+  uint8_t buffer[rc4_block];
+  while (drop > 0) {
+    size_t length = drop < rc4_block ? drop : rc4_block;
+    rc4_keystream(ctx, buffer, length);
+    drop -= length;
+  }
+}
+
+static void rc4_crypt_bytes(rc4_context &ctx, const uint8_t *input,
+                            uint8_t *output, size_t length) {
+  uint8_t buffer[rc4_block];
+  for (size_t offset = 0; offset < length; offset += rc4_block) {
+    size_t bytes = length - offset < rc4_block ? length - offset : rc4_block;
+    rc4_keystream(ctx, buffer, bytes);
+    xor_bytes(&output[offset], &input[offset], buffer, bytes);
+  }
+}
+
+void rc4_init(rc4_context &ctx, const std::vector<uint8_t> &key,
+              size_t drop) {
+  uint8_t expanded[256];
+  rc4_expand_key(key, expanded);
 
   // key scheduling
-  uint8_t s[256];
+  uint8_t *s = ctx.s;
   for (int i = 0; i < 256; i++) {
     s[i] = i;
   }
-  int j = 0;
+  uint8_t j = 0;
+  uint8_t x = s[0];
   for (int i = 0; i < 256; i++) {
-    j = (j + s[i] + key[i % key.size()]) % 256;
-    uint8_t temp = s[i];
-    s[i] = s[j];
-    s[j] = temp;
-  }
-
-  // pseudo random generation
-  int i = 0;
-  j = 0;
-  for (size_t k = 0; k < input.size(); k++) {
-    i = (i + 1) % 256;
-    j = (j + s[i]) % 256;
-    uint8_t temp = s[i];
-    s[i] = s[j];
-    s[j] = temp;
-    uint8_t K = s[(s[i] + s[j]) % 256];
-    output[k] = input[k] ^ K;
+    rc4_ksa_step(s, i, j, x, expanded[i]);
+  }
+  ctx.i = 0;
+  ctx.j = 0;
+  rc4_drop(ctx, drop);
+}
+
+void rc4_crypt(rc4_context &ctx, const std::vector<uint8_t> &input,
+               std::vector<uint8_t> &output) {
+  output.resize(input.size());
+  rc4_crypt_bytes(ctx, input.data(), output.data(), input.size());
+}
+
+void rc4(const std::vector<uint8_t> &input, const std::vector<uint8_t> &key,
+         std::vector<uint8_t> &output) {
+  rc4_context ctx;
+  rc4_init(ctx, key);
+  rc4_crypt(ctx, input, output);
+}
+
+// RC4 of many messages: each step depends on the previous one through j and
+// s, so a single stream leaves most of the pipeline idle, rc4_lanes
+// independent states advance in lockstep to fill it
+// 4 lanes keep j and s[i] of all states in the 16 registers of x86-64, with 8
+// they spill and the gain is gone
+static const int rc4_lanes = 4;
+// rc4_ksa_lanes and rc4_keystream_lanes spell out the lanes
+static_assert(rc4_lanes == 4, "one line per lane in the lane loops");
+// the states are rc4_stride bytes apart, 4 more than their size, so the same
+// index of different lanes falls in different cache banks
+static const size_t rc4_stride = 256 + 4;
+
+// the states of a group of messages, the lanes share i since they start
+// together
+struct rc4_lanes_state {
+  uint8_t s[rc4_lanes * rc4_stride];
+  uint8_t i;
+  uint8_t j[rc4_lanes];
+};
+
+// key scheduling of all lanes, keys holds each key repeated to 256 bytes
+static void rc4_ksa_lanes(rc4_lanes_state &state, const uint8_t *keys) {
+  uint8_t *s = state.s;
+  for (int l = 0; l < rc4_lanes; l++) {
+    for (int i = 0; i < 256; i++) {
+      s[l * rc4_stride + i] = i;
+    }
+  }
+  // separate variables rather than arrays, so they stay in registers
+  uint8_t j0 = 0, j1 = 0, j2 = 0, j3 = 0;
+  uint8_t x0 = 0, x1 = 0, x2 = 0, x3 = 0;
+  for (int i = 0; i < 256; i++) {
+    rc4_ksa_step(&s[0 * rc4_stride], i, j0, x0, keys[0 * 256 + i]);
+    rc4_ksa_step(&s[1 * rc4_stride], i, j1, x1, keys[1 * 256 + i]);
+    rc4_ksa_step(&s[2 * rc4_stride], i, j2, x2, keys[2 * 256 + i]);
+    rc4_ksa_step(&s[3 * rc4_stride], i, j3, x3, keys[3 * 256 + i]);
+  }
+  state.i = 0;
+  for (int l = 0; l < rc4_lanes; l++) {
+    state.j[l] = 0;
+  }
+}
+
+// the next length bytes of keystream of all lanes, lane l at
+// output[l * rc4_block], length is at most rc4_block
+static void rc4_keystream_lanes(rc4_lanes_state &state, uint8_t *output,
+                                size_t length) {
+  uint8_t *s = state.s;
+  uint8_t i = state.i;
+  uint8_t i1 = i + 1;
+  uint8_t j0 = state.j[0], j1 = state.j[1], j2 = state.j[2], j3 = state.j[3];
+  uint8_t x0 = s[0 * rc4_stride + i1], x1 = s[1 * rc4_stride + i1],
+          x2 = s[2 * rc4_stride + i1], x3 = s[3 * rc4_stride + i1];
+  for (size_t k = 0; k < length; k++) {
+    i++;
+    rc4_step(&s[0 * rc4_stride], i, j0, x0, &output[0 * rc4_block + k]);
+    rc4_step(&s[1 * rc4_stride], i, j1, x1, &output[1 * rc4_block + k]);
+    rc4_step(&s[2 * rc4_stride], i, j2, x2, &output[2 * rc4_block + k]);
+    rc4_step(&s[3 * rc4_stride], i, j3, x3, &output[3 * rc4_block + k]);
+  }
+  state.i = i;
+  state.j[0] = j0;
+  state.j[1] = j1;
+  state.j[2] = j2;
+  state.j[3] = j3;
+}
+
+// up to rc4_lanes messages in lockstep until the shortest one ends, the rest
+// of the others one at a time
+// missing lanes are padded with the key of lane 0, the work is the same, so
+// 1 or 2 messages are faster on the serial path
+static void rc4_crypt_group(const rc4_job *const jobs[], int count,
+                            size_t drop) {
+  if (count < 3) {
+    for (int l = 0; l < count; l++) {
+      rc4_context ctx;
+      rc4_init(ctx, *jobs[l]->key, drop);
+      rc4_crypt(ctx, *jobs[l]->input, *jobs[l]->output);
+    }
+    return;
+  }
+
+  rc4_lanes_state state;
+  // the keys repeated to 256 bytes, then the keystream
+  uint8_t buffer[rc4_lanes * rc4_block];
+  size_t length = jobs[0]->input->size();
+  for (int l = 0; l < rc4_lanes; l++) {
+    rc4_expand_key(*jobs[l < count ? l : 0]->key, &buffer[l * 256]);
+  }
+  for (int l = 0; l < count; l++) {
+    jobs[l]->output->resize(jobs[l]->input->size());
+    if (jobs[l]->input->size() < length) {
+      length = jobs[l]->input->size();
+    }
+  }
+  rc4_ksa_lanes(state, buffer);
+
+  while (drop > 0) {
+    size_t bytes = drop < rc4_block ? drop : rc4_block;
+    rc4_keystream_lanes(state, buffer, bytes);
+    drop -= bytes;
+  }
+
+  for (size_t offset = 0; offset < length; offset += rc4_block) {
+    size_t bytes = length - offset < rc4_block ? length - offset : rc4_block;
+    rc4_keystream_lanes(state, buffer, bytes);
+    for (int l = 0; l < count; l++) {
+      xor_bytes(&jobs[l]->output->data()[offset],
+                &jobs[l]->input->data()[offset], &buffer[l * rc4_block],
+                bytes);
+    }
+  }
+
+  for (int l = 0; l < count; l++) {
+    size_t size = jobs[l]->input->size();
+    if (size > length) {
+      rc4_context ctx;
+      memcpy(ctx.s, &state.s[l * rc4_stride], 256);
+      ctx.i = state.i;
+      ctx.j = state.j[l];
+      rc4_crypt_bytes(ctx, &jobs[l]->input->data()[length],
+                      &jobs[l]->output->data()[length], size - length);
+    }
+  }
+}
+
+void rc4_batch(const std::vector<rc4_job> &jobs, size_t drop) {
+  // messages of similar length go to the same group, so lanes stay busy
+  std::vector<const rc4_job *> sorted(jobs.size());
+  size_t bytes = 0;
+  for (size_t i = 0; i < jobs.size(); i++) {
+    sorted[i] = &jobs[i];
+    bytes += 256 + drop + jobs[i].input->size();
+  }
+  std::sort(sorted.begin(), sorted.end(),
+            [](const rc4_job *a, const rc4_job *b) {
+              return a->input->size() < b->input->size();
+            });
+
+  size_t groups = (jobs.size() + rc4_lanes - 1) / rc4_lanes;
+  // threads only pay off for enough work
+#pragma omp parallel for schedule(dynamic) if (groups > 1 && bytes >= 65536)
+  for (size_t group = 0; group < groups; group++) {
+    size_t begin = group * rc4_lanes;
+    int count = jobs.size() - begin < rc4_lanes ? jobs.size() - begin
+                                                : rc4_lanes;
+    rc4_crypt_group(&sorted[begin], count, drop);
   }
 }
@@ -0,0 +1,21 @@
+#ifndef __SM4_H__
+#define __SM4_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+// internal interface between sm4.cpp and the SM4 backends
+// round keys are the 32 rk_i of the standard, reversed for decryption
+
+// SM4 with the sbox computed by AESENCLAST(sm4ni.cpp), needs AES-NI and
+// SSSE3, 8 blocks at a time with AVX2, 4 otherwise
+// ECB on independent blocks, a partial batch is padded
+void sm4ni_crypt_blocks(const uint32_t rk[32], const uint8_t *input,
+                        uint8_t *output, size_t blocks);
+
+// bitsliced SM4(bssm4.cpp), constant time
+// ECB on independent blocks, 64 at a time, 256 with AVX2
+void bssm4_crypt_blocks(const uint32_t rk[32], const uint8_t *input,
+                        uint8_t *output, size_t blocks);
+
+#endif
@@ -0,0 +1,244 @@
+#include "sm4.h"
+#include "util.h"
+#include <cstdlib>
+#include <cstring>
+
+// reference:
+// https://github.com/mjosaarinen/sm4ni
+// https://eprint.iacr.org/2018/301.pdf
+
+// the sbox of SM4 is A(I(A x + 0xD3)) + 0xD3, I being the inversion in
+// GF(2^8) mod x^8+x^7+x^6+x^5+x^4+x^2+1
+// the field is isomorphic to the one of AES, so the sbox is an affine map
+// into the AES field, the AES sbox(AESENCLAST) and an affine map back:
+// sbox(x) = post(aes_sbox(pre(x)))
+// both affine maps are 2 lookups of 4 bits with PSHUFB, x = hi:lo
+// pre(x) = pre_tf[0][lo] ^ pre_tf[1][hi], the same for post
+// the isomorphism maps x to 0x23, a root of the polynomial in the AES field
+const uint8_t pre_tf[2][16] = {
+    {0x3e, 0xb2, 0x0e, 0x82, 0xbb, 0x37, 0x8b, 0x07, 0xa1, 0x2d, 0x91, 0x1d,
+     0x24, 0xa8, 0x14, 0x98},
+    {0x00, 0xdc, 0x2e, 0xf2, 0xc5, 0x19, 0xeb, 0x37, 0x08, 0xd4, 0x26, 0xfa,
+     0xcd, 0x11, 0xe3, 0x3f}};
+// the inverse of the AES affine map and of the isomorphism, then A and 0xD3
+const uint8_t post_tf[2][16] = {
+    {0x6c, 0xd4, 0xa6, 0x1e, 0x52, 0xea, 0x98, 0x20, 0x0b, 0xb3, 0xc1, 0x79,
+     0x35, 0x8d, 0xff, 0x47},
+    {0x00, 0xe0, 0x50, 0xb0, 0x9d, 0x7d, 0xcd, 0x2d, 0xc0, 0x20, 0x90, 0x70,
+     0x5d, 0xbd, 0x0d, 0xed}};
+
+// AESENCLAST does ShiftRows after SubBytes, it is undone in advance
+const uint8_t inv_shift_rows[16] = {0, 13, 10, 7,  4,  1,  14, 11,
+                                    8, 5,  2,  15, 12, 9,  6,  3};
+// big endian words to little endian ones and back
+const uint8_t bswap32[16] = {3,  2,  1, 0,  7,  6,  5,  4,
+                             11, 10, 9, 8, 15, 14, 13, 12};
+// rotate each word left by 8, 16 and 24 bits
+const uint8_t rotl8[16] = {3,  0, 1,  2,  7,  4,  5,  6,
+                           11, 8, 9, 10, 15, 12, 13, 14};
+const uint8_t rotl16[16] = {2,  3,  0, 1, 6,  7,  4,  5,
+                            10, 11, 8, 9, 14, 15, 12, 13};
+const uint8_t rotl24[16] = {1, 2,  3,  0, 5,  6,  7,  4,
+                            9, 10, 11, 8, 13, 14, 15, 12};
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+
+// compile AES-NI code without -maes, callers check cpu_has_aesni() and
+// cpu_has_ssse3() first, and cpu_has_avx2() for 8 blocks
+#define SM4NI_TARGET __attribute__((target("aes,ssse3")))
+#define SM4NI_AVX2_TARGET __attribute__((target("aes,avx2")))
+#define SM4NI_INLINE inline __attribute__((always_inline))
+
+// 4 blocks, one 32-bit word of each block per vector
+// word i of the 4 blocks is in x[i]
+
+SM4NI_TARGET SM4NI_INLINE __m128i sm4ni_load(const uint8_t table[16]) {
+  return _mm_loadu_si128((const __m128i *)table);
+}
+
+// table[0][low nibble] ^ table[1][high nibble] of each byte
+SM4NI_TARGET SM4NI_INLINE __m128i sm4ni_affine(const uint8_t table[2][16],
+                                               __m128i x) {
+  const __m128i mask = _mm_set1_epi8(0x0f);
+  __m128i lo = _mm_and_si128(x, mask);
+  __m128i hi = _mm_and_si128(_mm_srli_epi32(x, 4), mask);
+  return _mm_xor_si128(_mm_shuffle_epi8(sm4ni_load(table[0]), lo),
+                       _mm_shuffle_epi8(sm4ni_load(table[1]), hi));
+}
+
+// T(x) = L(tau(x)) on each word
+SM4NI_TARGET SM4NI_INLINE __m128i sm4ni_t(__m128i x) {
+  // tau: the sbox on each byte
+  x = sm4ni_affine(pre_tf, x);
+  x = _mm_shuffle_epi8(x, sm4ni_load(inv_shift_rows));
+  x = _mm_aesenclast_si128(x, _mm_setzero_si128());
+  x = sm4ni_affine(post_tf, x);
+
+  // L(x) = x ^ (x <<< 2) ^ (x <<< 10) ^ (x <<< 18) ^ (x <<< 24)
+  // = x ^ (x <<< 24) ^ ((x ^ (x <<< 8) ^ (x <<< 16)) <<< 2)
+  __m128i y = _mm_xor_si128(x, _mm_shuffle_epi8(x, sm4ni_load(rotl8)));
+  y = _mm_xor_si128(y, _mm_shuffle_epi8(x, sm4ni_load(rotl16)));
+  y = _mm_or_si128(_mm_slli_epi32(y, 2), _mm_srli_epi32(y, 30));
+  x = _mm_xor_si128(x, _mm_shuffle_epi8(x, sm4ni_load(rotl24)));
+  return _mm_xor_si128(x, y);
+}
+
+// 4x4 matrix of words, rows to columns
+SM4NI_TARGET SM4NI_INLINE void sm4ni_transpose(__m128i x[4]) {
+  __m128i t0 = _mm_unpacklo_epi32(x[0], x[1]);
+  __m128i t1 = _mm_unpacklo_epi32(x[2], x[3]);
+  __m128i t2 = _mm_unpackhi_epi32(x[0], x[1]);
+  __m128i t3 = _mm_unpackhi_epi32(x[2], x[3]);
+  x[0] = _mm_unpacklo_epi64(t0, t1);
+  x[1] = _mm_unpackhi_epi64(t0, t1);
+  x[2] = _mm_unpacklo_epi64(t2, t3);
+  x[3] = _mm_unpackhi_epi64(t2, t3);
+}
+
+// X_{i+4} = X_i xor T(X_{i+1} xor X_{i+2} xor X_{i+3} xor rk_i)
+SM4NI_TARGET SM4NI_INLINE __m128i sm4ni_round(__m128i x0, __m128i x1,
+                                              __m128i x2, __m128i x3,
+                                              uint32_t rk) {
+  __m128i t = _mm_xor_si128(_mm_xor_si128(x1, x2),
+                            _mm_xor_si128(x3, _mm_set1_epi32(rk)));
+  return _mm_xor_si128(x0, sm4ni_t(t));
+}
+
+SM4NI_TARGET void sm4ni_crypt4(const uint32_t rk[32], const uint8_t *input,
+                               uint8_t *output) {
+  __m128i x[4];
+  for (int b = 0; b < 4; b++) {
+    x[b] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)&input[b * 16]),
+                            sm4ni_load(bswap32));
+  }
+  sm4ni_transpose(x);
+
+  // 4 rounds per iteration, so the words stay in place
+  for (int round = 0; round < 32; round += 4) {
+    x[0] = sm4ni_round(x[0], x[1], x[2], x[3], rk[round]);
+    x[1] = sm4ni_round(x[1], x[2], x[3], x[0], rk[round + 1]);
+    x[2] = sm4ni_round(x[2], x[3], x[0], x[1], rk[round + 2]);
+    x[3] = sm4ni_round(x[3], x[0], x[1], x[2], rk[round + 3]);
+  }
+
+  // R(X_32, X_33, X_34, X_35) = (X_35, X_34, X_33, X_32)
+  __m128i y[4] = {x[3], x[2], x[1], x[0]};
+  sm4ni_transpose(y);
+  for (int b = 0; b < 4; b++) {
+    _mm_storeu_si128((__m128i *)&output[b * 16],
+                     _mm_shuffle_epi8(y[b], sm4ni_load(bswap32)));
+  }
+}
+
+// 8 blocks, blocks 0..3 in the low lanes and 4..7 in the high lanes
+// the same steps as above, AESENCLAST on 256-bit vectors needs VAES, so it
+// runs on each half
+
+SM4NI_AVX2_TARGET SM4NI_INLINE __m256i sm4ni_load2(const uint8_t table[16]) {
+  return _mm256_broadcastsi128_si256(
+      _mm_loadu_si128((const __m128i *)table));
+}
+
+SM4NI_AVX2_TARGET SM4NI_INLINE __m256i sm4ni_affine2(const uint8_t table[2][16],
+                                                     __m256i x) {
+  const __m256i mask = _mm256_set1_epi8(0x0f);
+  __m256i lo = _mm256_and_si256(x, mask);
+  __m256i hi = _mm256_and_si256(_mm256_srli_epi32(x, 4), mask);
+  return _mm256_xor_si256(_mm256_shuffle_epi8(sm4ni_load2(table[0]), lo),
+                          _mm256_shuffle_epi8(sm4ni_load2(table[1]), hi));
+}
+
+SM4NI_AVX2_TARGET SM4NI_INLINE __m256i sm4ni_t2(__m256i x) {
+  x = sm4ni_affine2(pre_tf, x);
+  x = _mm256_shuffle_epi8(x, sm4ni_load2(inv_shift_rows));
+  __m128i lo = _mm_aesenclast_si128(_mm256_castsi256_si128(x),
+                                    _mm_setzero_si128());
+  __m128i hi = _mm_aesenclast_si128(_mm256_extracti128_si256(x, 1),
+                                    _mm_setzero_si128());
+  x = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+  x = sm4ni_affine2(post_tf, x);
+
+  __m256i y = _mm256_xor_si256(x, _mm256_shuffle_epi8(x, sm4ni_load2(rotl8)));
+  y = _mm256_xor_si256(y, _mm256_shuffle_epi8(x, sm4ni_load2(rotl16)));
+  y = _mm256_or_si256(_mm256_slli_epi32(y, 2), _mm256_srli_epi32(y, 30));
+  x = _mm256_xor_si256(x, _mm256_shuffle_epi8(x, sm4ni_load2(rotl24)));
+  return _mm256_xor_si256(x, y);
+}
+
+SM4NI_AVX2_TARGET SM4NI_INLINE void sm4ni_transpose2(__m256i x[4]) {
+  __m256i t0 = _mm256_unpacklo_epi32(x[0], x[1]);
+  __m256i t1 = _mm256_unpacklo_epi32(x[2], x[3]);
+  __m256i t2 = _mm256_unpackhi_epi32(x[0], x[1]);
+  __m256i t3 = _mm256_unpackhi_epi32(x[2], x[3]);
+  x[0] = _mm256_unpacklo_epi64(t0, t1);
+  x[1] = _mm256_unpackhi_epi64(t0, t1);
+  x[2] = _mm256_unpacklo_epi64(t2, t3);
+  x[3] = _mm256_unpackhi_epi64(t2, t3);
+}
+
+SM4NI_AVX2_TARGET SM4NI_INLINE __m256i sm4ni_round2(__m256i x0, __m256i x1,
+                                                    __m256i x2, __m256i x3,
+                                                    uint32_t rk) {
+  __m256i t = _mm256_xor_si256(_mm256_xor_si256(x1, x2),
+                               _mm256_xor_si256(x3, _mm256_set1_epi32(rk)));
+  return _mm256_xor_si256(x0, sm4ni_t2(t));
+}
+
+SM4NI_AVX2_TARGET void sm4ni_crypt8(const uint32_t rk[32],
+                                    const uint8_t *input, uint8_t *output) {
+  __m256i x[4];
+  for (int b = 0; b < 4; b++) {
+    __m128i lo = _mm_loadu_si128((const __m128i *)&input[b * 16]);
+    __m128i hi = _mm_loadu_si128((const __m128i *)&input[(b + 4) * 16]);
+    x[b] = _mm256_shuffle_epi8(
+        _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1),
+        sm4ni_load2(bswap32));
+  }
+  sm4ni_transpose2(x);
+
+  for (int round = 0; round < 32; round += 4) {
+    x[0] = sm4ni_round2(x[0], x[1], x[2], x[3], rk[round]);
+    x[1] = sm4ni_round2(x[1], x[2], x[3], x[0], rk[round + 1]);
+    x[2] = sm4ni_round2(x[2], x[3], x[0], x[1], rk[round + 2]);
+    x[3] = sm4ni_round2(x[3], x[0], x[1], x[2], rk[round + 3]);
+  }
+
+  __m256i y[4] = {x[3], x[2], x[1], x[0]};
+  sm4ni_transpose2(y);
+  for (int b = 0; b < 4; b++) {
+    __m256i z = _mm256_shuffle_epi8(y[b], sm4ni_load2(bswap32));
+    _mm_storeu_si128((__m128i *)&output[b * 16], _mm256_castsi256_si128(z));
+    _mm_storeu_si128((__m128i *)&output[(b + 4) * 16],
+                     _mm256_extracti128_si256(z, 1));
+  }
+}
+
+void sm4ni_crypt_blocks(const uint32_t rk[32], const uint8_t *input,
+                        uint8_t *output, size_t blocks) {
+  size_t block = 0;
+  if (cpu_has_avx2()) {
+    for (; block + 8 <= blocks; block += 8) {
+      sm4ni_crypt8(rk, &input[block * 16], &output[block * 16]);
+    }
+  }
+  for (; block + 4 <= blocks; block += 4) {
+    sm4ni_crypt4(rk, &input[block * 16], &output[block * 16]);
+  }
+  // tail, padded to 4 blocks
+  if (block < blocks) {
+    uint8_t buffer[4 * 16] = {0};
+    memcpy(buffer, &input[block * 16], (blocks - block) * 16);
+    sm4ni_crypt4(rk, buffer, buffer);
+    memcpy(&output[block * 16], buffer, (blocks - block) * 16);
+  }
+}
+
+#else
+
+void sm4ni_crypt_blocks(const uint32_t[32], const uint8_t *, uint8_t *,
+                        size_t) {
+  abort();
+}
+
+#endif
@@ -1,4 +1,5 @@
 #include "crypto.h"
+#include "ghash.h"
 #include "util.h"
 #include <gtest/gtest.h>
 
@@ -71,6 +72,154 @@ TEST_F(DESTest, DecryptWithNonZeroIVTwoBlocks) {
   EXPECT_EQ(vec_output, parse_hex_new(output));
 }
 
+// one expanded key for several messages in both directions
+TEST_F(DESTest, Context) {
+  des_context ctx;
+  des_init(ctx, parse_hex_new(key));
+  des_cbc_encrypt(ctx, parse_hex_new("0123456789ABCDEF0123456789ABCDEF"),
+                  parse_hex_new("000000000000000F"), vec_output);
+  EXPECT_EQ(vec_output, parse_hex_new("AE26A69343ACEF305E7FE8F06ECE74E7"));
+  des_cbc_decrypt(ctx, parse_hex_new("AE26A69343ACEF30"),
+                  parse_hex_new("000000000000000F"), vec_output);
+  EXPECT_EQ(vec_output, parse_hex_new(input));
+  des_cbc_encrypt(ctx, parse_hex_new(input), parse_hex_new(iv), vec_output);
+  EXPECT_EQ(vec_output, parse_hex_new("85E813540F0AB405"));
+}
+
+// key bits 25 and 35 differ, compared with openssl des-ecb
+TEST_F(DESTest, KeySchedule) {
+  des_cbc(true, parse_hex_new("0001020304050607"),
+          parse_hex_new("00000000ff000000"), parse_hex_new(iv), vec_output);
+  EXPECT_EQ(vec_output, parse_hex_new("c5b4ad7811710f50"));
+}
+
+// long inputs are decrypted by bitsliced DES, encryption uses the tables
+TEST_F(DESTest, Bitslice) {
+  for (size_t blocks : {15, 16, 63, 64, 65, 300, 600}) {
+    std::vector<uint8_t> plain(blocks * 8);
+    std::vector<uint8_t> vec_key(24);
+    std::vector<uint8_t> vec_iv(8);
+    random_fill(plain);
+    random_fill(vec_key);
+    random_fill(vec_iv);
+    std::vector<uint8_t> des_key(vec_key.begin(), vec_key.begin() + 8);
+    std::vector<uint8_t> cipher;
+    des_cbc(true, plain, des_key, vec_iv, cipher);
+    des_cbc(false, cipher, des_key, vec_iv, vec_output);
+    EXPECT_EQ(vec_output, plain);
+    des3_cbc(true, plain, vec_key, vec_iv, cipher);
+    des3_cbc(false, cipher, vec_key, vec_iv, vec_output);
+    EXPECT_EQ(vec_output, plain);
+    // in place
+    des_cbc(true, plain, des_key, vec_iv, cipher);
+    des_cbc(false, cipher, des_key, vec_iv, cipher);
+    EXPECT_EQ(cipher, plain);
+    des3_cbc(true, plain, vec_key, vec_iv, cipher);
+    des3_cbc(false, cipher, vec_key, vec_iv, cipher);
+    EXPECT_EQ(cipher, plain);
+  }
+}
+
+// every backend must agree with the table based implementation
+TEST_F(DESTest, Backends) {
+  for (size_t blocks : {1, 15, 16, 70, 300}) {
+    std::vector<uint8_t> plain(blocks * 8), vec_key(24), vec_iv(8);
+    random_fill(plain);
+    random_fill(vec_key);
+    random_fill(vec_iv);
+    std::vector<uint8_t> des_key(vec_key.begin(), vec_key.begin() + 8);
+    std::vector<uint8_t> expected, expected3;
+    des_set_backend(DESBackend::Table);
+    des_cbc(true, plain, des_key, vec_iv, expected);
+    des3_cbc(true, plain, vec_key, vec_iv, expected3);
+    for (DESBackend backend : {DESBackend::Table, DESBackend::PairedTable,
+                               DESBackend::Bitslice, DESBackend::Auto}) {
+      des_set_backend(backend);
+      des_cbc(true, plain, des_key, vec_iv, vec_output);
+      EXPECT_EQ(vec_output, expected);
+      des_cbc(false, expected, des_key, vec_iv, vec_output);
+      EXPECT_EQ(vec_output, plain);
+      des3_cbc(true, plain, vec_key, vec_iv, vec_output);
+      EXPECT_EQ(vec_output, expected3);
+      des3_cbc(false, expected3, vec_key, vec_iv, vec_output);
+      EXPECT_EQ(vec_output, plain);
+      // in place
+      vec_output = expected;
+      des_cbc(false, vec_output, des_key, vec_iv, vec_output);
+      EXPECT_EQ(vec_output, plain);
+      vec_output = expected3;
+      des3_cbc(false, vec_output, vec_key, vec_iv, vec_output);
+      EXPECT_EQ(vec_output, plain);
+    }
+  }
+  des_set_backend(DESBackend::Auto);
+}
+
+// the counter wraps around, compared with openssl des-ecb
+TEST_F(DESTest, CTR) {
+  des_ctr(std::vector<uint8_t>(12), parse_hex_new("0123456789abcdef"),
+          parse_hex_new("ffffffffffffffff"), vec_output);
+  EXPECT_EQ(vec_output, parse_hex_new("59732356f36fde06d5d44ff7"));
+
+  // each block of keystream is the encryption of its counter
+  std::vector<uint8_t> zeros(5000 * 8 + 3);
+  std::vector<uint8_t> counter = parse_hex_new("00000000fffffff0");
+  des_ctr(zeros, parse_hex_new(key), counter, vec_output);
+  for (size_t offset = 0; offset < zeros.size(); offset += 8) {
+    std::vector<uint8_t> block;
+    des_cbc(true, counter, parse_hex_new(key), std::vector<uint8_t>(8), block);
+    for (size_t i = 0; i < 8 && offset + i < zeros.size(); i++) {
+      EXPECT_EQ(vec_output[offset + i], block[i]);
+    }
+    for (int i = 7; i >= 0 && ++counter[i] == 0; i--) {
+    }
+  }
+}
+
+// 21 unknown key bits in 2 parts, then 2 unknown bits
+TEST_F(DESTest, KeySearch) {
+  std::vector<uint8_t> mask = parse_hex_new("0000000000fefefe");
+  std::vector<std::vector<uint8_t>> found;
+  EXPECT_EQ(des_key_search_parts(mask), 2);
+  for (uint64_t part = 0; part < 2; part++) {
+    des_key_search(parse_hex_new(input), parse_hex_new("85E813540F0AB405"),
+                   parse_hex_new("133457799B000000"), mask, part, found);
+  }
+  ASSERT_EQ(found.size(), 1);
+  EXPECT_EQ(found[0], parse_hex_new("133457799BBCDEF0"));
+
+  found.clear();
+  mask = parse_hex_new("0000000000000006");
+  EXPECT_EQ(des_key_search_parts(mask), 1);
+  des_key_search(parse_hex_new(input), parse_hex_new("85E813540F0AB405"),
+                 parse_hex_new(key), mask, 0, found);
+  ASSERT_EQ(found.size(), 1);
+  EXPECT_EQ(found[0], parse_hex_new(key));
+}
+
+// Triple DES, compared with openssl des-ede3-cbc
+TEST_F(DESTest, TripleDES) {
+  std::string key = "0123456789abcdeff1e0d3c2b5a49786fedcba9876543210";
+  std::string iv = "0011223344556677";
+  std::string input = "0123456789ABCDEF0123456789ABCDEF"
+                      "00112233445566778899aabbccddeeff";
+  std::string output = "7fbc70333e757ca1d064c64a8e2db6ab"
+                       "b5d36893de49ef1e9f00d8eae54449e6";
+  des3_cbc(true, parse_hex_new(input), parse_hex_new(key), parse_hex_new(iv),
+           vec_output);
+  EXPECT_EQ(vec_output, parse_hex_new(output));
+  des3_cbc(false, parse_hex_new(output), parse_hex_new(key),
+           parse_hex_new(iv), vec_output);
+  EXPECT_EQ(vec_output, parse_hex_new(input));
+
+  // K1 = K2 = K3 is single DES
+  des3_context ctx;
+  des3_init(ctx, parse_hex_new(this->key + this->key + this->key));
+  des3_cbc_encrypt(ctx, parse_hex_new(this->input), parse_hex_new(this->iv),
+                   vec_output);
+  EXPECT_EQ(vec_output, parse_hex_new("85E813540F0AB405"));
+}
+
 // example taken from
 // https://kavaliro.com/wp-content/uploads/2014/03/AES.pdf
 class AESTest : public ::testing::Test {
@@ -81,6 +230,24 @@ protected:
   std::vector<uint8_t> vec_output;
 };
 
+// sets AESBackend::Auto again when a test ends, also when an ASSERT returns
+// early
+struct aes_backend_guard {
+  ~aes_backend_guard() { aes_set_backend(AESBackend::Auto); }
+};
+
+// runs test with each AES backend the cpu supports
+template <class F> void for_each_aes_backend(F test) {
+  aes_backend_guard guard;
+  for (AESBackend backend :
+       {AESBackend::Table, AESBackend::AESNI, AESBackend::Bitslice,
+        AESBackend::VPAES}) {
+    if (aes_set_backend(backend)) {
+      test(backend);
+    }
+  }
+}
+
 TEST_F(AESTest, EncryptWithNonZeroIVTwoBlocks) {
   std::string output = "29c3505f571420f6402299b31a02d73a";
   aes128_cbc(true, parse_hex_new(input), parse_hex_new(key), parse_hex_new(iv),
@@ -106,6 +273,419 @@ TEST_F(AESTest, DecryptWithZeroIV) {
   EXPECT_EQ(vec_output, parse_hex_new(output));
 }
 
+TEST_F(AESTest, DecryptWithPadding) {
+  std::string input =
+      "29c3505f571420f6402299b31a02d73a5f5917ec376a3a269efadb6b2d61e4e3";
+  std::vector<uint8_t> vec_expected = parse_hex_new(this->input);
+  pkcs7_pad(vec_expected, 16);
+  aes128_cbc(false, parse_hex_new(input), parse_hex_new(key),
+             parse_hex_new(iv), vec_output);
+  EXPECT_EQ(vec_output, vec_expected);
+}
+
+// example taken from
+// https://nvlpubs.nist.gov/nistpubs/FIPS/NIST.FIPS.197.pdf Appendix C.1
+TEST(AES, FIPS197Example) {
+  std::vector<uint8_t> vec_output;
+  std::string iv = "00000000000000000000000000000000";
+  std::string key = "000102030405060708090a0b0c0d0e0f";
+  std::string input = "00112233445566778899aabbccddeeff";
+  std::string output = "69c4e0d86a7b0430d8cdb78070b4c55a";
+  aes128_cbc(true, parse_hex_new(input), parse_hex_new(key), parse_hex_new(iv),
+             vec_output);
+  EXPECT_EQ(vec_output, parse_hex_new(output));
+  aes128_cbc(false, parse_hex_new(output), parse_hex_new(key),
+             parse_hex_new(iv), vec_output);
+  EXPECT_EQ(vec_output, parse_hex_new(input));
+}
+
+// FIPS-197 C.2 and C.3, SP 800-38A F.2.5 CBC-AES256 and F.5.3 CTR-AES192
+TEST(AES, KeySizes) {
+  std::string input = "00112233445566778899aabbccddeeff";
+  std::string key192 = "000102030405060708090a0b0c0d0e0f1011121314151617";
+  std::string key256 =
+      "000102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f";
+  std::string plain = "6bc1bee22e409f96e93d7e117393172a"
+                      "ae2d8a571e03ac9c9eb76fac45af8e51"
+                      "30c81c46a35ce411e5fbc1191a0a52ef"
+                      "f69f2445df4f9b17ad2b417be66c3710";
+  std::string cbc256 = "f58c4c04d6e5f1ba779eabfb5f7bfbd6"
+                       "9cfc4e967edb808d679f777bc6702c7d"
+                       "39f23369a9d9bacfa530e26304231461"
+                       "b2eb05e2c39be9fcda6c19078c6a9d1b";
+  std::string ctr192 = "1abc932417521ca24f2b0459fe7e6e0b"
+                       "090339ec0aa6faefd5ccc2c6f4ce8e94"
+                       "1e36b26bd1ebc670d1bd1d665620abf7"
+                       "4f78a7f6d29809585a97daec58c6b050";
+  std::vector<uint8_t> zero_iv(16), vec_output;
+  for_each_aes_backend([&](AESBackend) {
+    aes_cbc(true, parse_hex_new(input), parse_hex_new(key192), zero_iv,
+            vec_output);
+    EXPECT_EQ(vec_output, parse_hex_new("dda97ca4864cdfe06eaf70a0ec0d7191"));
+    aes_cbc(true, parse_hex_new(input), parse_hex_new(key256), zero_iv,
+            vec_output);
+    EXPECT_EQ(vec_output, parse_hex_new("8ea2b7ca516745bfeafc49904b496089"));
+    aes_cbc(false, parse_hex_new("8ea2b7ca516745bfeafc49904b496089"),
+            parse_hex_new(key256), zero_iv, vec_output);
+    EXPECT_EQ(vec_output, parse_hex_new(input));
+
+    aes_cbc(true, parse_hex_new(plain),
+            parse_hex_new("603deb1015ca71be2b73aef0857d7781"
+                          "1f352c073b6108d72d9810a30914dff4"),
+            parse_hex_new("000102030405060708090a0b0c0d0e0f"), vec_output);
+    EXPECT_EQ(vec_output, parse_hex_new(cbc256));
+    aes_ctr(parse_hex_new(plain),
+            parse_hex_new("8e73b0f7da0e6452c810f32b809079e5"
+                          "62f8ead2522c6b7b"),
+            parse_hex_new("f0f1f2f3f4f5f6f7f8f9fafbfcfdfeff"), vec_output);
+    EXPECT_EQ(vec_output, parse_hex_new(ctr192));
+  });
+}
+
+// every backend must agree with the table based implementation
+TEST(AES, Backends) {
+  aes_backend_guard guard;
+  // some backends work on batches of blocks, try partial ones too
+  for (size_t key_size : {16, 24, 32}) {
+    for (size_t blocks : {1, 7, 8, 37, 300}) {
+      std::vector<uint8_t> input(16 * blocks), key(key_size), iv(16);
+      random_fill(input);
+      random_fill(key);
+      random_fill(iv);
+      std::vector<uint8_t> expected, output;
+      ASSERT_TRUE(aes_set_backend(AESBackend::Table));
+      aes_cbc(true, input, key, iv, expected);
+      aes_cbc(false, expected, key, iv, output);
+      EXPECT_EQ(output, input);
+      for_each_aes_backend([&](AESBackend) {
+        aes_cbc(true, input, key, iv, output);
+        EXPECT_EQ(output, expected);
+        aes_cbc(false, expected, key, iv, output);
+        EXPECT_EQ(output, input);
+        // in place
+        output = expected;
+        aes_cbc(false, output, key, iv, output);
+        EXPECT_EQ(output, input);
+      });
+    }
+  }
+}
+
+// example taken from
+// https://nvlpubs.nist.gov/nistpubs/Legacy/SP/nistspecialpublication800-38a.pdf
+// F.5.1 CTR-AES128.Encrypt
+TEST(AES, CTR) {
+  std::vector<uint8_t> vec_output;
+  std::string iv = "f0f1f2f3f4f5f6f7f8f9fafbfcfdfeff";
+  std::string key = "2b7e151628aed2a6abf7158809cf4f3c";
+  std::string input = "6bc1bee22e409f96e93d7e117393172a"
+                      "ae2d8a571e03ac9c9eb76fac45af8e51"
+                      "30c81c46a35ce411e5fbc1191a0a52ef"
+                      "f69f2445df4f9b17ad2b417be66c3710";
+  std::string output = "874d6191b620e3261bef6864990db6ce"
+                       "9806f66b7970fdff8617187bb9fffdff"
+                       "5ae4df3edbd5d35e5b4f09020db03eab"
+                       "1e031dda2fbe03d1792170a0f3009cee";
+  for_each_aes_backend([&](AESBackend) {
+    aes128_ctr(parse_hex_new(input), parse_hex_new(key), parse_hex_new(iv),
+               vec_output);
+    EXPECT_EQ(vec_output, parse_hex_new(output));
+  });
+}
+
+// test cases 2-4 of the GCM specification, and a 60-byte iv
+TEST(AES, GCM) {
+  std::string key = "feffe9928665731c6d6a8f9467308308";
+  std::string iv = "cafebabefacedbaddecaf888";
+  std::string long_iv =
+      "9313225df88406e5a55909c5aff5269aa6a7a9538534f7da1e4c303d2a318a72"
+      "8c3c0c95156809539fcf0e2429a6b525416aedbf5a0de6a57a637b39";
+  std::string aad = "feedfacedeadbeeffeedfacedeadbeefabaddad2";
+  std::string input = "d9313225f88406e5a55909c5aff5269a"
+                      "86a7a9531534f7da2e4c303d8a318a72"
+                      "1c3c0c95956809532fcf0e2449a6b525"
+                      "b16aedf5aa0de657ba637b391aafd255";
+  std::string output = "42831ec2217774244b7221b784d0d49c"
+                       "e3aa212f2c02a4e035c17e2329aca12e"
+                       "21d514b25466931c7d8f6a5aac84aa05"
+                       "1ba30b396a0aac973d58e091473f5985";
+  // generated with openssl
+  std::string output_long_iv = "d029c111c6bdfdd623b71099d2f95c63"
+                               "da791e92eb85ddb2878f69b77aa33074"
+                               "fd746147c98727f81a71749d7936a41c"
+                               "46428b0dc338adaf27d27fb8";
+  std::vector<uint8_t> vec_output, vec_tag, vec_plain;
+  for_each_aes_backend([&](AESBackend) {
+    aes128_gcm_encrypt(std::vector<uint8_t>(16), std::vector<uint8_t>(16),
+                       std::vector<uint8_t>(12), {}, vec_output, vec_tag);
+    EXPECT_EQ(vec_output, parse_hex_new("0388dace60b6a392f328c2b971b2fe78"));
+    EXPECT_EQ(vec_tag, parse_hex_new("ab6e47d42cec13bdf53a67b21257bddf"));
+
+    aes128_gcm_encrypt(parse_hex_new(input), parse_hex_new(key),
+                       parse_hex_new(iv), {}, vec_output, vec_tag);
+    EXPECT_EQ(vec_output, parse_hex_new(output));
+    EXPECT_EQ(vec_tag, parse_hex_new("4d5c2af327cd64a62cf35abd2ba6fab4"));
+
+    // 60 bytes with aad
+    std::vector<uint8_t> vec_input = parse_hex_new(input);
+    vec_input.resize(60);
+    std::vector<uint8_t> expected = parse_hex_new(output);
+    expected.resize(60);
+    aes128_gcm_encrypt(vec_input, parse_hex_new(key), parse_hex_new(iv),
+                       parse_hex_new(aad), vec_output, vec_tag);
+    EXPECT_EQ(vec_output, expected);
+    EXPECT_EQ(vec_tag, parse_hex_new("5bc94fbc3221a5db94fae95ae7121a47"));
+    EXPECT_TRUE(aes128_gcm_decrypt(vec_output, parse_hex_new(key),
+                                   parse_hex_new(iv), parse_hex_new(aad),
+                                   vec_tag, vec_plain));
+    EXPECT_EQ(vec_plain, vec_input);
+
+    // iv of 60 bytes
+    aes128_gcm_encrypt(vec_input, parse_hex_new(key), parse_hex_new(long_iv),
+                       parse_hex_new(aad), vec_output, vec_tag);
+    EXPECT_EQ(vec_output, parse_hex_new(output_long_iv));
+    EXPECT_EQ(vec_tag, parse_hex_new("ab409cef23414822cd79ce54079134f4"));
+  });
+}
+
+TEST(AES, GCMTamper) {
+  std::vector<uint8_t> input(100), key(16), iv(12), aad(20);
+  random_fill(input);
+  random_fill(key);
+  random_fill(iv);
+  random_fill(aad);
+  std::vector<uint8_t> cipher, tag, plain;
+  aes128_gcm_encrypt(input, key, iv, aad, cipher, tag);
+  ASSERT_TRUE(aes128_gcm_decrypt(cipher, key, iv, aad, tag, plain));
+  EXPECT_EQ(plain, input);
+
+  cipher[50] ^= 1;
+  EXPECT_FALSE(aes128_gcm_decrypt(cipher, key, iv, aad, tag, plain));
+  EXPECT_TRUE(plain.empty());
+  cipher[50] ^= 1;
+  aad[0] ^= 1;
+  EXPECT_FALSE(aes128_gcm_decrypt(cipher, key, iv, aad, tag, plain));
+  aad[0] ^= 1;
+  tag[15] ^= 1;
+  EXPECT_FALSE(aes128_gcm_decrypt(cipher, key, iv, aad, tag, plain));
+}
+
+// the 4-bit tables and PCLMULQDQ agree on random keys and lengths
+TEST(GHASH, TableAndCLMUL) {
+  if (!cpu_has_pclmul()) {
+    return;
+  }
+  for (size_t blocks : {1, 3, 4, 5, 17}) {
+    std::vector<uint8_t> h(16), input(16 * blocks), state(16);
+    random_fill(h);
+    random_fill(input);
+    random_fill(state);
+    std::vector<uint8_t> expected = state;
+    ghash_key table_key, clmul_key;
+    ghash_init(table_key, h.data(), false);
+    ghash_init(clmul_key, h.data(), true);
+    ghash_update(table_key, expected.data(), input.data(), blocks);
+    ghash_update(clmul_key, state.data(), input.data(), blocks);
+    EXPECT_EQ(state, expected);
+  }
+}
+
+// large inputs are split into chunks for threads, the result must be the
+// same as splitting at any other block
+TEST(AES, CTRChunks) {
+  std::vector<uint8_t> input(16 * 10000 + 5), key(16);
+  random_fill(input);
+  random_fill(key);
+  // the counter wraps around in the middle
+  std::vector<uint8_t> iv = parse_hex_new("fffffffffffffffffffffffffffff000");
+  std::vector<uint8_t> expected;
+  aes128_ctr(input, key, iv, expected);
+
+  size_t split = 16 * 4097;
+  std::vector<uint8_t> first(input.begin(), input.begin() + split);
+  std::vector<uint8_t> second(input.begin() + split, input.end());
+  std::vector<uint8_t> output, output2;
+  aes128_ctr(first, key, iv, output);
+  iv = parse_hex_new("00000000000000000000000000000001");
+  aes128_ctr(second, key, iv, output2);
+  output.insert(output.end(), output2.begin(), output2.end());
+  EXPECT_EQ(output, expected);
+}
+
+// the context keeps the backend it was created with
+TEST(AES, Context) {
+  aes_backend_guard guard;
+  std::vector<uint8_t> input(16 * 37), key(32), iv(16);
+  random_fill(input);
+  random_fill(key);
+  random_fill(iv);
+  std::vector<uint8_t> expected, output;
+  ASSERT_TRUE(aes_set_backend(AESBackend::Table));
+  aes_cbc(true, input, key, iv, expected);
+  for_each_aes_backend([&](AESBackend) {
+    aes_context ctx;
+    aes_init(ctx, key);
+    aes_set_backend(AESBackend::Table);
+    for (int i = 0; i < 2; i++) {
+      aes_cbc_encrypt(ctx, input, iv, output);
+      EXPECT_EQ(output, expected);
+      aes_cbc_decrypt(ctx, expected, iv, output);
+      EXPECT_EQ(output, input);
+    }
+  });
+}
+
+// messages of all key sizes and lengths, more than the 8 streams at once and
+// enough for several threads
+TEST(AES, CBCBatch) {
+  for_each_aes_backend([&](AESBackend) {
+    const size_t count = 300;
+    std::vector<aes_context> ctxs(count);
+    std::vector<std::vector<uint8_t>> inputs(count), ivs(count), outputs(count);
+    std::vector<cbc_job<aes_context>> jobs;
+    for (size_t i = 0; i < count; i++) {
+      std::vector<uint8_t> key(16 + 8 * (i % 3));
+      random_fill(key);
+      aes_init(ctxs[i], key);
+      inputs[i].resize(16 * (i * 7 % 60));
+      ivs[i].resize(16);
+      random_fill(inputs[i]);
+      random_fill(ivs[i]);
+      jobs.push_back({&ctxs[i], &inputs[i], &ivs[i], &outputs[i]});
+    }
+    aes_cbc_encrypt_batch(jobs);
+    for (size_t i = 0; i < count; i++) {
+      std::vector<uint8_t> expected;
+      aes_cbc_encrypt(ctxs[i], inputs[i], ivs[i], expected);
+      EXPECT_EQ(outputs[i], expected);
+    }
+  });
+}
+
+// vector 1 of IEEE 1619, and sectors of 32 and 48 bytes checked with openssl
+TEST(AES, XTS) {
+  std::vector<std::vector<uint8_t>> keys = {
+      std::vector<uint8_t>(32),
+      parse_hex_new(
+          "000102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f"),
+      parse_hex_new(
+          "fffefdfcfbfaf9f8f7f6f5f4f3f2f1f0efeeedecebeae9e8e7e6e5e4e3e2e1e0"
+          "dfdedddcdbdad9d8d7d6d5d4d3d2d1d0cfcecdcccbcac9c8c7c6c5c4c3c2c1c0")};
+  std::vector<uint64_t> sectors = {0, 0x123456789a, 7};
+  std::vector<size_t> sector_sizes = {512, 32, 48};
+  std::vector<size_t> lengths = {32, 96, 48};
+  std::vector<std::string> outputs = {
+      "917cf69ebd68b2ec9b9fe9a3eadda692cd43d2f59598ed858c02c2652fbf922e",
+      "3ca6c425e2f83bf789206f1403f8532260fb0aba46365325d6fb0b92d1be3066"
+      "02cf40e6a835ce8823503240551f7f5edcdcd311c007c5ca6c0ee7521402848f"
+      "f5105b0283a09b54af34445044921e004d437f32f26840b921e2fbe6bd4e8be1",
+      "d43253f4b6419af94e8da7464300ae39e91ebdf006805fb5ea4921b398079fdb"
+      "b719f4baec32cd6a28ca64422c4abae7"};
+  for_each_aes_backend([&](AESBackend) {
+    for (size_t i = 0; i < keys.size(); i++) {
+      // zeros for vector 1, 0, 1, 2, ... for the others
+      std::vector<uint8_t> input(lengths[i]), output, plain;
+      for (size_t j = 0; i > 0 && j < input.size(); j++) {
+        input[j] = j;
+      }
+      aes_xts_context ctx;
+      aes_xts_init(ctx, keys[i]);
+      aes_xts_encrypt(ctx, sectors[i], sector_sizes[i], input, output);
+      EXPECT_EQ(output, parse_hex_new(outputs[i]));
+      aes_xts_decrypt(ctx, sectors[i], sector_sizes[i], output, plain);
+      EXPECT_EQ(plain, input);
+    }
+  });
+}
+
+// sectors are split among threads, the result must be the same as
+// encrypting any range of sectors on its own
+TEST(AES, XTSSectors) {
+  std::vector<uint8_t> input(4096 * 100), key(64);
+  random_fill(input);
+  random_fill(key);
+  aes_xts_context ctx;
+  aes_xts_init(ctx, key);
+  std::vector<uint8_t> expected, output, plain;
+  aes_xts_encrypt(ctx, 1000, 4096, input, expected);
+  aes_xts_decrypt(ctx, 1000, 4096, expected, plain);
+  EXPECT_EQ(plain, input);
+
+  std::vector<uint8_t> range(input.begin() + 4096 * 37,
+                             input.begin() + 4096 * 40);
+  aes_xts_encrypt(ctx, 1037, 4096, range, output);
+  EXPECT_EQ(output, std::vector<uint8_t>(expected.begin() + 4096 * 37,
+                                         expected.begin() + 4096 * 40));
+}
+
+// RFC 4493 and NIST SP 800-38B examples, messages of 0, 16, 40 and 64 bytes
+TEST(AES, CMAC) {
+  std::vector<uint8_t> message = parse_hex_new(
+      "6bc1bee22e409f96e93d7e117393172aae2d8a571e03ac9c9eb76fac45af8e51"
+      "30c81c46a35ce411e5fbc1191a0a52eff69f2445df4f9b17ad2b417be66c3710");
+  std::vector<std::vector<uint8_t>> keys = {
+      parse_hex_new("2b7e151628aed2a6abf7158809cf4f3c"),
+      parse_hex_new(
+          "603deb1015ca71be2b73aef0857d77811f352c073b6108d72d9810a30914dff4")};
+  std::vector<size_t> lengths = {0, 16, 40, 64};
+  std::vector<std::vector<std::string>> tags = {
+      {"bb1d6929e95937287fa37d129b756746", "070a16b46b4d4144f79bdd9dd04a287c",
+       "dfa66747de9ae63030ca32611497c827", "51f0bebf7e3b9d92fc49741779363cfe"},
+      {"028962f61b7bf89efc6b551f4667d983", "28a7023f452e8f82bd4bf28d8c37c35c",
+       "aaf3d8f1de5640c232f5b169b9c911e6", "e1992190549f6ed5696a2c056c315410"}};
+  for_each_aes_backend([&](AESBackend) {
+    for (size_t i = 0; i < keys.size(); i++) {
+      aes_cmac_context ctx;
+      aes_cmac_init(ctx, keys[i]);
+      for (size_t j = 0; j < lengths.size(); j++) {
+        std::vector<uint8_t> input(message.begin(),
+                                   message.begin() + lengths[j]);
+        std::vector<uint8_t> tag;
+        aes_cmac(ctx, input, tag);
+        EXPECT_EQ(tag, parse_hex_new(tags[i][j]));
+
+        // the same message in pieces of 1, 2, 3, ... bytes
+        cmac_state state;
+        cmac_start(state);
+        for (size_t offset = 0, step = 1; offset < input.size();
+             offset += step, step++) {
+          size_t end =
+              offset + step < input.size() ? offset + step : input.size();
+          aes_cmac_update(ctx, state,
+                          std::vector<uint8_t>(input.begin() + offset,
+                                               input.begin() + end));
+        }
+        aes_cmac_final(ctx, state, tag);
+        EXPECT_EQ(tag, parse_hex_new(tags[i][j]));
+      }
+    }
+  });
+}
+
+// messages of all key sizes and lengths, including partial and empty ones
+TEST(AES, CMACBatch) {
+  for_each_aes_backend([&](AESBackend) {
+    const size_t count = 300;
+    std::vector<aes_cmac_context> ctxs(count);
+    std::vector<std::vector<uint8_t>> inputs(count), tags(count);
+    std::vector<cmac_job<aes_cmac_context>> jobs;
+    for (size_t i = 0; i < count; i++) {
+      std::vector<uint8_t> key(16 + 8 * (i % 3));
+      random_fill(key);
+      aes_cmac_init(ctxs[i], key);
+      inputs[i].resize(i * 13 % 500);
+      random_fill(inputs[i]);
+      jobs.push_back({&ctxs[i], &inputs[i], &tags[i]});
+    }
+    aes_cmac_batch(jobs);
+    for (size_t i = 0; i < count; i++) {
+      std::vector<uint8_t> expected;
+      aes_cmac(ctxs[i], inputs[i], expected);
+      EXPECT_EQ(tags[i], expected);
+    }
+  });
+}
+
 // example taken from
 // https://tools.ietf.org/id/draft-crypto-sm4-00.html
 class SM4Test : public ::testing::Test {
@@ -123,6 +703,173 @@ TEST_F(SM4Test, EncryptWithZeroIV) {
   EXPECT_EQ(vec_output, parse_hex_new(output));
 }
 
+TEST_F(SM4Test, DecryptWithZeroIV) {
+  std::string input = "681EDF34D206965E86B3E94F536E4246";
+  sm4_cbc(false, parse_hex_new(input), parse_hex_new(key), parse_hex_new(iv),
+          vec_output);
+  EXPECT_EQ(vec_output, parse_hex_new(this->input));
+}
+
+// decryption runs several blocks at once, cover both paths
+TEST_F(SM4Test, DecryptManyBlocks) {
+  std::vector<uint8_t> vec_input(16 * 11);
+  random_fill(vec_input);
+  std::vector<uint8_t> vec_encrypted;
+  sm4_cbc(true, vec_input, parse_hex_new(key), parse_hex_new(iv),
+          vec_encrypted);
+  sm4_cbc(false, vec_encrypted, parse_hex_new(key), parse_hex_new(iv),
+          vec_output);
+  EXPECT_EQ(vec_output, vec_input);
+  // in place
+  sm4_cbc(false, vec_encrypted, parse_hex_new(key), parse_hex_new(iv),
+          vec_encrypted);
+  EXPECT_EQ(vec_encrypted, vec_input);
+}
+
+TEST_F(SM4Test, Context) {
+  sm4_context ctx;
+  sm4_init(ctx, parse_hex_new(key));
+  for (int i = 0; i < 2; i++) {
+    sm4_cbc_encrypt(ctx, parse_hex_new(input), parse_hex_new(iv), vec_output);
+    EXPECT_EQ(vec_output, parse_hex_new("681EDF34D206965E86B3E94F536E4246"));
+    sm4_cbc_decrypt(ctx, parse_hex_new("681EDF34D206965E86B3E94F536E4246"),
+                    parse_hex_new(iv), vec_output);
+    EXPECT_EQ(vec_output, parse_hex_new(input));
+  }
+}
+
+TEST_F(SM4Test, CBCBatch) {
+  const size_t count = 10;
+  std::vector<sm4_context> ctxs(count);
+  std::vector<std::vector<uint8_t>> inputs(count), ivs(count), outputs(count);
+  std::vector<cbc_job<sm4_context>> jobs;
+  for (size_t i = 0; i < count; i++) {
+    std::vector<uint8_t> key(16);
+    random_fill(key);
+    sm4_init(ctxs[i], key);
+    inputs[i].resize(16 * (i * 3 % 7));
+    ivs[i].resize(16);
+    random_fill(inputs[i]);
+    random_fill(ivs[i]);
+    jobs.push_back({&ctxs[i], &inputs[i], &ivs[i], &outputs[i]});
+  }
+  sm4_cbc_encrypt_batch(jobs);
+  for (size_t i = 0; i < count; i++) {
+    std::vector<uint8_t> expected;
+    sm4_cbc_encrypt(ctxs[i], inputs[i], ivs[i], expected);
+    EXPECT_EQ(outputs[i], expected);
+  }
+}
+
+// every backend must agree with the table based implementation
+TEST_F(SM4Test, Backends) {
+  // batches of 4, 8, 64 and 256 blocks, and partial ones, on both sides of
+  // the AVX2 threshold of Auto
+  for (size_t blocks : {1, 3, 4, 13, 40, 64, 300}) {
+    std::vector<uint8_t> plain(blocks * 16), vec_key(16), vec_iv(16);
+    random_fill(plain);
+    random_fill(vec_key);
+    random_fill(vec_iv);
+    std::vector<uint8_t> expected, expected_ctr;
+    ASSERT_TRUE(sm4_set_backend(SM4Backend::Table));
+    sm4_cbc(true, plain, vec_key, vec_iv, expected);
+    sm4_ctr(plain, vec_key, vec_iv, expected_ctr);
+    for (SM4Backend backend : {SM4Backend::Table, SM4Backend::AESNI,
+                               SM4Backend::Bitslice, SM4Backend::Auto}) {
+      if (!sm4_set_backend(backend)) {
+        continue;
+      }
+      sm4_cbc(true, plain, vec_key, vec_iv, vec_output);
+      EXPECT_EQ(vec_output, expected);
+      sm4_cbc(false, expected, vec_key, vec_iv, vec_output);
+      EXPECT_EQ(vec_output, plain);
+      // in place
+      vec_output = expected;
+      sm4_cbc(false, vec_output, vec_key, vec_iv, vec_output);
+      EXPECT_EQ(vec_output, plain);
+      sm4_ctr(plain, vec_key, vec_iv, vec_output);
+      EXPECT_EQ(vec_output, expected_ctr);
+    }
+  }
+  sm4_set_backend(SM4Backend::Auto);
+}
+
+// tags computed by openssl mac -cipher SM4-CBC CMAC
+TEST_F(SM4Test, CMAC) {
+  std::vector<uint8_t> message = parse_hex_new(
+      "6bc1bee22e409f96e93d7e117393172aae2d8a571e03ac9c9eb76fac45af8e51"
+      "30c81c46a35ce411e5fbc1191a0a52eff69f2445df4f9b17ad2b417be66c3710");
+  std::vector<size_t> lengths = {0, 16, 40, 64};
+  std::vector<std::string> tags = {
+      "29e154322e5c7bd8ee6a25ba549b24bc", "07a0861ededd5cfcead8489011600b9c",
+      "67a8e59526f59125b5d91e626d23a37a", "cc8eda3eeed4cd37b55fa09b06c6f630"};
+  sm4_cmac_context ctx;
+  sm4_cmac_init(ctx, parse_hex_new(key));
+  std::vector<std::vector<uint8_t>> inputs(lengths.size()),
+      batch_tags(lengths.size());
+  std::vector<cmac_job<sm4_cmac_context>> jobs;
+  for (size_t i = 0; i < lengths.size(); i++) {
+    inputs[i].assign(message.begin(), message.begin() + lengths[i]);
+    sm4_cmac(ctx, inputs[i], vec_output);
+    EXPECT_EQ(vec_output, parse_hex_new(tags[i]));
+    jobs.push_back({&ctx, &inputs[i], &batch_tags[i]});
+  }
+  sm4_cmac_batch(jobs);
+  for (size_t i = 0; i < lengths.size(); i++) {
+    EXPECT_EQ(batch_tags[i], parse_hex_new(tags[i]));
+  }
+}
+
+// ciphertext computed by openssl enc -sm4-ctr
+TEST_F(SM4Test, CTR) {
+  std::string iv = "000102030405060708090a0b0c0dfffe";
+  std::string input = "0123456789abcdeffedcba9876543210"
+                      "0123456789abcdeffedcba9876543210aabbccdd";
+  std::string output = "f67cc0bed59752d05f31cb55d67d3493"
+                       "e073fc64da47bd5e7877ca8592def33db16414fe";
+  sm4_ctr(parse_hex_new(input), parse_hex_new(key), parse_hex_new(iv),
+          vec_output);
+  EXPECT_EQ(vec_output, parse_hex_new(output));
+}
+
+// test vector taken from RFC 8998 A.1
+TEST_F(SM4Test, GCM) {
+  std::string iv = "00001234567800000000ABCD";
+  std::string aad = "FEEDFACEDEADBEEFFEEDFACEDEADBEEFABADDAD2";
+  std::string input = "AAAAAAAAAAAAAAAABBBBBBBBBBBBBBBB"
+                      "CCCCCCCCCCCCCCCCDDDDDDDDDDDDDDDD"
+                      "EEEEEEEEEEEEEEEEFFFFFFFFFFFFFFFF"
+                      "EEEEEEEEEEEEEEEEAAAAAAAAAAAAAAAA";
+  std::string output = "17F399F08C67D5EE19D0DC9969C4BB7D"
+                       "5FD46FD3756489069157B282BB200735"
+                       "D82710CA5C22F0CCFA7CBF93D496AC15"
+                       "A56834CBCF98C397B4024A2691233B8D";
+  std::string tag = "83DE3541E4C2B58177E065A9BF7B62EC";
+  std::vector<uint8_t> vec_tag, vec_plain;
+  for (SM4Backend backend :
+       {SM4Backend::Table, SM4Backend::AESNI, SM4Backend::Bitslice}) {
+    if (!sm4_set_backend(backend)) {
+      continue;
+    }
+    sm4_gcm_encrypt(parse_hex_new(input), parse_hex_new(key),
+                    parse_hex_new(iv), parse_hex_new(aad), vec_output,
+                    vec_tag);
+    EXPECT_EQ(vec_output, parse_hex_new(output));
+    EXPECT_EQ(vec_tag, parse_hex_new(tag));
+    EXPECT_TRUE(sm4_gcm_decrypt(vec_output, parse_hex_new(key),
+                                parse_hex_new(iv), parse_hex_new(aad), vec_tag,
+                                vec_plain));
+    EXPECT_EQ(vec_plain, parse_hex_new(input));
+
+    vec_output[10] ^= 1;
+    EXPECT_FALSE(sm4_gcm_decrypt(vec_output, parse_hex_new(key),
+                                 parse_hex_new(iv), parse_hex_new(aad),
+                                 vec_tag, vec_plain));
+    EXPECT_TRUE(vec_plain.empty());
+  }
+  sm4_set_backend(SM4Backend::Auto);
+}
+
 // example taken from
 // https://en.wikipedia.org/wiki/RC4
 class RC4Test : public ::testing::Test {
@@ -146,6 +893,74 @@ TEST_F(RC4Test, EncryptPediaWithKey) {
   EXPECT_EQ(vec_output, parse_hex_new(output));
 }
 
+TEST_F(RC4Test, Streaming) {
+  std::vector<uint8_t> key = parse_hex_new("0102030405");
+  std::vector<uint8_t> input(1000);
+  random_fill(input);
+  rc4(input, key, vec_output);
+
+  // pieces of odd sizes, across the keystream blocks
+  rc4_context ctx;
+  rc4_init(ctx, key);
+  std::vector<uint8_t> streamed;
+  std::vector<uint8_t> piece;
+  size_t sizes[] = {0, 1, 7, 255, 2, 300, 435};
+  size_t offset = 0;
+  for (size_t size : sizes) {
+    rc4_crypt(ctx,
+              std::vector<uint8_t>(input.begin() + offset,
+                                   input.begin() + offset + size),
+              piece);
+    streamed.insert(streamed.end(), piece.begin(), piece.end());
+    offset += size;
+  }
+  EXPECT_EQ(offset, input.size());
+  EXPECT_EQ(streamed, vec_output);
+
+  // in place
+  rc4_init(ctx, key);
+  rc4_crypt(ctx, input, input);
+  EXPECT_EQ(input, vec_output);
+}
+
+TEST_F(RC4Test, Drop) {
+  // RFC 6229, 40-bit key, keystream at offsets 768 and 3072
+  std::vector<uint8_t> key = parse_hex_new("0102030405");
+  rc4_context ctx;
+  rc4_init(ctx, key, 768);
+  rc4_crypt(ctx, std::vector<uint8_t>(16), vec_output);
+  EXPECT_EQ(vec_output, parse_hex_new("eb62638d4f0ba1fe9fca20e05bf8ff2b"));
+  rc4_init(ctx, key, 3072);
+  rc4_crypt(ctx, std::vector<uint8_t>(16), vec_output);
+  EXPECT_EQ(vec_output, parse_hex_new("ec0e11c479dc329dc8da7968fe965681"));
+}
+
+TEST_F(RC4Test, Batch) {
+  // messages of different lengths and keys, some in lockstep, some not
+  size_t sizes[] = {0, 1, 100, 255, 256, 300, 1000, 17, 64};
+  int count = sizeof(sizes) / sizeof(sizes[0]);
+  for (size_t drop : {0, 768}) {
+    for (int n = 1; n <= count; n++) {
+      std::vector<std::vector<uint8_t>> keys(n), inputs(n), outputs(n);
+      std::vector<rc4_job> jobs;
+      for (int i = 0; i < n; i++) {
+        keys[i].resize(i * 29 % 256 + 1);
+        random_fill(keys[i]);
+        inputs[i].resize(sizes[i]);
+        random_fill(inputs[i]);
+        jobs.push_back({&keys[i], &inputs[i], &outputs[i]});
+      }
+      rc4_batch(jobs, drop);
+      for (int i = 0; i < n; i++) {
+        rc4_context ctx;
+        rc4_init(ctx, keys[i], drop);
+        rc4_crypt(ctx, inputs[i], vec_output);
+        EXPECT_EQ(outputs[i], vec_output);
+      }
+    }
+  }
+}
+
 TEST(BM, Reverse) {
   // example taken from slides
   std::vector<uint8_t> vec_output;
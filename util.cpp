@@ -1,6 +1,10 @@
 #include "util.h"
 #include <cassert>
+#include <cstring>
 #include <sys/time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
 
 void parse_hex(const std::string &input, std::vector<uint8_t> &output) {
   assert((input.size() % 2) == 0);
@@ -79,3 +83,88 @@ void hash_pad(std::vector<uint8_t> &data, bool little_endian, int block_size) {
     }
   }
 }
+
+void xor_bytes(uint8_t *output, const uint8_t *a, const uint8_t *b,
+               size_t length) {
+  size_t i = 0;
+  // memcpy compiles to unaligned loads and stores
+  for (; i + 8 <= length; i += 8) {
+    uint64_t x, y;
+    memcpy(&x, &a[i], 8);
+    memcpy(&y, &b[i], 8);
+    x ^= y;
+    memcpy(&output[i], &x, 8);
+  }
+  for (; i < length; i++) {
+    output[i] = a[i] ^ b[i];
+  }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+// CPUID.01H:ECX
+static uint32_t cpuid_1_ecx() {
+  unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+  __get_cpuid(1, &eax, &ebx, &ecx, &edx);
+  return ecx;
+}
+
+static bool detect_avx2() {
+  unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+  if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+    return false;
+  }
+  // the os must save ymm registers: OSXSAVE and XCR0 bit 1(sse), 2(avx)
+  if (!(ecx & bit_OSXSAVE) || !(ecx & bit_AVX)) {
+    return false;
+  }
+  uint32_t xcr0_lo, xcr0_hi;
+  __asm__("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+  if ((xcr0_lo & 0x6) != 0x6) {
+    return false;
+  }
+  // CPUID.(EAX=07H, ECX=0H):EBX.AVX2[bit 5]
+  if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+    return false;
+  }
+  return (ebx & bit_AVX2) != 0;
+}
+#endif
+
+bool cpu_has_aesni() {
+#if defined(__x86_64__) || defined(__i386__)
+  // cpuid is slow(and traps in vm), query only once
+  static const bool result = (cpuid_1_ecx() & bit_AES) != 0;
+  return result;
+#else
+  return false;
+#endif
+}
+
+bool cpu_has_pclmul() {
+#if defined(__x86_64__) || defined(__i386__)
+  // the pshufb byte swap in GHASH needs SSSE3 as well
+  static const bool result =
+      (cpuid_1_ecx() & (bit_PCLMUL | bit_SSSE3)) == (bit_PCLMUL | bit_SSSE3);
+  return result;
+#else
+  return false;
+#endif
+}
+
+bool cpu_has_ssse3() {
+#if defined(__x86_64__) || defined(__i386__)
+  static const bool result = (cpuid_1_ecx() & bit_SSSE3) != 0;
+  return result;
+#else
+  return false;
+#endif
+}
+
+bool cpu_has_avx2() {
+#if defined(__x86_64__) || defined(__i386__)
+  static const bool result = detect_avx2();
+  return result;
+#else
+  return false;
+#endif
+}
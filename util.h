@@ -1,6 +1,7 @@
 #ifndef __UTIL_H__
 #define __UTIL_H__
 
+#include <stdint.h>
 #include <string>
 #include <vector>
 
@@ -14,4 +15,39 @@ uint64_t get_time_us();
 void hash_pad(std::vector<uint8_t> &data, bool little_endian,
               int block_size = 64);
 
+// output[i] = a[i] ^ b[i], 8 bytes at a time
+void xor_bytes(uint8_t *output, const uint8_t *a, const uint8_t *b,
+               size_t length);
+
+// runtime cpu feature detection
+bool cpu_has_aesni();
+bool cpu_has_pclmul();
+bool cpu_has_ssse3();
+bool cpu_has_avx2();
+
+// load/store 32bit words from/to bytes
+inline uint32_t load_le32(const uint8_t *p) {
+  return ((uint32_t)p[3] << 24) | ((uint32_t)p[2] << 16) |
+         ((uint32_t)p[1] << 8) | (uint32_t)p[0];
+}
+
+inline void store_le32(uint8_t *p, uint32_t v) {
+  p[0] = v & 0xFF;
+  p[1] = (v >> 8) & 0xFF;
+  p[2] = (v >> 16) & 0xFF;
+  p[3] = v >> 24;
+}
+
+inline uint32_t load_be32(const uint8_t *p) {
+  return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+         ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+inline void store_be32(uint8_t *p, uint32_t v) {
+  p[0] = v >> 24;
+  p[1] = (v >> 16) & 0xFF;
+  p[2] = (v >> 8) & 0xFF;
+  p[3] = v & 0xFF;
+}
+
 #endif
\ No newline at end of file
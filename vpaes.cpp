@@ -0,0 +1,529 @@
+#include "aes.h"
+#include <cstdlib>
+
+// reference:
+// https://crypto.stanford.edu/vpaes/vpaes.pdf
+// https://eprint.iacr.org/2009/191.pdf
+
+// vector permute AES, after Hamburg's vpaes
+// SubBytes inverts in GF(2^8) = GF(2^4)[t] / (t^2 + t + 8), every step is a
+// PSHUFB lookup of 16 entries indexed by one nibble, so there are no memory
+// accesses indexed by secret data and it runs in constant time
+//
+// the state is kept in coordinates (i, k) of the tower field, x = i + k e
+// with e = 0x16(packed as h << 4 | l for h t + l), i in the high nibble
+// then with j = i + k and inversion in GF(2^4) extended by 1/0 = inf:
+//   io = 1/(1/i + 2/k) + j
+//   jo = 1/(1/j + 2/k) + i
+//   1/x = 0x1f/io + 0x1e/jo
+// PSHUFB returns 0 for indices with the top bit set, which is used for inf
+//
+// the output lookups return the inverse already mapped through the affine
+// transform, MixColumns multipliers and the basis change into coordinates,
+// constants are folded into the round keys
+
+// GF(2^4) modulo x^4 + x + 1
+constexpr uint8_t gf16_mul(uint8_t a, uint8_t b) {
+  uint8_t result = 0;
+  for (int i = 0; i < 4; i++) {
+    if (b & (1 << i)) {
+      result ^= a;
+    }
+    a <<= 1;
+    if (a & 0x10) {
+      a ^= 0x13;
+    }
+  }
+  return result;
+}
+
+constexpr uint8_t gf16_inv(uint8_t a) {
+  for (int b = 1; b < 16; b++) {
+    if (gf16_mul(a, b) == 1) {
+      return b;
+    }
+  }
+  return 0;
+}
+
+// GF(2^4)[t] / (t^2 + t + 8)
+constexpr uint8_t tower_mul(uint8_t a, uint8_t b) {
+  uint8_t ah = a >> 4, al = a & 0xf, bh = b >> 4, bl = b & 0xf;
+  uint8_t hh = gf16_mul(ah, bh);
+  uint8_t h = hh ^ gf16_mul(ah, bl) ^ gf16_mul(al, bh);
+  uint8_t l = gf16_mul(al, bl) ^ gf16_mul(hh, 8);
+  return (h << 4) | l;
+}
+
+// GF(2^8) of AES, modulo x^8 + x^4 + x^3 + x + 1
+constexpr uint8_t gf256_mul(uint8_t a, uint8_t b) {
+  uint8_t result = 0;
+  for (int i = 0; i < 8; i++) {
+    if (b & (1 << i)) {
+      result ^= a;
+    }
+    a = (a << 1) ^ ((a & 0x80) ? 0x1b : 0);
+  }
+  return result;
+}
+
+constexpr uint8_t rotl8(uint8_t x, int bits) {
+  return (x << bits) | (x >> (8 - bits));
+}
+
+// linear part of the S-box affine transform and its inverse
+constexpr uint8_t affine(uint8_t x) {
+  return x ^ rotl8(x, 1) ^ rotl8(x, 2) ^ rotl8(x, 3) ^ rotl8(x, 4);
+}
+
+constexpr uint8_t inv_affine(uint8_t x) {
+  return rotl8(x, 1) ^ rotl8(x, 3) ^ rotl8(x, 6);
+}
+
+// the state basis:
+// encryption keeps T(x) = coordinates of the AES byte x in the tower field
+// decryption keeps D(x) = T(A^-1 x), so InvSubBytes starts with an inversion
+// lo/hi tables are indexed by nibbles, [0] for the low nibble, [1] for high
+struct VPTables {
+  // 1/n and 2/n in GF(2^4), inf for n = 0
+  uint8_t inv[16];
+  uint8_t inva[16];
+  // AES byte to T and D
+  uint8_t enc_in[2][16];
+  uint8_t dec_in[2][16];
+  // from io and jo: T(S), T(2 S), S in the last round, without the constant
+  uint8_t enc_s[2][16];
+  uint8_t enc_s2[2][16];
+  uint8_t enc_last[2][16];
+  // from io and jo: D(e S^-1), D(b S^-1), D(d S^-1), D(9 S^-1), S^-1
+  uint8_t dec_mul[4][2][16];
+  uint8_t dec_last[2][16];
+  // ShiftRows followed by rotation of each column by k rows
+  uint8_t enc_shift[4][16];
+  // InvShiftRows followed by rotation of each column by k rows
+  uint8_t dec_shift[4][16];
+};
+
+constexpr VPTables make_vptables() {
+  VPTables tables = {};
+
+  // isomorphism from the AES field, x maps to a root of x^8 + x^4 + x^3 + x +
+  // 1 in the tower field
+  uint8_t powers[8] = {};
+  powers[0] = 1;
+  for (int i = 1; i < 8; i++) {
+    powers[i] = tower_mul(powers[i - 1], 0x20);
+  }
+  uint8_t to_tower[256] = {};
+  uint8_t from_tower[256] = {};
+  for (int x = 0; x < 256; x++) {
+    uint8_t y = 0;
+    for (int i = 0; i < 8; i++) {
+      if (x & (1 << i)) {
+        y ^= powers[i];
+      }
+    }
+    to_tower[x] = y;
+    from_tower[y] = x;
+  }
+  // tower field element to coordinates
+  uint8_t coords[256] = {};
+  for (int i = 0; i < 16; i++) {
+    for (int k = 0; k < 16; k++) {
+      coords[i ^ tower_mul(k, 0x16)] = (i << 4) | k;
+    }
+  }
+
+  for (int n = 0; n < 16; n++) {
+    tables.inv[n] = n ? gf16_inv(n) : 0x80;
+    tables.inva[n] = n ? gf16_mul(2, gf16_inv(n)) : 0x80;
+    for (int half = 0; half < 2; half++) {
+      uint8_t x = half ? n << 4 : n;
+      tables.enc_in[half][n] = coords[to_tower[x]];
+      tables.dec_in[half][n] = coords[to_tower[inv_affine(x)]];
+
+      // the part of the inverse from io(half = 0) or jo(half = 1)
+      uint8_t y = from_tower[tower_mul(half ? 0x1e : 0x1f, gf16_inv(n))];
+      uint8_t sy = affine(y);
+      tables.enc_s[half][n] = coords[to_tower[sy]];
+      tables.enc_s2[half][n] = coords[to_tower[gf256_mul(sy, 2)]];
+      tables.enc_last[half][n] = sy;
+      const uint8_t muls[4] = {0xe, 0xb, 0xd, 0x9};
+      for (int i = 0; i < 4; i++) {
+        uint8_t z = gf256_mul(y, muls[i]);
+        tables.dec_mul[i][half][n] = coords[to_tower[inv_affine(z)]];
+      }
+      tables.dec_last[half][n] = y;
+    }
+  }
+
+  // byte 4c + r is row r of column c
+  for (int k = 0; k < 4; k++) {
+    for (int c = 0; c < 4; c++) {
+      for (int r = 0; r < 4; r++) {
+        int row = (r + k) % 4;
+        tables.enc_shift[k][4 * c + r] = 4 * ((c + row) % 4) + row;
+        tables.dec_shift[k][4 * c + r] = 4 * ((c + 4 - row) % 4) + row;
+      }
+    }
+  }
+  return tables;
+}
+
+constexpr VPTables vptables = make_vptables();
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <tmmintrin.h>
+
+// compile SSSE3 code without -mssse3, callers check cpu_has_ssse3() first
+#define VPAES_TARGET __attribute__((target("ssse3")))
+#define VPAES_INLINE inline __attribute__((always_inline))
+
+// blocks in flight for independent blocks
+const int vp_lanes = 4;
+
+VPAES_TARGET VPAES_INLINE __m128i vp_load(const uint8_t table[16]) {
+  return _mm_loadu_si128((const __m128i *)table);
+}
+
+// table[0][low nibble] ^ table[1][high nibble]
+VPAES_TARGET VPAES_INLINE __m128i vp_lookup(const uint8_t table[2][16],
+                                            __m128i lo, __m128i hi) {
+  return _mm_xor_si128(_mm_shuffle_epi8(vp_load(table[0]), lo),
+                       _mm_shuffle_epi8(vp_load(table[1]), hi));
+}
+
+VPAES_TARGET VPAES_INLINE __m128i vp_transform(const uint8_t table[2][16],
+                                               __m128i x) {
+  const __m128i mask = _mm_set1_epi8(0x0f);
+  return vp_lookup(table, _mm_and_si128(x, mask),
+                   _mm_and_si128(_mm_srli_epi32(x, 4), mask));
+}
+
+// io and jo of the inversion
+VPAES_TARGET VPAES_INLINE void vp_invert(__m128i x, __m128i &io,
+                                         __m128i &jo) {
+  const __m128i mask = _mm_set1_epi8(0x0f);
+  const __m128i inv = vp_load(vptables.inv);
+  __m128i k = _mm_and_si128(x, mask);
+  __m128i i = _mm_and_si128(_mm_srli_epi32(x, 4), mask);
+  __m128i j = _mm_xor_si128(i, k);
+  __m128i ak = _mm_shuffle_epi8(vp_load(vptables.inva), k);
+  __m128i iak = _mm_xor_si128(_mm_shuffle_epi8(inv, i), ak);
+  __m128i jak = _mm_xor_si128(_mm_shuffle_epi8(inv, j), ak);
+  io = _mm_xor_si128(_mm_shuffle_epi8(inv, iak), j);
+  jo = _mm_xor_si128(_mm_shuffle_epi8(inv, jak), i);
+}
+
+VPAES_TARGET VPAES_INLINE __m128i vp_shift(const uint8_t table[16],
+                                           __m128i x) {
+  return _mm_shuffle_epi8(x, vp_load(table));
+}
+
+VPAES_TARGET VPAES_INLINE __m128i vp_key(const uint32_t *roundkeys,
+                                         int round) {
+  return _mm_loadu_si128((const __m128i *)&roundkeys[round * 4]);
+}
+
+// encrypt n blocks, block j with roundkeys[j]
+template <int rounds, int n>
+VPAES_TARGET VPAES_INLINE void vp_encrypt(const uint32_t *const roundkeys[n],
+                                          __m128i state[n]) {
+#pragma GCC unroll 8
+  for (int j = 0; j < n; j++) {
+    state[j] = _mm_xor_si128(vp_transform(vptables.enc_in, state[j]),
+                             vp_key(roundkeys[j], 0));
+  }
+#pragma GCC unroll 14
+  for (int round = 1; round <= rounds - 1; round++) {
+#pragma GCC unroll 8
+    for (int j = 0; j < n; j++) {
+      __m128i io, jo;
+      vp_invert(state[j], io, jo);
+      __m128i s = vp_lookup(vptables.enc_s, io, jo);
+      __m128i s2 = vp_lookup(vptables.enc_s2, io, jo);
+      // MixColumns: 2 a[r] + 3 a[r + 1] + a[r + 2] + a[r + 3]
+      // 3 a[r + 1] comes last, it is on the critical path
+      __m128i out = _mm_xor_si128(vp_shift(vptables.enc_shift[0], s2),
+                                  vp_key(roundkeys[j], round));
+      out = _mm_xor_si128(out, vp_shift(vptables.enc_shift[2], s));
+      out = _mm_xor_si128(out, vp_shift(vptables.enc_shift[3], s));
+      state[j] = _mm_xor_si128(
+          out, vp_shift(vptables.enc_shift[1], _mm_xor_si128(s2, s)));
+    }
+  }
+#pragma GCC unroll 8
+  for (int j = 0; j < n; j++) {
+    __m128i io, jo;
+    vp_invert(state[j], io, jo);
+    __m128i s = vp_lookup(vptables.enc_last, io, jo);
+    state[j] = _mm_xor_si128(vp_shift(vptables.enc_shift[0], s),
+                             vp_key(roundkeys[j], rounds));
+  }
+}
+
+// decrypt n blocks with the equivalent inverse cipher
+template <int rounds, int n>
+VPAES_TARGET VPAES_INLINE void vp_decrypt(const uint32_t *dec_roundkeys,
+                                          __m128i state[n]) {
+#pragma GCC unroll 8
+  for (int j = 0; j < n; j++) {
+    state[j] = _mm_xor_si128(vp_transform(vptables.dec_in, state[j]),
+                             vp_key(dec_roundkeys, 0));
+  }
+#pragma GCC unroll 14
+  for (int round = 1; round <= rounds - 1; round++) {
+#pragma GCC unroll 8
+    for (int j = 0; j < n; j++) {
+      __m128i io, jo;
+      vp_invert(state[j], io, jo);
+      // InvMixColumns: e a[r] + b a[r + 1] + d a[r + 2] + 9 a[r + 3]
+      __m128i out = _mm_setzero_si128();
+#pragma GCC unroll 4
+      for (int k = 0; k < 4; k++) {
+        __m128i s = vp_lookup(vptables.dec_mul[k], io, jo);
+        out = _mm_xor_si128(out, vp_shift(vptables.dec_shift[k], s));
+      }
+      state[j] = _mm_xor_si128(out, vp_key(dec_roundkeys, round));
+    }
+  }
+#pragma GCC unroll 8
+  for (int j = 0; j < n; j++) {
+    __m128i io, jo;
+    vp_invert(state[j], io, jo);
+    __m128i s = vp_lookup(vptables.dec_last, io, jo);
+    state[j] = _mm_xor_si128(vp_shift(vptables.dec_shift[0], s),
+                             vp_key(dec_roundkeys, rounds));
+  }
+}
+
+template <int rounds>
+VPAES_TARGET void
+vpaes_expand_key(const uint32_t roundkeys[(rounds + 1) * 4],
+                 const uint32_t dec_roundkeys[(rounds + 1) * 4],
+                 uint32_t vp_roundkeys[(rounds + 1) * 4],
+                 uint32_t vp_dec_roundkeys[(rounds + 1) * 4]) {
+  // the S-box constant goes through MixColumns unchanged
+  const __m128i c = _mm_set1_epi8(0x63);
+  __m128i *vk = (__m128i *)vp_roundkeys;
+  __m128i *vdk = (__m128i *)vp_dec_roundkeys;
+  _mm_storeu_si128(&vk[0],
+                   vp_transform(vptables.enc_in, vp_key(roundkeys, 0)));
+  for (int round = 1; round <= rounds - 1; round++) {
+    __m128i key = _mm_xor_si128(vp_key(roundkeys, round), c);
+    _mm_storeu_si128(&vk[round], vp_transform(vptables.enc_in, key));
+  }
+  _mm_storeu_si128(&vk[rounds], _mm_xor_si128(vp_key(roundkeys, rounds), c));
+
+  // D(x ^ 0x63) is the input of the inversion in InvSubBytes
+  for (int round = 0; round <= rounds - 1; round++) {
+    __m128i key = _mm_xor_si128(vp_key(dec_roundkeys, round), c);
+    _mm_storeu_si128(&vdk[round], vp_transform(vptables.dec_in, key));
+  }
+  _mm_storeu_si128(&vdk[rounds], vp_key(dec_roundkeys, rounds));
+}
+
+template <int rounds>
+VPAES_TARGET void
+vpaes_cbc_encrypt(const uint32_t vp_roundkeys[(rounds + 1) * 4],
+                  const uint8_t iv[16], const uint8_t *input, uint8_t *output,
+                  size_t blocks) {
+  const uint32_t *keys[1] = {vp_roundkeys};
+  __m128i state = _mm_loadu_si128((const __m128i *)iv);
+  for (size_t i = 0; i < blocks; i++) {
+    // plain text is xored with last cipher text
+    __m128i data = _mm_loadu_si128((const __m128i *)&input[i * 16]);
+    state = _mm_xor_si128(state, data);
+    vp_encrypt<rounds, 1>(keys, &state);
+    _mm_storeu_si128((__m128i *)&output[i * 16], state);
+  }
+}
+
+template <int rounds>
+VPAES_TARGET void
+vpaes_cbc_decrypt(const uint32_t vp_dec_roundkeys[(rounds + 1) * 4],
+                  const uint8_t iv[16], const uint8_t *input, uint8_t *output,
+                  size_t blocks) {
+  __m128i cur_iv = _mm_loadu_si128((const __m128i *)iv);
+  size_t i = 0;
+  for (; i + vp_lanes <= blocks; i += vp_lanes) {
+    __m128i data[vp_lanes];
+    __m128i state[vp_lanes];
+#pragma GCC unroll 8
+    for (int j = 0; j < vp_lanes; j++) {
+      data[j] = _mm_loadu_si128((const __m128i *)&input[(i + j) * 16]);
+      state[j] = data[j];
+    }
+    vp_decrypt<rounds, vp_lanes>(vp_dec_roundkeys, state);
+    // plain text is xored with last cipher text
+#pragma GCC unroll 8
+    for (int j = 0; j < vp_lanes; j++) {
+      _mm_storeu_si128((__m128i *)&output[(i + j) * 16],
+                       _mm_xor_si128(state[j], cur_iv));
+      cur_iv = data[j];
+    }
+  }
+
+  // tail, one block at a time
+  for (; i < blocks; i++) {
+    __m128i data = _mm_loadu_si128((const __m128i *)&input[i * 16]);
+    __m128i state = data;
+    vp_decrypt<rounds, 1>(vp_dec_roundkeys, &state);
+    _mm_storeu_si128((__m128i *)&output[i * 16],
+                     _mm_xor_si128(state, cur_iv));
+    cur_iv = data;
+  }
+}
+
+template <int rounds>
+VPAES_TARGET void
+vpaes_ecb_encrypt(const uint32_t vp_roundkeys[(rounds + 1) * 4],
+                  const uint8_t *input, uint8_t *output, size_t blocks) {
+  const uint32_t *keys[vp_lanes];
+  for (int j = 0; j < vp_lanes; j++) {
+    keys[j] = vp_roundkeys;
+  }
+  size_t i = 0;
+  for (; i + vp_lanes <= blocks; i += vp_lanes) {
+    __m128i state[vp_lanes];
+#pragma GCC unroll 8
+    for (int j = 0; j < vp_lanes; j++) {
+      state[j] = _mm_loadu_si128((const __m128i *)&input[(i + j) * 16]);
+    }
+    vp_encrypt<rounds, vp_lanes>(keys, state);
+#pragma GCC unroll 8
+    for (int j = 0; j < vp_lanes; j++) {
+      _mm_storeu_si128((__m128i *)&output[(i + j) * 16], state[j]);
+    }
+  }
+  for (; i < blocks; i++) {
+    __m128i state = _mm_loadu_si128((const __m128i *)&input[i * 16]);
+    vp_encrypt<rounds, 1>(keys, &state);
+    _mm_storeu_si128((__m128i *)&output[i * 16], state);
+  }
+}
+
+template <int rounds>
+VPAES_TARGET void
+vpaes_ecb_decrypt(const uint32_t vp_dec_roundkeys[(rounds + 1) * 4],
+                  const uint8_t *input, uint8_t *output, size_t blocks) {
+  size_t i = 0;
+  for (; i + vp_lanes <= blocks; i += vp_lanes) {
+    __m128i state[vp_lanes];
+#pragma GCC unroll 8
+    for (int j = 0; j < vp_lanes; j++) {
+      state[j] = _mm_loadu_si128((const __m128i *)&input[(i + j) * 16]);
+    }
+    vp_decrypt<rounds, vp_lanes>(vp_dec_roundkeys, state);
+#pragma GCC unroll 8
+    for (int j = 0; j < vp_lanes; j++) {
+      _mm_storeu_si128((__m128i *)&output[(i + j) * 16], state[j]);
+    }
+  }
+  for (; i < blocks; i++) {
+    __m128i state = _mm_loadu_si128((const __m128i *)&input[i * 16]);
+    vp_decrypt<rounds, 1>(vp_dec_roundkeys, &state);
+    _mm_storeu_si128((__m128i *)&output[i * 16], state);
+  }
+}
+
+template <int rounds>
+VPAES_TARGET void vpaes_cbc_encrypt_multi(const uint32_t *const vp_roundkeys[8],
+                                          uint8_t ivs[8 * 16],
+                                          const uint8_t *const input[8],
+                                          uint8_t *const output[8],
+                                          size_t streams, size_t blocks) {
+  // groups of vp_lanes streams, missing ones are padded with the first stream
+  // of the group and never stored
+  for (size_t first = 0; first < streams; first += vp_lanes) {
+    const uint32_t *keys[vp_lanes];
+    __m128i state[vp_lanes];
+#pragma GCC unroll 8
+    for (int j = 0; j < vp_lanes; j++) {
+      size_t stream = first + j < streams ? first + j : first;
+      keys[j] = vp_roundkeys[stream];
+      state[j] = _mm_loadu_si128((const __m128i *)&ivs[stream * 16]);
+    }
+    for (size_t i = 0; i < blocks; i++) {
+#pragma GCC unroll 8
+      for (int j = 0; j < vp_lanes; j++) {
+        size_t stream = first + j < streams ? first + j : first;
+        __m128i data =
+            _mm_loadu_si128((const __m128i *)&input[stream][i * 16]);
+        state[j] = _mm_xor_si128(state[j], data);
+      }
+      vp_encrypt<rounds, vp_lanes>(keys, state);
+      for (int j = 0; output != nullptr && j < vp_lanes && first + j < streams;
+           j++) {
+        _mm_storeu_si128((__m128i *)&output[first + j][i * 16], state[j]);
+      }
+    }
+    for (int j = 0; j < vp_lanes && first + j < streams; j++) {
+      _mm_storeu_si128((__m128i *)&ivs[(first + j) * 16], state[j]);
+    }
+  }
+}
+
+#else
+
+#define VPAES_TARGET
+
+template <int rounds>
+void vpaes_expand_key(const uint32_t[(rounds + 1) * 4],
+                      const uint32_t[(rounds + 1) * 4],
+                      uint32_t[(rounds + 1) * 4], uint32_t[(rounds + 1) * 4]) {
+  abort();
+}
+
+template <int rounds>
+void vpaes_cbc_encrypt(const uint32_t[(rounds + 1) * 4], const uint8_t[16],
+                       const uint8_t *, uint8_t *, size_t) {
+  abort();
+}
+
+template <int rounds>
+void vpaes_cbc_decrypt(const uint32_t[(rounds + 1) * 4], const uint8_t[16],
+                       const uint8_t *, uint8_t *, size_t) {
+  abort();
+}
+
+template <int rounds>
+void vpaes_ecb_encrypt(const uint32_t[(rounds + 1) * 4], const uint8_t *,
+                       uint8_t *, size_t) {
+  abort();
+}
+
+template <int rounds>
+void vpaes_ecb_decrypt(const uint32_t[(rounds + 1) * 4], const uint8_t *,
+                       uint8_t *, size_t) {
+  abort();
+}
+
+template <int rounds>
+void vpaes_cbc_encrypt_multi(const uint32_t *const[8], uint8_t[8 * 16],
+                             const uint8_t *const[8], uint8_t *const[8], size_t,
+                             size_t) {
+  abort();
+}
+
+#endif
+
+// AES-128, AES-192 and AES-256
+#define VPAES_INSTANTIATE(rounds)                                              \
+  template VPAES_TARGET void vpaes_expand_key<rounds>(                         \
+      const uint32_t *, const uint32_t *, uint32_t *, uint32_t *);             \
+  template VPAES_TARGET void vpaes_cbc_encrypt<rounds>(                        \
+      const uint32_t *, const uint8_t *, const uint8_t *, uint8_t *, size_t);  \
+  template VPAES_TARGET void vpaes_cbc_decrypt<rounds>(                        \
+      const uint32_t *, const uint8_t *, const uint8_t *, uint8_t *, size_t);  \
+  template VPAES_TARGET void vpaes_ecb_encrypt<rounds>(                        \
+      const uint32_t *, const uint8_t *, uint8_t *, size_t);                   \
+  template VPAES_TARGET void vpaes_ecb_decrypt<rounds>(                        \
+      const uint32_t *, const uint8_t *, uint8_t *, size_t);                   \
+  template VPAES_TARGET void vpaes_cbc_encrypt_multi<rounds>(                  \
+      const uint32_t *const *, uint8_t *, const uint8_t *const *,              \
+      uint8_t *const *, size_t, size_t);
+
+VPAES_INSTANTIATE(10)
+VPAES_INSTANTIATE(12)
+VPAES_INSTANTIATE(14)